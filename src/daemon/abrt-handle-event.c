@@ -16,9 +16,9 @@
     with this program; if not, write to the Free Software Foundation, Inc.,
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
+#include <satyr/frame.h>
 #include <satyr/thread.h>
 #include <satyr/stacktrace.h>
-#include <satyr/distance.h>
 #include <satyr/abrt.h>
 
 #include "libabrt.h"
@@ -27,12 +27,28 @@
 /* 70 % similarity */
 #define BACKTRACE_DUP_THRESHOLD 0.3
 
+/* The duplicate index element mapping uid, type and executable to the problem
+ * directories */
+#define DUP_INDEX_KEY "dup_key"
+/* The duplicate index element mapping the problem directories to the MinHash
+ * signatures of their crash frames */
+#define DUP_INDEX_LSH "crash_frames_lsh"
+
+/* The threads comparing the problem directories if there is no index */
+#define DUP_SCAN_MAX_THREADS 64
+
 static char *uid = NULL;
 static char *uuid = NULL;
 static struct sr_stacktrace *corebt = NULL;
+/* The crash thread of corebt, if it is a core backtrace */
+static uint64_t *crash_frames = NULL;
+static unsigned crash_frames_count = 0;
+/* The signature of crash_frames, NULL if all crash frames are unknown */
+static char *lsh_signature = NULL;
 static char *type = NULL;
 static char *executable = NULL;
 static char *crash_dump_dup_name = NULL;
+static char *dup_key = NULL;
 
 static void dup_corebt_fini(void);
 
@@ -48,17 +64,64 @@ static char* load_backtrace(const struct dump_dir *dd)
         DD_FAIL_QUIETLY_ENOENT|DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
 }
 
+/* Returns the id of the frame, the id of a similar frame if there is one in
+ * unique. Otherwise, the frame is added to unique if add is true, the frames
+ * that are never similar get 0.
+ */
+static uint32_t intern_frame(struct sr_frame *frame, struct sr_frame **unique,
+                             unsigned *unique_count, bool add)
+{
+    unsigned i;
+    for (i = 0; i < *unique_count; ++i)
+    {
+        if (sr_frame_cmp_distance(frame, unique[i]) == 0)
+            return i + 1;
+    }
+
+    /* e.g. "??" functions */
+    if (!add || sr_frame_cmp_distance(frame, frame) != 0)
+        return 0;
+
+    unique[(*unique_count)++] = frame;
+    return *unique_count;
+}
+
+/* The Damerau-Levenshtein distance of the threads. Every distinct frame is
+ * compared once instead of once per cell of the distance matrix.
+ */
+static float thread_distance(struct sr_thread *thread1, struct sr_thread *thread2)
+{
+    const unsigned count1 = sr_thread_frame_count(thread1);
+    const unsigned count2 = sr_thread_frame_count(thread2);
+    struct sr_frame **unique = xmalloc(sizeof(*unique) * (count1 + 1));
+    unsigned unique_count = 0;
+    uint32_t *ids1 = xmalloc(sizeof(*ids1) * (count1 + count2 + 1));
+    uint32_t *ids2 = ids1 + count1;
+
+    unsigned i = 0;
+    struct sr_frame *frame;
+    for (frame = sr_thread_frames(thread1); frame != NULL && i < count1; frame = sr_frame_next(frame))
+        ids1[i++] = intern_frame(frame, unique, &unique_count, true);
+
+    /* The frames not similar to any frame of thread1 can't match */
+    unsigned j = 0;
+    for (frame = sr_thread_frames(thread2); frame != NULL && j < count2; frame = sr_frame_next(frame))
+        ids2[j++] = intern_frame(frame, unique, &unique_count, false);
+
+    const float distance = frame_ids_distance(ids1, i, ids2, j, BACKTRACE_DUP_THRESHOLD);
+
+    free(ids1);
+    free(unique);
+    return distance;
+}
+
 static int core_backtrace_is_duplicate(struct sr_stacktrace *bt1,
                                        const char *bt2_text)
 {
+    /* Checked in dup_corebt_init() */
     struct sr_thread *thread1 = sr_stacktrace_find_crash_thread(bt1);
-
     if (thread1 == NULL)
-    {
-        log_notice("New stacktrace has no crash thread, disabling core stacktrace deduplicate");
-        dup_corebt_fini();
         return 0;
-    }
 
     int result;
     char *error_message;
@@ -89,7 +152,7 @@ static int core_backtrace_is_duplicate(struct sr_stacktrace *bt1,
         goto end;
     }
 
-    float distance = sr_distance(SR_DISTANCE_DAMERAU_LEVENSHTEIN, thread1, thread2);
+    float distance = thread_distance(thread1, thread2);
     log_info("Distance between backtraces: %f", distance);
     result = (distance <= BACKTRACE_DUP_THRESHOLD);
 
@@ -166,16 +229,60 @@ static void dup_corebt_init(const struct dump_dir *dd)
         log_notice("Failed to load core stacktrace: %s", error_message);
         free(error_message);
     }
+    else if (sr_stacktrace_find_crash_thread(corebt) == NULL)
+    {
+        log_notice("New stacktrace has no crash thread, disabling core stacktrace deduplicate");
+        sr_stacktrace_free(corebt);
+        corebt = NULL;
+    }
+    else if (report_type == SR_REPORT_CORE)
+    {
+        crash_frames = crash_frames_from_core_backtrace(corebt_text, &crash_frames_count);
+        if (crash_frames)
+            lsh_signature = crash_frames_lsh_signature(crash_frames, crash_frames_count);
+    }
 
     free(corebt_text);
 }
 
+/* Compares the crash frames without parsing the core backtrace of dd.
+ * Returns -1 if dd has no crash frames.
+ */
+static int crash_frames_compare(const struct dump_dir *dd)
+{
+    unsigned dd_frames_count;
+    uint64_t *dd_frames = crash_frames_load(dd, &dd_frames_count);
+    if (!dd_frames)
+        return -1;
+
+    int isdup = 0;
+    if (dd_frames_count == 0)
+        log_notice("Core backtrace has zero frames, considering it not duplicate");
+    else
+    {
+        float distance = crash_frames_distance(crash_frames, crash_frames_count,
+                                               dd_frames, dd_frames_count,
+                                               BACKTRACE_DUP_THRESHOLD);
+        log_info("Distance between crash frames: %f", distance);
+        isdup = (distance <= BACKTRACE_DUP_THRESHOLD);
+    }
+
+    free(dd_frames);
+    return isdup;
+}
+
 static int dup_corebt_compare(const struct dump_dir *dd)
 {
     if (!corebt)
         return 0;
 
-    int isdup;
+    int isdup = crash_frames ? crash_frames_compare(dd) : -1;
+    if (isdup >= 0)
+    {
+        if (isdup)
+            log_notice("Duplicate: crash frames");
+        return isdup;
+    }
 
     char *dd_corebt = load_backtrace(dd);
     if (!dd_corebt)
@@ -194,6 +301,327 @@ static void dup_corebt_fini(void)
 {
     sr_stacktrace_free(corebt);
     corebt = NULL;
+    free(crash_frames);
+    crash_frames = NULL;
+    free(lsh_signature);
+    lsh_signature = NULL;
+}
+
+/* Lets the next problems compare their crash frames with the processed one */
+static void save_crash_frames(const char *dump_dir_name)
+{
+    struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags:*/ 0);
+    if (!dd)
+        return;
+
+    crash_frames_save(dd, crash_frames, crash_frames_count);
+    dd_close(dd);
+
+    /* Without a signature the processed problem can't be similar to any
+     * problem with crash frames, see skip_lsh_candidate() */
+    char *path = realpath(dump_dir_name, NULL);
+    if (path && dir_is_in_dump_location(path))
+        dup_index_add(g_settings_dump_location, DUP_INDEX_LSH,
+                      lsh_signature ? lsh_signature : "-", strrchr(path, '/') + 1);
+    free(path);
+}
+
+/* Tells whether the candidate can't be a duplicate according to its MinHash
+ * signature in signatures. The candidates without a signature are compared.
+ */
+static bool skip_lsh_candidate(GHashTable *signatures, const char *dir_name)
+{
+    const char *signature = signatures ? g_hash_table_lookup(signatures, dir_name) : NULL;
+    if (!signature)
+        return false;
+
+    /* One of the problems has no known crash frames */
+    if (!lsh_signature || strcmp(signature, "-") == 0)
+        return true;
+
+    return !crash_frames_lsh_match(lsh_signature, signature);
+}
+
+/* The first occurrence of the problem, the problems without it go last */
+static unsigned long long load_dup_time(struct dump_dir *dd)
+{
+    char *dd_time_str = dd_load_text_ext(dd, FILENAME_TIME,
+            DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    const unsigned long long dd_time = dd_time_str ? strtoull(dd_time_str, NULL, 10) : ULLONG_MAX;
+    free(dd_time_str);
+    return dd_time;
+}
+
+/* An indexed candidate, see sort_dup_candidates() */
+struct dup_candidate
+{
+    const char *dir_name;
+    char *path;
+    unsigned long long time;
+};
+
+static int dup_candidate_cmp(const void *a, const void *b)
+{
+    const struct dup_candidate *ca = a;
+    const struct dup_candidate *cb = b;
+    if (ca->time != cb->time)
+        return ca->time < cb->time ? -1 : 1;
+    return strcmp(ca->path, cb->path);
+}
+
+/* Sorts the base names of the indexed candidates oldest first, ties broken by
+ * the real path, the order of dup_scan_is_older(). The index and the scan then
+ * choose the same duplicate. The candidates that no longer exist are dropped,
+ * the list is freed and the base names are kept in the returned one.
+ */
+static GList *sort_dup_candidates(GList *dir_names)
+{
+    struct dup_candidate *candidates = xmalloc((g_list_length(dir_names) + 1) * sizeof(*candidates));
+    unsigned count = 0;
+
+    GList *item;
+    for (item = dir_names; item != NULL; item = g_list_next(item))
+    {
+        char *tmp_concat_path = concat_path_file(g_settings_dump_location, item->data);
+        char *path = realpath(tmp_concat_path, NULL);
+        free(tmp_concat_path);
+        if (!path)
+            continue;
+
+        struct dump_dir *dd = dd_opendir(path, DD_FAIL_QUIETLY_ENOENT | DD_OPEN_READONLY);
+        candidates[count].dir_name = item->data;
+        candidates[count].path = path;
+        candidates[count].time = dd ? load_dup_time(dd) : ULLONG_MAX;
+        dd_close(dd);
+        ++count;
+    }
+    g_list_free(dir_names);
+
+    qsort(candidates, count, sizeof(*candidates), dup_candidate_cmp);
+
+    GList *sorted = NULL;
+    while (count-- > 0)
+    {
+        sorted = g_list_prepend(sorted, (gpointer)candidates[count].dir_name);
+        free(candidates[count].path);
+    }
+
+    free(candidates);
+    return sorted;
+}
+
+/* Problems of different keys are never duplicates, the duplicate index maps
+ * the keys to the problem directories.
+ */
+static char *make_dup_key(const char *dd_uid, const char *dd_type, const char *dd_executable)
+{
+    return xasprintf("%s:%s:%s", dd_uid, dd_type, dd_executable ? dd_executable : "");
+}
+
+/* The state of scan_dump_location() shared by its threads */
+struct dup_scan
+{
+    const char *dump_dir_name;
+    GMutex lock;
+    /* Maps the scanned directories to their keys */
+    GHashTable *keys;
+    /* The real path and the first occurrence of the oldest duplicate */
+    char *found;
+    unsigned long long found_time;
+};
+
+/* Must be called with the lock held */
+static bool dup_scan_is_older(struct dup_scan *scan, unsigned long long dd_time, const char *path)
+{
+    return !scan->found
+        || dd_time < scan->found_time
+        || (dd_time == scan->found_time && strcmp(path, scan->found) < 0);
+}
+
+/* Compares the processed problem with the problem directory dir_name in the
+ * dump location. Returns the malloced real path of the directory if it is
+ * a duplicate. If dd_key is not NULL, it is set to the malloced key of the
+ * directory. If scan is not NULL, dd_time is set to the first occurrence of
+ * the directory and the directories younger than the oldest duplicate found
+ * by the scan are not compared.
+ *
+ * Called from the threads of scan_dump_location(), it must not modify the
+ * state of the processed problem.
+ */
+static char *check_dup_candidate(const char *dump_dir_name, const char *dir_name,
+                                 struct dup_scan *scan, char **dd_key,
+                                 unsigned long long *dd_time)
+{
+    char *found = NULL;
+    struct dump_dir *dd = NULL;
+
+    char *tmp_concat_path = concat_path_file(g_settings_dump_location, dir_name);
+
+    char *dump_dir_name2 = realpath(tmp_concat_path, NULL);
+    if (g_verbose > 1 && !dump_dir_name2)
+        perror_msg("realpath(%s)", tmp_concat_path);
+
+    free(tmp_concat_path);
+
+    if (!dump_dir_name2)
+        return NULL;
+
+    char *dd_uid = NULL, *dd_type = NULL;
+    char *dd_executable = NULL;
+
+    if (strcmp(dump_dir_name, dump_dir_name2) == 0)
+        goto next; /* we are never a dup of ourself */
+
+    /* The caller silences the errors in the silent log level, logmode is
+     * shared by the threads */
+    dd = dd_opendir(dump_dir_name2, /*flags:*/ DD_FAIL_QUIETLY_ENOENT | DD_OPEN_READONLY);
+    if (!dd)
+        goto next;
+
+    dd_uid = dd_load_text_ext(dd, FILENAME_UID, DD_FAIL_QUIETLY_ENOENT);
+    dd_type = dd_load_text_ext(dd, FILENAME_TYPE, DD_FAIL_QUIETLY_ENOENT);
+    dd_executable = dd_load_text_ext(dd, FILENAME_EXECUTABLE, DD_FAIL_QUIETLY_ENOENT);
+
+    if (dd_key)
+        *dd_key = make_dup_key(dd_uid, dd_type, dd_executable);
+
+    if (scan)
+    {
+        *dd_time = load_dup_time(dd);
+
+        /* A younger duplicate wouldn't be chosen */
+        g_mutex_lock(&scan->lock);
+        const bool older = dup_scan_is_older(scan, *dd_time, dump_dir_name2);
+        g_mutex_unlock(&scan->lock);
+        if (!older)
+            goto next;
+    }
+
+    /* crashes of different users are not considered duplicates */
+    if (strcmp(uid, dd_uid))
+    {
+        goto next;
+    }
+
+    /* different crash types are not duplicates */
+    if (strcmp(type, dd_type))
+    {
+        goto next;
+    }
+
+    /* different executables are not duplicates */
+    if (     (executable != NULL && dd_executable == NULL)
+         ||  (executable == NULL && dd_executable != NULL)
+         || ((executable != NULL && dd_executable != NULL)
+              && strcmp(executable, dd_executable) != 0))
+    {
+        goto next;
+    }
+
+    if (dup_uuid_compare(dd)
+     || dup_corebt_compare(dd)
+    ) {
+        found = dump_dir_name2;
+        dump_dir_name2 = NULL;
+    }
+
+next:
+    free(dump_dir_name2);
+    dd_close(dd);
+    free(dd_uid);
+    free(dd_type);
+    free(dd_executable);
+    return found;
+}
+
+static void scan_dup_candidate(gpointer data, gpointer user_data)
+{
+    char *dir_name = data;
+    struct dup_scan *scan = user_data;
+
+    char *dd_key = NULL;
+    unsigned long long dd_time = ULLONG_MAX;
+    char *dup = check_dup_candidate(scan->dump_dir_name, dir_name, scan, &dd_key, &dd_time);
+
+    g_mutex_lock(&scan->lock);
+    if (dup && dup_scan_is_older(scan, dd_time, dup))
+    {
+        free(scan->found);
+        scan->found = dup;
+        scan->found_time = dd_time;
+        dup = NULL;
+    }
+
+    if (dd_key)
+        g_hash_table_insert(scan->keys, dir_name, dd_key);
+    else
+        free(dir_name);
+    g_mutex_unlock(&scan->lock);
+
+    free(dup);
+}
+
+/* Compares the processed problem with all problem directories and builds the
+ * duplicate index of the dump location on the way. The directories are read,
+ * parsed and compared on a pool of threads. The oldest duplicate is chosen,
+ * so the result doesn't depend on the order the threads finish in.
+ */
+static char *scan_dump_location(const char *dump_dir_name)
+{
+    DIR *dir = opendir(g_settings_dump_location);
+    if (dir == NULL)
+        return NULL;
+
+    GList *dir_names = NULL;
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL)
+    {
+        /* skip ".", ".." and the hidden files of the dump location */
+        if (dent->d_name[0] == '.')
+            continue;
+        const char *ext = strrchr(dent->d_name, '.');
+        if (ext && strcmp(ext, ".new") == 0)
+            continue; /* skip anything named "<dirname>.new" */
+
+        dir_names = g_list_prepend(dir_names, xstrdup(dent->d_name));
+    }
+    closedir(dir);
+
+    /* The names start with the type and the time of the crash, the older
+     * duplicates are likely found first and the younger directories need not
+     * be compared */
+    dir_names = g_list_sort(dir_names, (GCompareFunc)strcmp);
+
+    struct dup_scan scan = {
+        .dump_dir_name = dump_dir_name,
+        .keys = g_hash_table_new_full(g_str_hash, g_str_equal, free, free),
+    };
+    g_mutex_init(&scan.lock);
+
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = MAX(1, MIN(threads, DUP_SCAN_MAX_THREADS));
+    log_info("Scanning %u problem directories in %ld threads", g_list_length(dir_names), threads);
+
+    int sv_logmode = logmode;
+    /* Silently ignore any error in the silent log level. */
+    logmode = g_verbose == 0 ? 0 : sv_logmode;
+
+    GThreadPool *pool = g_thread_pool_new(scan_dup_candidate, &scan, threads, /*exclusive:*/ FALSE, NULL);
+    GList *item;
+    for (item = dir_names; item != NULL; item = g_list_next(item))
+        g_thread_pool_push(pool, item->data, NULL);
+    /* Waits for all directories */
+    g_thread_pool_free(pool, /*immediate:*/ FALSE, /*wait:*/ TRUE);
+    g_list_free(dir_names);
+
+    logmode = sv_logmode;
+    g_mutex_clear(&scan.lock);
+
+    log_notice("Adding %u problem directories to the duplicate index", g_hash_table_size(scan.keys));
+    dup_index_add_all(g_settings_dump_location, DUP_INDEX_KEY, scan.keys);
+    g_hash_table_destroy(scan.keys);
+
+    return scan.found;
 }
 
 /* This function is run after each post-create event is finished (there may be
@@ -202,26 +630,29 @@ static void dup_corebt_fini(void)
  * It first checks if there is CORE_BACKTRACE or UUID item in the dump dir
  * we are processing.
  *
- * If there is a CORE_BACKTRACE, it iterates over all other dump
- * directories and computes similarity to their core backtraces (if any).
- * If one of them is similar enough to be considered duplicate, the function
- * saves the path to the dump directory in question and returns 1 to indicate
- * that we have indeed found a duplicate of currently processed dump directory.
- * No more events are processed and program prints the path to the other
- * directory and returns failure.
+ * If there is a CORE_BACKTRACE, it iterates over the other dump directories
+ * of the same user, type and executable and computes similarity to their core
+ * backtraces (if any). If one of them is similar enough to be considered
+ * duplicate, the function saves the path to the dump directory in question
+ * and returns 1 to indicate that we have indeed found a duplicate of currently
+ * processed dump directory. No more events are processed and program prints
+ * the path to the other directory and returns failure.
  *
  * If there is an UUID item (and no core backtrace), the function again
- * iterates over all other dump directories and compares this UUID to their
+ * iterates over these dump directories and compares this UUID to their
  * UUID. If there is a match, the path to the duplicate is saved and 1 is returned.
  *
+ * The directories are looked up in the duplicate index. Only if the index has
+ * no DUP_INDEX_KEY rows, all directories are compared and the index is built.
+ * The indexed directories whose crash frames have a MinHash signature without
+ * a common band can't be similar enough and are not compared at all.
+ *
  * If duplicate is not found as described above, the function returns 0 and we
  * either process remaining events if there are any, or successfully terminate
  * processing of the current dump directory.
  */
 static int is_crash_a_dup(const char *dump_dir_name, void *param)
 {
-    int retval = 0; /* defaults to no dup found, "run_event, please continue iterating" */
-
     struct dump_dir *dd = dd_opendir(dump_dir_name, DD_OPEN_READONLY);
     if (!dd)
         return 0; /* wtf? (error, but will be handled elsewhere later) */
@@ -233,95 +664,70 @@ static int is_crash_a_dup(const char *dump_dir_name, void *param)
     dup_corebt_init(dd);
     dd_close(dd);
 
+    free(dup_key);
+    dup_key = make_dup_key(uid, type, executable);
+
     /* dump_dir_name can be relative */
     dump_dir_name = realpath(dump_dir_name, NULL);
+    if (!dump_dir_name)
+        return 0;
 
-    DIR *dir = opendir(g_settings_dump_location);
-    if (dir == NULL)
-        goto end;
-
-    /* Scan crash dumps looking for a dup */
-    //TODO: explain why this is safe wrt concurrent runs
-    struct dirent *dent;
-    while ((dent = readdir(dir)) != NULL && crash_dump_dup_name == NULL)
+    bool indexed;
+    GList *candidates = dup_index_find_all(g_settings_dump_location, DUP_INDEX_KEY, dup_key, &indexed);
+    if (indexed)
     {
-        if (dot_or_dotdot(dent->d_name))
-            continue; /* skip "." and ".." */
-        const char *ext = strrchr(dent->d_name, '.');
-        if (ext && strcmp(ext, ".new") == 0)
-            continue; /* skip anything named "<dirname>.new" */
-
-        dd = NULL;
-
-        char *tmp_concat_path = concat_path_file(g_settings_dump_location, dent->d_name);
-
-        char *dump_dir_name2 = realpath(tmp_concat_path, NULL);
-        if (g_verbose > 1 && !dump_dir_name2)
-            perror_msg("realpath(%s)", tmp_concat_path);
-
-        free(tmp_concat_path);
-
-        if (!dump_dir_name2)
-            continue;
-
-        char *dd_uid = NULL, *dd_type = NULL;
-        char *dd_executable = NULL;
-
-        if (strcmp(dump_dir_name, dump_dir_name2) == 0)
-            goto next; /* we are never a dup of ourself */
+        /* Only the candidates in the same LSH bucket get the crash frames
+         * compared */
+        GHashTable *signatures = NULL;
+        if (crash_frames && candidates)
+            signatures = dup_index_find_values(g_settings_dump_location, DUP_INDEX_LSH, candidates);
 
         int sv_logmode = logmode;
         /* Silently ignore any error in the silent log level. */
         logmode = g_verbose == 0 ? 0 : sv_logmode;
-        dd = dd_opendir(dump_dir_name2, /*flags:*/ DD_FAIL_QUIETLY_ENOENT | DD_OPEN_READONLY);
-        logmode = sv_logmode;
-        if (!dd)
-            goto next;
 
-        /* crashes of different users are not considered duplicates */
-        dd_uid = dd_load_text_ext(dd, FILENAME_UID, DD_FAIL_QUIETLY_ENOENT);
-        if (strcmp(uid, dd_uid))
+        unsigned skipped = 0;
+        GList *compared = NULL;
+        GList *item;
+        for (item = candidates; item != NULL; item = g_list_next(item))
         {
-            goto next;
+            if (skip_lsh_candidate(signatures, item->data))
+                ++skipped;
+            else
+                compared = g_list_prepend(compared, item->data);
         }
 
-        /* different crash types are not duplicates */
-        dd_type = dd_load_text_ext(dd, FILENAME_TYPE, DD_FAIL_QUIETLY_ENOENT);
-        if (strcmp(type, dd_type))
-        {
-            goto next;
-        }
+        /* The oldest duplicate wins like in scan_dump_location() */
+        compared = sort_dup_candidates(compared);
+        for (item = compared; item != NULL && crash_dump_dup_name == NULL; item = g_list_next(item))
+            crash_dump_dup_name = check_dup_candidate(dump_dir_name, item->data, NULL, NULL, NULL);
+        g_list_free(compared);
 
-        /* different executables are not duplicates */
-        dd_executable = dd_load_text_ext(dd, FILENAME_EXECUTABLE, DD_FAIL_QUIETLY_ENOENT);
-        if (     (executable != NULL && dd_executable == NULL)
-             ||  (executable == NULL && dd_executable != NULL)
-             || ((executable != NULL && dd_executable != NULL)
-                  && strcmp(executable, dd_executable) != 0))
-        {
-            goto next;
-        }
+        logmode = sv_logmode;
 
-        if (dup_uuid_compare(dd)
-         || dup_corebt_compare(dd)
-        ) {
-            crash_dump_dup_name = dump_dir_name2;
-            dump_dir_name2 = NULL;
-            retval = 1; /* "run_event, please stop iterating" */
-            /* sonce crash_dump_dup_name != NULL now, we exit the loop */
+        if (signatures)
+        {
+            log_info("Skipped %u candidates of different MinHash signatures", skipped);
+            g_hash_table_destroy(signatures);
         }
-
-next:
-        free(dump_dir_name2);
-        dd_close(dd);
-        free(dd_uid);
-        free(dd_type);
+        g_list_free_full(candidates, free);
     }
-    closedir(dir);
+    else
+        crash_dump_dup_name = scan_dump_location(dump_dir_name);
 
-end:
     free((char*)dump_dir_name);
-    return retval;
+
+    /* "run_event, please stop iterating" if a dup was found */
+    return crash_dump_dup_name != NULL;
+}
+
+/* Lets the next problems find the processed one */
+static void index_dup_key(const char *dump_dir_name)
+{
+    char *path = realpath(dump_dir_name, NULL);
+    if (path && dir_is_in_dump_location(path))
+        dup_index_add(g_settings_dump_location, DUP_INDEX_KEY, dup_key, strrchr(path, '/') + 1);
+    free(path);
 }
 
 static char *do_log(char *log_line, void *param)
@@ -413,6 +819,10 @@ int main(int argc, char **argv)
         const bool no_action_for_event = (r == 0 && run_state->children_count == 0);
 
         free_run_event_state(run_state);
+
+        if (post_create && r == 0 && crash_dump_dup_name == NULL && crash_frames != NULL)
+            save_crash_frames(dump_dir_name);
+
         /* Needed only if is_crash_a_dup() was called, but harmless
          * even if it wasn't:
          */
@@ -440,6 +850,11 @@ int main(int argc, char **argv)
         if (r != 0)
             return r; /* yes */
 
+        if (post_create && dup_key != NULL)
+            index_dup_key(dump_dir_name);
+        free(dup_key);
+        dup_key = NULL;
+
         free(dump_dir_name);
         dump_dir_name = NULL;
     }
@@ -0,0 +1,1311 @@
+/*
+    Copyright (C) 2010  ABRT team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+#include <arpa/inet.h>
+#include <sys/sendfile.h>
+#include "problem_api.h"
+#include "abrt-request.h"
+
+/*
+Unix socket in ABRT daemon for creating new dump directories.
+
+Why to use socket for creating dump dirs? Security. When a Python
+script throws unexpected exception, ABRT handler catches it, running
+as a part of that broken Python application. The application is running
+with certain SELinux privileges, for example it can not execute other
+programs, or to create files in /var/cache or anything else required
+to properly fill a problem directory. Adding these privileges to every
+application would weaken the security.
+The most suitable solution is for the Python application
+to open a socket where ABRT daemon is listening, write all relevant
+data to that socket, and close it. ABRT daemon handles the rest.
+
+** Protocol
+
+Initializing new dump:
+open /var/run/abrt.socket
+
+Providing dump data (hook writes to the socket):
+MANDATORY ITEMS:
+-> "PID="
+   number 0 - PID_MAX (/proc/sys/kernel/pid_max)
+   \0
+-> "EXECUTABLE="
+   string
+   \0
+-> "BACKTRACE="
+   string
+   \0
+-> "ANALYZER="
+   string
+   \0
+-> "BASENAME="
+   string (no slashes)
+   \0
+-> "REASON="
+   string
+   \0
+
+You can send more messages using the same KEY=value format.
+
+** Protocol v2
+
+The values of the items above are limited to a few MiB in total and the
+daemon holds all of them in memory. Clients with big items (heap dumps, long
+traces, attachments) use "POST /v2 HTTP/1.1\r\n\r\n" followed by items:
+
+-> key length: uint32 in network byte order
+-> value length: uint32 in network byte order, or 0xFFFFFFFF if the value is
+   the content of a regular file whose descriptor is passed (SCM_RIGHTS) in
+   the same sendmsg() as the length
+-> key
+-> value (unless passed as a descriptor)
+
+The items the daemon needs to accept the problem (type, analyzer, basename,
+pid, executable) are kept in memory, the other items are written to the new
+problem directory as they arrive. The passed files are copied by sendfile()
+from their beginning, in chunks of ABRT_REQUEST_COPY_CHUNK bytes, so the
+daemon can serve other clients in the meantime; see abrt_request_copy().
+*/
+
+/* The parts of a v2 item */
+enum
+{
+    ITEM_LENGTHS,
+    ITEM_KEY,
+    ITEM_VALUE,
+};
+
+#define ITEM_LENGTHS_SIZE (2 * sizeof(uint32_t))
+
+void abrt_request_init(struct abrt_request *req, uid_t client_uid, pid_t client_pid)
+{
+    memset(req, 0, sizeof(*req));
+    req->client_uid = client_uid;
+    req->client_pid = client_pid;
+    req->version = 1;
+    req->buf = xzalloc(1);
+    req->copy_fd = -1;
+    /* use free instead of g_free so that we can use xstr* functions from
+     * libreport/lib/xfuncs.c
+     */
+    req->problem_info = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+}
+
+static void batch_problem_free(struct abrt_batch_problem *problem)
+{
+    if (problem->dd != NULL)
+        dd_delete(problem->dd);
+
+    g_hash_table_destroy(problem->problem_info);
+    free(problem);
+}
+
+void abrt_request_forget_dirs(struct abrt_request *req)
+{
+    /* dd_close() would remove the lock the forked process relies on */
+    if (req->dd != NULL)
+    {
+        req->dd->locked = 0;
+        dd_close(req->dd);
+        req->dd = NULL;
+    }
+
+    GList *item;
+    for (item = req->batch; item != NULL; item = g_list_next(item))
+    {
+        struct abrt_batch_problem *problem = item->data;
+        if (problem->dd != NULL)
+        {
+            problem->dd->locked = 0;
+            dd_close(problem->dd);
+            problem->dd = NULL;
+        }
+    }
+}
+
+void abrt_request_destroy(struct abrt_request *req)
+{
+    if (req->item_file != NULL)
+        fclose(req->item_file);
+
+    /* The request failed before the problem directory was complete */
+    if (req->dd != NULL)
+        dd_delete(req->dd);
+
+    if (req->copy_fd >= 0)
+        close(req->copy_fd);
+
+    for (; req->fd_next < req->fd_count; ++req->fd_next)
+        close(req->fds[req->fd_next]);
+
+    g_list_free_full(req->batch, (GDestroyNotify)batch_problem_free);
+    g_hash_table_destroy(req->problem_info);
+    free(req->key);
+    free(req->buf);
+    free(req->pending);
+}
+
+ssize_t abrt_request_recv(struct abrt_request *req, int sockfd, char *buf, size_t size)
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * ABRT_REQUEST_MAX_FDS)];
+    } control;
+
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    const ssize_t r = recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+    /* abrt-server can be run with stdin redirected from a file */
+    if (r < 0 && errno == ENOTSOCK)
+        return read(sockfd, buf, size);
+    if (r < 0)
+        return r;
+
+    bool too_many = (msg.msg_flags & MSG_CTRUNC);
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        const int *fds = (const int *)CMSG_DATA(cmsg);
+        const unsigned count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        unsigned i;
+        for (i = 0; i < count; ++i)
+        {
+            if (req->fd_count < ABRT_REQUEST_MAX_FDS)
+                req->fds[req->fd_count++] = fds[i];
+            else
+            {
+                close(fds[i]);
+                too_many = true;
+            }
+        }
+    }
+
+    if (too_many)
+    {
+        error_msg("Client passed more than %d file descriptors", ABRT_REQUEST_MAX_FDS);
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    return r;
+}
+
+static gboolean key_value_ok(struct abrt_request *req, gchar *key, gchar *value)
+{
+    char *i;
+
+    /* check key, it has to be valid filename and will end up in the
+     * bugzilla */
+    for (i = key; *i != 0; i++)
+    {
+        if (!isalpha(*i) && (*i != '-') && (*i != '_') && (*i != ' '))
+            return FALSE;
+    }
+
+    /* check value of 'basename', it has to be valid non-hidden directory
+     * name */
+    if (strcmp(key, "basename") == 0
+     || strcmp(key, FILENAME_TYPE) == 0
+    )
+    {
+        if (!str_is_correct_filename(value))
+        {
+            error_msg("Value of '%s' ('%s') is not a valid directory name",
+                      key, value);
+            return FALSE;
+        }
+    }
+
+    return allowed_new_user_problem_entry(req->client_uid, key, value);
+}
+
+/* Handles a message received from client over socket. */
+static void process_message(struct abrt_request *req, char *message)
+{
+    gchar *key, *value;
+
+    value = strchr(message, '=');
+    if (value)
+    {
+        key = xstrndup(message, value - message);
+        char *c;
+        for (c = key; *c != '\0'; ++c)
+            *c = g_ascii_tolower(*c);
+
+        value++;
+        if (key_value_ok(req, key, value))
+        {
+            if (strcmp(key, FILENAME_UID) == 0)
+            {
+                error_msg("Ignoring value of %s, will be determined later",
+                          FILENAME_UID);
+            }
+            else
+            {
+                g_hash_table_insert(req->problem_info, key, xstrdup(value));
+                /* Prevent freeing key later: */
+                key = NULL;
+            }
+        }
+        else
+        {
+            /* should use error_msg_and_die() here? */
+            error_msg("Invalid key or value format: %s", message);
+        }
+        free(key);
+    }
+    else
+    {
+        /* should use error_msg_and_die() here? */
+        error_msg("Invalid message format: '%s'", message);
+    }
+}
+
+/* Processes the complete items of the body */
+static void process_messages(struct abrt_request *req)
+{
+    char *message = req->buf;
+    unsigned left = req->len;
+    while (1)
+    {
+        unsigned len = strnlen(message, left);
+        if (len >= left)
+            break;
+        /* message has at least one NUL - process the line */
+        process_message(req, message);
+        message += len + 1;
+        left -= len + 1;
+    }
+
+    req->len = left;
+    memmove(req->buf, message, left + 1);
+}
+
+/* The items the daemon needs before it accepts the problem are kept in
+ * memory, the other v2 items are streamed to the problem directory.
+ */
+static bool item_is_buffered(const char *key)
+{
+    return problem_entry_is_post_create_condition(key)
+        || strcmp(key, FILENAME_PID) == 0
+        || strcmp(key, FILENAME_EXECUTABLE) == 0
+        || strcmp(key, FILENAME_UID) == 0;
+}
+
+/* Creates the hidden directory the v2 items are streamed to */
+static int open_incoming_dir(struct abrt_request *req)
+{
+    if (req->dd != NULL)
+        return 0;
+
+    /* Refuse if free space is less than 1/4 of MaxCrashReportsSize */
+    if (g_settings_nMaxCrashReportsSize > 0
+        && low_free_space(g_settings_nMaxCrashReportsSize, g_settings_dump_location))
+        return 507; /* Insufficient Storage */
+
+    static unsigned incoming_seq;
+    char *path = xasprintf("%s/"ABRT_INCOMING_DIR_PREFIX"%lu-%lu-%u",
+                           g_settings_dump_location, (long)time(NULL),
+                           (long)getpid(), ++incoming_seq);
+
+    req->dd = dd_create(path, /*fs owner*/0, DEFAULT_DUMP_DIR_MODE);
+    if (req->dd == NULL)
+    {
+        error_msg("Error creating problem directory '%s'", path);
+        free(path);
+        return 500; /* Internal Server Error */
+    }
+
+    free(path);
+    return 0;
+}
+
+static int check_streamed_len(struct abrt_request *req, unsigned long long len)
+{
+    req->streamed_len += len;
+    if (g_settings_nMaxCrashReportsSize > 0
+        && req->streamed_len > g_settings_nMaxCrashReportsSize * 1024ULL * 1024ULL)
+    {
+        error_msg("Problem data exceed MaxCrashReportsSize, aborting");
+        return 413; /* Payload Too Large */
+    }
+
+    return 0;
+}
+
+static int open_item_file(struct abrt_request *req)
+{
+    const int r = open_incoming_dir(req);
+    if (r != 0)
+        return r;
+
+    /* The last item of the same name wins */
+    dd_delete_item(req->dd, req->key);
+    req->item_file = dd_open_item_file(req->dd, req->key, O_RDWR);
+    if (req->item_file == NULL)
+    {
+        error_msg("Can't create item '%s'", req->key);
+        return 500; /* Internal Server Error */
+    }
+
+    return 0;
+}
+
+static int close_item_file(struct abrt_request *req)
+{
+    const int r = fclose(req->item_file);
+    req->item_file = NULL;
+    if (r != 0)
+    {
+        perror_msg("Can't write item '%s'", req->key);
+        return 500; /* Internal Server Error */
+    }
+
+    /* Only the presence of the streamed items matters */
+    g_hash_table_insert(req->problem_info, xstrdup(req->key), NULL);
+    return 0;
+}
+
+/* Opens the item file for the content of the passed file, the content is
+ * copied by abrt_request_copy() */
+static int start_passed_file(struct abrt_request *req)
+{
+    if (req->fd_next >= req->fd_count)
+    {
+        error_msg("Item '%s' has no file descriptor", req->key);
+        return 400; /* Bad Request */
+    }
+
+    int r = 0;
+    const int fd = req->fds[req->fd_next++];
+
+    /* Never block on a pipe or a device */
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode))
+    {
+        error_msg("Item '%s' is not a regular file", req->key);
+        r = 400; /* Bad Request */
+        goto ret;
+    }
+
+    r = check_streamed_len(req, stat_buf.st_size);
+    if (r != 0)
+        goto ret;
+
+    r = open_item_file(req);
+    if (r != 0)
+        goto ret;
+
+    /* Doesn't move the offset of the client's file */
+    req->copy_fd = fd;
+    req->copy_offset = 0;
+    req->copy_size = stat_buf.st_size;
+    return 0;
+
+ ret:
+    close(fd);
+    return r;
+}
+
+static void start_item(struct abrt_request *req)
+{
+    req->item_state = ITEM_LENGTHS;
+    req->item_left = ITEM_LENGTHS_SIZE;
+    req->len = 0;
+    req->buf[0] = '\0';
+}
+
+/* Called when the key of a v2 item is complete */
+static int start_item_value(struct abrt_request *req)
+{
+    if (strlen(req->buf) != req->len)
+    {
+        error_msg("Invalid key format");
+        return 400; /* Bad Request */
+    }
+
+    free(req->key);
+    req->key = g_ascii_strdown(req->buf, req->len); /* result is malloced */
+    req->len = 0;
+    req->buf[0] = '\0';
+
+    /* check key, it has to be valid filename and will end up in the
+     * bugzilla */
+    char *i;
+    for (i = req->key; *i != '\0'; i++)
+    {
+        if (!isalpha(*i) && (*i != '-') && (*i != '_') && (*i != ' '))
+        {
+            error_msg("Invalid key format: '%s'", req->key);
+            return 400; /* Bad Request */
+        }
+    }
+
+    const bool buffered = item_is_buffered(req->key);
+    if (req->value_len == ABRT_REQUEST_FD_VALUE)
+    {
+        if (buffered)
+        {
+            error_msg("Item '%s' can't be passed as a file", req->key);
+            return 400; /* Bad Request */
+        }
+
+        return start_passed_file(req);
+    }
+
+    req->item_state = ITEM_VALUE;
+    req->item_left = req->value_len;
+    return buffered ? 0 : open_item_file(req);
+}
+
+/* Called when the value of a v2 item is complete */
+static int finish_item(struct abrt_request *req)
+{
+    if (req->item_file != NULL)
+    {
+        const int r = close_item_file(req);
+        if (r != 0)
+            return r;
+    }
+    else if (!key_value_ok(req, req->key, req->buf))
+    {
+        /* should use error_msg_and_die() here? */
+        error_msg("Invalid key or value format: %s=%s", req->key, req->buf);
+    }
+    else if (strcmp(req->key, FILENAME_UID) == 0)
+    {
+        error_msg("Ignoring value of %s, will be determined later",
+                  FILENAME_UID);
+    }
+    else
+        g_hash_table_insert(req->problem_info, xstrdup(req->key), xstrdup(req->buf));
+
+    start_item(req);
+    return 0;
+}
+
+/* Called when a problem of a batch is complete */
+static int finish_batch_problem(struct abrt_request *req)
+{
+    if (req->batch_len >= ABRT_REQUEST_MAX_BATCH)
+    {
+        error_msg("Batch has more than %d problems, aborting", ABRT_REQUEST_MAX_BATCH);
+        return 413; /* Payload Too Large */
+    }
+
+    struct abrt_batch_problem *problem = xmalloc(sizeof(*problem));
+    problem->problem_info = req->problem_info;
+    problem->dd = req->dd;
+    req->batch = g_list_append(req->batch, problem);
+    ++req->batch_len;
+
+    req->problem_info = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    req->dd = NULL;
+    return 0;
+}
+
+/* Called whenever a part of a v2 item is complete */
+static int finish_item_part(struct abrt_request *req)
+{
+    switch (req->item_state)
+    {
+        case ITEM_LENGTHS:
+        {
+            uint32_t lengths[2];
+            memcpy(lengths, req->buf, sizeof(lengths));
+            const uint32_t key_len = ntohl(lengths[0]);
+            req->value_len = ntohl(lengths[1]);
+            req->len = 0;
+            req->buf[0] = '\0';
+
+            if (key_len == 0 && req->value_len == 0 && req->type == ABRT_REQUEST_BATCH)
+                return finish_batch_problem(req);
+
+            if (key_len == 0 || key_len > NAME_MAX)
+            {
+                error_msg("Invalid key length %u", (unsigned)key_len);
+                return 400; /* Bad Request */
+            }
+
+            req->item_state = ITEM_KEY;
+            req->item_left = key_len;
+            return 0;
+        }
+        case ITEM_KEY:
+            return start_item_value(req);
+        default:
+            return finish_item(req);
+    }
+}
+
+/* Processes the data of a v2 body, the values of the streamed items are
+ * written right away */
+static int process_items(struct abrt_request *req, const char *data, unsigned len)
+{
+    while (len > 0)
+    {
+        /* The rest follows the passed file */
+        if (req->copy_fd >= 0)
+        {
+            req->pending = xrealloc(req->pending, req->pending_len + len);
+            memcpy(req->pending + req->pending_len, data, len);
+            req->pending_len += len;
+            return 0;
+        }
+
+        const unsigned chunk = MIN(len, req->item_left);
+        if (req->item_file != NULL)
+        {
+            const int r = check_streamed_len(req, chunk);
+            if (r != 0)
+                return r;
+
+            if (fwrite(data, 1, chunk, req->item_file) != chunk)
+            {
+                perror_msg("Can't write item '%s'", req->key);
+                return 500; /* Internal Server Error */
+            }
+        }
+        else
+        {
+            req->total_len += chunk;
+            if (req->total_len > ABRT_REQUEST_MAX_SIZE)
+            {
+                error_msg("Message is too long, aborting");
+                return 413; /* Payload Too Large */
+            }
+
+            req->buf = xrealloc(req->buf, req->len + chunk + 1);
+            memcpy(req->buf + req->len, data, chunk);
+            req->len += chunk;
+            req->buf[req->len] = '\0';
+        }
+
+        data += chunk;
+        len -= chunk;
+        req->item_left -= chunk;
+
+        /* Empty values are complete right away */
+        while (req->item_left == 0 && req->copy_fd < 0)
+        {
+            const int r = finish_item_part(req);
+            if (r != 0)
+                return r;
+        }
+    }
+
+    return 0;
+}
+
+bool abrt_request_copying(struct abrt_request *req)
+{
+    return req->copy_fd >= 0;
+}
+
+int abrt_request_copy(struct abrt_request *req)
+{
+    const off_t left = req->copy_size - req->copy_offset;
+    const ssize_t copied = left == 0 ? 0
+            : sendfile(fileno(req->item_file), req->copy_fd, &req->copy_offset,
+                       MIN(left, ABRT_REQUEST_COPY_CHUNK));
+    if (copied < 0 && errno == EINTR)
+        return 0;
+    if (copied < 0)
+    {
+        perror_msg("Can't copy item '%s'", req->key);
+        return 500; /* Internal Server Error */
+    }
+    /* Unless the file was truncated */
+    if (copied != 0 && req->copy_offset < req->copy_size)
+        return 0;
+
+    log_debug("Copied %lld bytes of item '%s'", (long long)req->copy_offset, req->key);
+    close(req->copy_fd);
+    req->copy_fd = -1;
+
+    int r = close_item_file(req);
+    if (r != 0)
+        return r;
+
+    start_item(req);
+
+    char *pending = req->pending;
+    const unsigned pending_len = req->pending_len;
+    req->pending = NULL;
+    req->pending_len = 0;
+    r = process_items(req, pending, pending_len);
+    free(pending);
+    return r;
+}
+
+/* Sanitizes and analyzes the header. Returns 0 or the HTTP error code */
+static int parse_header(struct abrt_request *req, char *header)
+{
+    log_debug("Request: %s", header);
+
+    /* Header is NUL terminated string, with last empty line deleted.
+     * \r\n are not (yet) converted to \n, multi-line headers also
+     * not converted.
+     */
+    /* First line must be "op<space>[http://host]/path<space>HTTP/n.n".
+     * <space> is exactly one space char.
+     */
+    if (prefixcmp(header, "DELETE ") == 0)
+    {
+        header += strlen("DELETE ");
+        char *space = strchr(header, ' ');
+        if (!space || prefixcmp(space+1, "HTTP/") != 0)
+            return 400; /* Bad Request */
+        *space = '\0';
+        //decode_url(header); %20 => ' '
+        req->type = ABRT_REQUEST_DELETE;
+        return 0;
+    }
+
+    /* We erroneously used "PUT /" to create new problems.
+     * POST is the correct request in this case:
+     * "PUT /" implies creation or replace of resource named "/"!
+     * Delete PUT in 2014.
+     */
+    if (prefixcmp(header, "PUT ") != 0
+     && prefixcmp(header, "POST ") != 0
+    ) {
+        return 400; /* Bad Request */
+    }
+
+    char *url = skip_non_whitespace(header) + 1; /* skip "POST " */
+    if (prefixcmp(url, "/creation_notification ") == 0)
+        req->type = ABRT_REQUEST_CREATION_NOTIFICATION;
+    else if (prefixcmp(url, "/ ") == 0)
+        req->type = ABRT_REQUEST_NEW_PROBLEM;
+    else if (prefixcmp(url, "/v2 ") == 0)
+    {
+        req->type = ABRT_REQUEST_NEW_PROBLEM;
+        req->version = 2;
+    }
+    else if (prefixcmp(url, "/batch ") == 0)
+    {
+        req->type = ABRT_REQUEST_BATCH;
+        req->version = 2;
+    }
+    else
+        return 400; /* Bad Request */
+
+    return 0;
+}
+
+int abrt_request_feed(struct abrt_request *req, const char *data, unsigned len)
+{
+    /* DELETE is carried out right after its header */
+    if (req->type == ABRT_REQUEST_DELETE)
+        return 0;
+
+    if (req->version == 2)
+        return process_items(req, data, len);
+
+    log_debug("Received %u bytes of data", len);
+    req->total_len += len;
+    if (req->total_len > ABRT_REQUEST_MAX_SIZE)
+    {
+        error_msg("Message is too long, aborting");
+        return 413; /* Payload Too Large */
+    }
+
+    const unsigned old_len = req->len;
+    req->buf = xrealloc(req->buf, req->len + len + 1);
+    memcpy(req->buf + req->len, data, len);
+    req->len += len;
+    req->buf[req->len] = '\0';
+
+    if (req->type == ABRT_REQUEST_UNKNOWN)
+    {
+        /* Check whether we see end of header */
+        /* Note: we support both [\r]\n\r\n and \n\n */
+        char *past_end = req->buf + req->len;
+        char *p = req->buf + old_len;
+        if (p > req->buf+1)
+            p -= 2; /* start search from two last bytes in last read - they might be '\n\r' */
+        char *body_start = NULL;
+        while (p < past_end)
+        {
+            p = memchr(p, '\n', past_end - p);
+            if (!p)
+                break;
+            p++;
+            if (p >= past_end)
+                break;
+            if (*p == '\n'
+             || (*p == '\r' && p+1 < past_end && p[1] == '\n')
+            ) {
+                body_start = p + 1 + (*p == '\r');
+                *p = '\0';
+                break;
+            }
+        }
+
+        if (body_start == NULL)
+            return 0;
+
+        const int r = parse_header(req, req->buf);
+        if (r != 0)
+            return r;
+
+        if (req->type == ABRT_REQUEST_DELETE)
+        {
+            /* Keep only the path */
+            req->len = strlen(req->buf + strlen("DELETE "));
+            memmove(req->buf, req->buf + strlen("DELETE "), req->len + 1);
+            return 0;
+        }
+
+        if (req->version == 2)
+        {
+            /* The buffer holds the parts of the items from now on */
+            const unsigned body_len = past_end - body_start;
+            char *body = xmalloc(body_len + 1);
+            memcpy(body, body_start, body_len);
+            start_item(req);
+            const int r = process_items(req, body, body_len);
+            free(body);
+            return r;
+        }
+
+        req->len = past_end - body_start;
+        memmove(req->buf, body_start, req->len + 1);
+        log_debug("Body so far: %u bytes, '%s'", req->len, req->buf);
+    }
+
+    if (req->type == ABRT_REQUEST_NEW_PROBLEM)
+        process_messages(req);
+
+    return 0;
+}
+
+int abrt_request_finish(struct abrt_request *req)
+{
+    if (req->type == ABRT_REQUEST_UNKNOWN)
+    {
+        log_warning("Premature EOF detected, exiting");
+        return 400; /* Bad Request */
+    }
+
+    if (req->version == 2 && (req->copy_fd >= 0
+        || req->item_state != ITEM_LENGTHS || req->item_left != ITEM_LENGTHS_SIZE))
+    {
+        log_warning("Premature EOF in item '%s', exiting", req->key ? req->key : "");
+        return 400; /* Bad Request */
+    }
+
+    /* Tolerate the missing end of the last problem */
+    if (req->type == ABRT_REQUEST_BATCH
+        && (g_hash_table_size(req->problem_info) > 0 || req->dd != NULL))
+        return finish_batch_problem(req);
+
+    return 0;
+}
+
+int abrt_request_delete(struct abrt_request *req)
+{
+    const char *dump_dir_name = req->buf;
+
+    /* If doesn't start with "g_settings_dump_location/"... */
+    if (!dir_is_in_dump_location(dump_dir_name))
+    {
+        /* Then refuse to operate on it (someone is attacking us??) */
+        error_msg("Bad problem directory name '%s', should start with: '%s'", dump_dir_name, g_settings_dump_location);
+        return 400; /* Bad Request */
+    }
+    if (!dir_has_correct_permissions(dump_dir_name, DD_PERM_DAEMONS))
+    {
+        error_msg("Problem directory '%s' has wrong owner or group", dump_dir_name);
+        return 400; /*  */
+    }
+
+    struct dump_dir *dd = dd_opendir(dump_dir_name, DD_OPEN_FD_ONLY);
+    if (dd == NULL)
+    {
+        perror_msg("Can't open problem directory '%s'", dump_dir_name);
+        return 400;
+    }
+    if (!dd_accessible_by_uid(dd, req->client_uid))
+    {
+        dd_close(dd);
+        if (errno == ENOTDIR)
+        {
+            error_msg("Path '%s' isn't problem directory", dump_dir_name);
+            return 404; /* Not Found */
+        }
+        error_msg("Problem directory '%s' can't be accessed by user with uid %ld", dump_dir_name, (long)req->client_uid);
+        return 403; /* Forbidden */
+    }
+
+    dd = dd_fdopendir(dd, /*flags:*/ 0);
+    if (dd)
+    {
+        if (dd_delete(dd) != 0)
+        {
+            error_msg("Failed to delete problem directory '%s'", dump_dir_name);
+            dd_close(dd);
+            return 400;
+        }
+    }
+
+    return 200;
+}
+
+static int problem_dump_dir_was_provoked_by_abrt_event(struct dump_dir *dd, char  **provoker)
+{
+    char *env_var = NULL;
+    const int r = dd_get_env_variable(dd, ABRT_SERVER_EVENT_ENV, &env_var);
+
+    /* Dump directory doesn't contain the environ file */
+    if (r == -ENOENT)
+        return 0;
+
+    if (provoker != NULL)
+        *provoker = env_var;
+    else
+        free(env_var);
+
+    return env_var != NULL;
+}
+
+int abrt_request_check_new_dir(const char *dirname)
+{
+    /* If doesn't start with "g_settings_dump_location/"... */
+    if (!dir_is_in_dump_location(dirname))
+    {
+        /* Then refuse to operate on it (someone is attacking us??) */
+        error_msg("Bad problem directory name '%s', should start with: '%s'", dirname, g_settings_dump_location);
+        return 400;
+    }
+    if (!dir_has_correct_permissions(dirname, DD_PERM_EVENTS))
+    {
+        error_msg("Problem directory '%s' has wrong owner or group", dirname);
+        return 400;
+    }
+
+    /* Check completness */
+    struct dump_dir *dd = dd_opendir(dirname, DD_OPEN_READONLY);
+
+    char *provoker = NULL;
+    const bool event_dir = dd && problem_dump_dir_was_provoked_by_abrt_event(dd, &provoker);
+    if (event_dir)
+    {
+        if (g_settings_debug_level == 0)
+        {
+            error_msg("Removing problem provoked by ABRT(pid:%s): '%s'", provoker, dirname);
+            dd_delete(dd);
+        }
+        else
+        {
+            char *dumpdir = NULL;
+            char *event   = NULL;
+            char *reason  = NULL;
+            char *cmdline = NULL;
+
+            /* Ignore errors */
+            dd_get_env_variable(dd, "DUMP_DIR", &dumpdir);
+            dd_get_env_variable(dd, "EVENT",    &event);
+            reason  = dd_load_text(dd, FILENAME_REASON);
+            cmdline = dd_load_text(dd, FILENAME_CMDLINE);
+
+            error_msg("ABRT_SERVER_PID=%s;DUMP_DIR='%s';EVENT='%s';REASON='%s';CMDLINE='%s'",
+                       provoker, dumpdir, event, reason, cmdline);
+
+            free(dumpdir);
+            free(event);
+            free(reason);
+            free(cmdline);
+            dd_close(dd);
+        }
+
+        free(provoker);
+        return 400;
+    }
+
+    const bool complete = dd && problem_dump_dir_is_complete(dd);
+    dd_close(dd);
+    if (complete)
+    {
+        error_msg("Problem directory '%s' has already been processed", dirname);
+        return 403;
+    }
+
+    return 0;
+}
+
+static bool data_is_missing(GHashTable *problem_info)
+{
+    gboolean missing_data = FALSE;
+    gchar **pstring;
+    static const gchar *const needed[] = {
+        FILENAME_TYPE,
+        FILENAME_REASON,
+        /* FILENAME_BACKTRACE, - ECC errors have no such elements */
+        /* FILENAME_EXECUTABLE, */
+        NULL
+    };
+
+    for (pstring = (gchar**) needed; *pstring; pstring++)
+    {
+        if (!g_hash_table_contains(problem_info, *pstring))
+        {
+            error_msg("Element '%s' is missing", *pstring);
+            missing_data = TRUE;
+        }
+    }
+
+    if (missing_data)
+        error_msg("Some data is missing, aborting");
+
+    return missing_data;
+}
+
+/*
+ * Takes hash table, looks for key FILENAME_PID and tries to convert its value
+ * to int. Returns 0 on errors.
+ */
+static unsigned convert_pid(GHashTable *problem_info)
+{
+    long ret;
+    gchar *pid_str = (gchar *) g_hash_table_lookup(problem_info, FILENAME_PID);
+    char *err_pos;
+
+    if (!pid_str)
+    {
+        error_msg("PID data is missing, aborting");
+        return 0;
+    }
+
+    errno = 0;
+    ret = strtol(pid_str, &err_pos, 10);
+    if (errno || pid_str == err_pos || *err_pos != '\0'
+        || ret > UINT_MAX || ret < 1)
+    {
+        error_msg("Malformed or out-of-range PID number: '%s'", pid_str);
+        return 0;
+    }
+
+    return (unsigned) ret;
+}
+
+/* Create a new problem directory from client session.
+ * Returns the malloced path of the directory or NULL.
+ */
+static char *create_problem_dir(struct abrt_request *req, unsigned pid)
+{
+    GHashTable *problem_info = req->problem_info;
+
+    /* Create temp directory with the problem data.
+     * This directory is renamed to final directory name after
+     * all files have been stored into it.
+     */
+
+    gchar *dir_basename = g_hash_table_lookup(problem_info, "basename");
+    if (!dir_basename)
+        dir_basename = g_hash_table_lookup(problem_info, FILENAME_TYPE);
+
+    /* The problems of one batch can have the same pid */
+    char *path = req->batch_index == 0
+        ? xasprintf("%s/%s-%s-%u.new",
+                    g_settings_dump_location,
+                    dir_basename,
+                    iso_date_string(NULL),
+                    pid)
+        : xasprintf("%s/%s-%s-%u-%u.new",
+                    g_settings_dump_location,
+                    dir_basename,
+                    iso_date_string(NULL),
+                    pid, req->batch_index);
+
+    /* This item is useless, don't save it */
+    g_hash_table_remove(problem_info, "basename");
+
+    /* The v2 items might have been streamed to an incoming directory */
+    struct dump_dir *dd = req->dd;
+    req->dd = NULL;
+
+    /* No need to check the path length, as all variables used are limited,
+     * and dd_create() fails if the path is too long.
+     */
+    if (!dd)
+        dd = dd_create(path, /*fs owner*/0, DEFAULT_DUMP_DIR_MODE);
+    if (!dd)
+    {
+        error_msg("Error creating problem directory '%s'", path);
+        free(path);
+        return NULL;
+    }
+
+    /* The client of a spooled request might be gone and its pid reused, the
+     * client sent the data from /proc itself */
+    const int proc_dir_fd = req->client_pid > 0 ? open_proc_pid_dir(pid) : -1;
+    char *rootdir = NULL;
+
+    if (req->client_pid == 0)
+    {
+        dd_save_text(dd, FILENAME_SPOOLED, "1");
+    }
+    else if (proc_dir_fd < 0)
+    {
+        pwarn_msg("Cannot open /proc/%d:", pid);
+    }
+    else if (process_has_own_root_at(proc_dir_fd))
+    {
+        /* Obtain the root directory path only if process' root directory is
+         * not the same as the init's root directory
+         */
+        rootdir = get_rootdir_at(proc_dir_fd);
+    }
+
+    /* Reading data from an arbitrary root directory is not secure. */
+    if (proc_dir_fd >= 0 && g_settings_explorechroots)
+    {
+        char proc_pid_root[sizeof("/proc/[pid]/root") + sizeof(pid_t) * 3];
+        const size_t w = snprintf(proc_pid_root, sizeof(proc_pid_root), "/proc/%d/root", pid);
+        assert(sizeof(proc_pid_root) > w);
+
+        /* Yes, test 'rootdir' but use 'source_filename' because 'rootdir' can
+         * be '/' for a process with own namespace. 'source_filename' is /proc/[pid]/root. */
+        dd_create_basic_files(dd, req->client_uid, (rootdir != NULL) ? proc_pid_root : NULL);
+    }
+    else
+    {
+        dd_create_basic_files(dd, req->client_uid, NULL);
+    }
+
+    if (proc_dir_fd >= 0)
+    {
+        /* Obtain and save the command line. */
+        char *cmdline = get_cmdline_at(proc_dir_fd);
+        if (cmdline)
+        {
+            dd_save_text(dd, FILENAME_CMDLINE, cmdline);
+            free(cmdline);
+        }
+
+        /* Obtain and save the environment variables. */
+        char *environ = get_environ_at(proc_dir_fd);
+        if (environ)
+        {
+            dd_save_text(dd, FILENAME_ENVIRON, environ);
+            free(environ);
+        }
+
+        dd_copy_file_at(dd, FILENAME_CGROUP,    proc_dir_fd, "cgroup");
+        dd_copy_file_at(dd, FILENAME_MOUNTINFO, proc_dir_fd, "mountinfo");
+
+        FILE *open_fds = dd_open_item_file(dd, FILENAME_OPEN_FDS, O_RDWR);
+        if (open_fds)
+        {
+            if (dump_fd_info_at(proc_dir_fd, open_fds) < 0)
+                dd_delete_item(dd, FILENAME_OPEN_FDS);
+            fclose(open_fds);
+        }
+
+        const int init_proc_dir_fd = open_proc_pid_dir(1);
+        FILE *namespaces = dd_open_item_file(dd, FILENAME_NAMESPACES, O_RDWR);
+        if (namespaces && init_proc_dir_fd >= 0)
+        {
+            if (dump_namespace_diff_at(init_proc_dir_fd, proc_dir_fd, namespaces) < 0)
+                dd_delete_item(dd, FILENAME_NAMESPACES);
+        }
+        if (init_proc_dir_fd >= 0)
+            close(init_proc_dir_fd);
+        if (namespaces)
+            fclose(namespaces);
+
+        /* The process's root directory isn't the same as the init's root
+         * directory. */
+        if (rootdir)
+        {
+            if (strcmp(rootdir, "/") ==  0)
+            {   /* We are dealing containerized process because root's
+                 * directory path is '/' and that means that the process
+                 * has mounted its own root.
+                 * Seriously, it is possible if the process is running in its
+                 * own MOUNT namespaces.
+                 */
+                log_debug("Process %d is considered to be containerized", pid);
+                pid_t container_pid;
+                if (get_pid_of_container_at(proc_dir_fd, &container_pid) == 0)
+                {
+                    char *container_cmdline = get_cmdline(container_pid);
+                    dd_save_text(dd, FILENAME_CONTAINER_CMDLINE, container_cmdline);
+                    free(container_cmdline);
+                }
+            }
+            else
+            {   /* We are dealing chrooted process. */
+                dd_save_text(dd, FILENAME_ROOTDIR, rootdir);
+            }
+        }
+        close(proc_dir_fd);
+    }
+    free(rootdir);
+
+    /* Store id of the user whose application crashed. */
+    char uid_str[sizeof(long) * 3 + 2];
+    sprintf(uid_str, "%lu", (long)req->client_uid);
+    dd_save_text(dd, FILENAME_UID, uid_str);
+
+    GHashTableIter iter;
+    gpointer gpkey;
+    gpointer gpvalue;
+    g_hash_table_iter_init(&iter, problem_info);
+    while (g_hash_table_iter_next(&iter, &gpkey, &gpvalue))
+    {
+        /* The streamed items are already saved */
+        if (gpvalue != NULL)
+            dd_save_text(dd, (gchar *) gpkey, (gchar *) gpvalue);
+    }
+
+    dd_save_text(dd, FILENAME_ABRT_VERSION, VERSION);
+
+    char *dd_path = xstrdup(dd->dd_dirname);
+    dd_close(dd);
+
+    /* Not needing it anymore */
+    g_hash_table_remove_all(problem_info);
+
+    /* Move the completely created problem directory
+     * to final directory.
+     */
+    char *newpath = xstrndup(path, strlen(path) - strlen(".new"));
+    if (rename(dd_path, newpath) == 0)
+        strcpy(path, newpath);
+    else if (strcmp(dd_path, path) != 0)
+    {
+        free(path);
+        path = dd_path;
+        dd_path = NULL;
+    }
+    free(newpath);
+    free(dd_path);
+
+    log_notice("Saved problem directory of pid %u to '%s'", pid, path);
+    return path;
+}
+
+int abrt_request_create_problem(struct abrt_request *req, char **dirname)
+{
+    if (data_is_missing(req->problem_info))
+        return 400; /* Bad Request */
+
+    /* Save problem dir */
+    char *executable = g_hash_table_lookup(req->problem_info, FILENAME_EXECUTABLE);
+    if (executable)
+    {
+        int repeating_crash = !crash_admission_check(g_settings_dump_location, executable,
+                req->client_uid, g_settings_crash_rate_burst, g_settings_crash_rate_interval);
+        if (repeating_crash) /* Only pretend that we saved it */
+        {
+            error_msg("Not saving repeating crash in '%s'", executable);
+            return 200;
+        }
+    }
+
+    unsigned pid = convert_pid(req->problem_info);
+    if (pid == 0)
+        return 400; /* Bad Request */
+
+    /* The client of a spooled request is not known */
+    if (req->client_pid > 0)
+    {
+        static struct ns_ids own_ids;
+        static bool own_ids_loaded;
+        if (!own_ids_loaded)
+        {
+            if (get_ns_ids(getpid(), &own_ids) < 0)
+            {
+                error_msg("Cannot get own Namespaces from /proc/%d/ns", getpid());
+                return 500; /* Internal Server Error */
+            }
+            own_ids_loaded = true;
+        }
+
+        struct ns_ids client_ids;
+        if (get_ns_ids(req->client_pid, &client_ids) < 0)
+        {
+            error_msg("Cannot get peer's Namespaces from /proc/%d/ns", req->client_pid);
+            return 500; /* Internal Server Error */
+        }
+
+        if (client_ids.nsi_ids[PROC_NS_ID_PID] != own_ids.nsi_ids[PROC_NS_ID_PID])
+        {
+            log_notice("Client is running in own PID Namespace, using PID %d instead of %d", req->client_pid, pid);
+            pid = req->client_pid;
+        }
+    }
+
+    /* Refuse if free space is less than 1/4 of MaxCrashReportsSize */
+    if (g_settings_nMaxCrashReportsSize > 0
+        && low_free_space(g_settings_nMaxCrashReportsSize, g_settings_dump_location))
+        return 507; /* Insufficient Storage */
+
+    *dirname = create_problem_dir(req, pid);
+    return *dirname != NULL ? 201 : 500;
+}
+
+GList *abrt_request_create_batch(struct abrt_request *req, struct strbuf *status)
+{
+    GList *paths = NULL;
+
+    while (req->batch != NULL)
+    {
+        struct abrt_batch_problem *problem = req->batch->data;
+        req->batch = g_list_delete_link(req->batch, req->batch);
+
+        /* Every problem is created as if it were sent alone */
+        g_hash_table_destroy(req->problem_info);
+        req->problem_info = problem->problem_info;
+        req->dd = problem->dd;
+        free(problem);
+        ++req->batch_index;
+
+        char *path = NULL;
+        const int code = abrt_request_create_problem(req, &path);
+        if (path != NULL)
+        {
+            strbuf_append_strf(status, "%u %s\n", code, path);
+            paths = g_list_prepend(paths, path);
+        }
+        else
+            strbuf_append_strf(status, "%u\n", code);
+
+        /* The problem was refused before its directory was completed */
+        if (req->dd != NULL)
+        {
+            dd_delete(req->dd);
+            req->dd = NULL;
+        }
+    }
+
+    return g_list_reverse(paths);
+}
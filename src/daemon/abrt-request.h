@@ -0,0 +1,166 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef _ABRT_REQUEST_H_
+#define _ABRT_REQUEST_H_
+
+#include "libabrt.h"
+
+/* Amount of data received from one client for a message before reporting error. */
+#define ABRT_REQUEST_MAX_SIZE (4*1024*1024)
+/* The client must send the whole request in this many seconds, the time spent
+ * copying the passed files does not count */
+#define ABRT_REQUEST_TIMEOUT 10
+/* Bytes of a passed file copied at once */
+#define ABRT_REQUEST_COPY_CHUNK (1024*1024)
+/* File descriptors a client can pass with one request */
+#define ABRT_REQUEST_MAX_FDS 16
+/* Problems a client can send in one batch */
+#define ABRT_REQUEST_MAX_BATCH 64
+/* Value length of a v2 item whose value is a passed file descriptor */
+#define ABRT_REQUEST_FD_VALUE 0xFFFFFFFFu
+/* The problem directories the v2 items are streamed to, left behind if the
+ * daemon dies in the middle of a request */
+#define ABRT_INCOMING_DIR_PREFIX ".incoming-"
+
+/* Set in the environment of the events run by abrt-server, the problems
+ * provoked by the events are ignored */
+#define ABRT_SERVER_EVENT_ENV "ABRT_SERVER_PID"
+
+enum abrt_request_type
+{
+    /* The header has not been received yet */
+    ABRT_REQUEST_UNKNOWN,
+    /* DELETE /path/to/problem/directory */
+    ABRT_REQUEST_DELETE,
+    /* POST /creation_notification, the body is a path */
+    ABRT_REQUEST_CREATION_NOTIFICATION,
+    /* POST /, the body is a sequence of NUL terminated KEY=VALUE items
+     * POST /v2, the body is a sequence of length-prefixed items */
+    ABRT_REQUEST_NEW_PROBLEM,
+    /* POST /batch, the body is a sequence of problems in the v2 format, every
+     * problem ends with an item with empty key and value */
+    ABRT_REQUEST_BATCH,
+};
+
+/* A received problem of ABRT_REQUEST_BATCH */
+struct abrt_batch_problem
+{
+    GHashTable *problem_info;
+    struct dump_dir *dd;
+};
+
+/* A request received on abrt.socket. The request is parsed incrementally,
+ * so it can be fed with data as they arrive from a non-blocking socket.
+ */
+struct abrt_request
+{
+    uid_t client_uid;
+    /* 0 if the request was spooled */
+    pid_t client_pid;
+    enum abrt_request_type type;
+    /* 1 or 2 */
+    unsigned version;
+    /* The unprocessed data; the path of DELETE and CREATION_NOTIFICATION */
+    char *buf;
+    unsigned len;
+    unsigned total_len;
+    /* The items of NEW_PROBLEM, the streamed items have NULL values */
+    GHashTable *problem_info;
+
+    /* The state of the v2 item being received */
+    int item_state;
+    unsigned item_left;
+    uint32_t value_len;
+    char *key;
+    /* The streamed item */
+    FILE *item_file;
+    /* The directory the items are streamed to */
+    struct dump_dir *dd;
+    unsigned long long streamed_len;
+
+    /* The passed file being copied to item_file or -1 */
+    int copy_fd;
+    off_t copy_offset;
+    off_t copy_size;
+    /* The received data following the passed file, processed once the file
+     * is copied */
+    char *pending;
+    unsigned pending_len;
+
+    /* The received file descriptors waiting for their items */
+    int fds[ABRT_REQUEST_MAX_FDS];
+    unsigned fd_count;
+    unsigned fd_next;
+
+    /* The received problems of BATCH */
+    GList *batch;
+    unsigned batch_len;
+    /* Makes the names of the problems of one batch unique */
+    unsigned batch_index;
+};
+
+void abrt_request_init(struct abrt_request *req, uid_t client_uid, pid_t client_pid);
+void abrt_request_destroy(struct abrt_request *req);
+
+/* Frees the problem directories the items were streamed to without unlocking
+ * or deleting them. Called by the parent once a forked process has taken the
+ * request over. */
+void abrt_request_forget_dirs(struct abrt_request *req);
+
+/* Reads from the client's socket like read(), the passed file descriptors are
+ * kept for the v2 items */
+ssize_t abrt_request_recv(struct abrt_request *req, int sockfd, char *buf, size_t size);
+
+/* Returns 0 if the request can continue, otherwise the HTTP error code */
+int abrt_request_feed(struct abrt_request *req, const char *data, unsigned len);
+
+/* Returns true while a passed file is being copied. abrt_request_copy() must
+ * be called until it returns false, the data fed in the meantime are kept
+ * until the file is copied. */
+bool abrt_request_copying(struct abrt_request *req);
+
+/* Copies the next ABRT_REQUEST_COPY_CHUNK bytes of the passed file and
+ * processes the data following it once the file is copied. Returns 0 if the
+ * request can continue, otherwise the HTTP error code. */
+int abrt_request_copy(struct abrt_request *req);
+
+/* Called once the client has sent everything. Returns 0 if the request is
+ * complete, otherwise the HTTP error code. */
+int abrt_request_finish(struct abrt_request *req);
+
+/* Carries out ABRT_REQUEST_DELETE. Returns the HTTP code */
+int abrt_request_delete(struct abrt_request *req);
+
+/* Checks whether the new problem directory can be processed. The directories
+ * provoked by the events run by abrt-server are deleted. Returns 0 if the
+ * directory can be processed, otherwise the HTTP error code. */
+int abrt_request_check_new_dir(const char *dirname);
+
+/* Carries out ABRT_REQUEST_NEW_PROBLEM. Returns 201 and the malloced path of
+ * the new problem directory in dirname, 200 if the crash was ignored or the
+ * HTTP error code. */
+int abrt_request_create_problem(struct abrt_request *req, char **dirname);
+
+/* Carries out ABRT_REQUEST_BATCH. Appends a line with the HTTP code of every
+ * problem and the path of its new problem directory to status. Returns the
+ * list of the malloced paths of the new problem directories. */
+GList *abrt_request_create_batch(struct abrt_request *req, struct strbuf *status);
+
+#endif /*_ABRT_REQUEST_H_*/
@@ -24,6 +24,7 @@
 
 #include "abrt_glib.h"
 #include "abrt-inotify.h"
+#include "abrt-request.h"
 #include "libabrt.h"
 #include "problem_api.h"
 
@@ -42,7 +43,29 @@
 /* Maximum number of simultaneously opened client connections. */
 #define MAX_CLIENT_COUNT  10
 
-#define IN_DUMP_LOCATION_FLAGS (IN_DELETE_SELF | IN_MOVE_SELF)
+#define IN_DUMP_LOCATION_FLAGS (IN_DELETE_SELF | IN_MOVE_SELF \
+                                | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+#define POST_CREATE_STATS_FILE VAR_RUN"/abrt/post-create-queue"
+/* How often the load status is refreshed while abrtd is busy */
+#define LOAD_STATUS_INTERVAL 5
+/* Used if PostCreatePriorities is not set */
+#define DEFAULT_POST_CREATE_PRIORITIES "vmcore:20, Kerneloops:20"
+
+/* The spool directory is writable by everybody, readable by root only */
+#define SPOOL_DIR_MODE 01733
+/* abrtd processes this many spooled requests per second */
+#define SPOOL_DRAIN_BATCH 10
+/* Temporary files left behind by the clients which died while spooling a
+ * request are removed after this many seconds */
+#define SPOOL_STALE_TIMEOUT 60
+/* The spool directory is on tmpfs, a user can't keep more requests there,
+ * the newest ones over the limits are removed */
+#define SPOOL_MAX_REQUESTS_PER_UID 32
+#define SPOOL_MAX_BYTES_PER_UID (2 * ABRT_REQUEST_MAX_SIZE)
+
+/* Check the size index against the dump location at least this often (seconds) */
+#define DIR_SIZES_SYNC_INTERVAL (10 * 60)
 
 #define ABRTD_DBUS_NAME ABRT_DBUS_NAME".daemon"
 
@@ -59,43 +82,109 @@ static unsigned s_timeout;
 static int s_timeout_src;
 static GMainLoop *s_main_loop;
 
-GList *s_processes;
-GList *s_dir_queue;
+/* Clients connected to abrt.socket, struct abrt_client */
+static GList *s_clients;
+
+/* Sizes of the problem directories, updated from inotify events and after
+ * post-create, so the dump location is not walked for every new problem */
+static dir_size_index_t *s_dir_sizes;
+static time_t s_dir_sizes_synced;
 
 static GIOChannel *channel_socket = NULL;
 static guint channel_id_socket = 0;
-static int child_count = 0;
 
-struct abrt_server_proc
+/* A client connected to abrt.socket. The request is served in the main loop,
+ * the client is never blocked by another one.
+ */
+struct abrt_client
 {
-    pid_t pid;
-    int fdout;
-    char *dirname;
+    int fd;
     GIOChannel *channel;
     guint watch_id;
-    enum {
-        AS_UKNOWN,
-        AS_POST_CREATE,
-    } type;
+    /* The client must send the whole request in ABRT_REQUEST_TIMEOUT, the
+     * timeout is stopped while a passed file is copied */
+    guint timeout_id;
+    /* Copies a passed file in chunks when the main loop is idle */
+    guint copy_id;
+    struct abrt_request req;
 };
 
-/* Returns 0 if proc's pid equals the the given pid */
-static gint abrt_server_compare_pid(struct abrt_server_proc *proc, pid_t *pid)
+/* A forked process carrying out a request which creates or deletes problem
+ * directories, so the main loop never waits for the dump location or /proc.
+ * The worker replies to the client and sends the NUL terminated paths of the
+ * new problem directories through a pipe.
+ */
+struct request_worker
 {
-    return proc->pid != *pid;
-}
+    pid_t pid;
+    GIOChannel *channel;
+    guint watch_id;
+    /* The received paths */
+    GString *paths;
+};
 
-/* Returns 0 if proc's fdout equals the the given fdout */
-static gint abrt_server_compare_fdout(struct abrt_server_proc *proc, int *fdout)
+/* Running struct request_worker, they count against MAX_CLIENT_COUNT */
+static GList *s_request_workers;
+
+/* A new problem directory reported on abrt.socket waits in the post-create
+ * queue and abrtd runs 'abrt-server -r' on it once there is
+ * a free slot and no queued problem can be its duplicate. The waiting problems
+ * are not processed in the order of detection, see pick_post_create_job().
+ */
+struct post_create_job
 {
-    return proc->fdout != *fdout;
-}
+    char *dirname;
+    /* Problems with the same key can be duplicates of each other */
+    char *dup_key;
+    char *type;
+    /* -1 if unknown */
+    long uid;
+    /* PostCreatePriorities of the type */
+    int priority;
+    time_t enqueued;
+    /* Order of detection */
+    unsigned long seq;
+    /* The socket of the client waiting for the result or -1 */
+    int reply_fd;
+    /* The post-create process or 0 if the job is waiting */
+    pid_t pid;
+};
 
-/* Returns 0 if proc's dirname equals the the given dirname */
-static gint abrt_server_compare_dirname(struct abrt_server_proc *proc, const char *dirname)
+/* dirname -> struct post_create_job, owns the jobs */
+static GHashTable *s_post_create_jobs;
+/* dup_key -> GQueue of the jobs with the key in the order of detection, only
+ * the head of the queue can be processed */
+static GHashTable *s_post_create_keys;
+/* Waiting heads of the key queues in the order of detection */
+static GQueue s_post_create_ready = G_QUEUE_INIT;
+/* pid -> running struct post_create_job */
+static GHashTable *s_post_create_workers;
+static unsigned long s_post_create_seq;
+/* Survives restarts of abrtd, the queued directories are not lost */
+static post_create_journal_t *s_journal;
+
+struct post_create_stats
 {
-    return g_strcmp0(proc->dirname, dirname);
-}
+    unsigned queued;
+    unsigned running;
+    unsigned long started;
+    unsigned long long total_wait;
+    unsigned long max_wait;
+};
+
+/* "type NAME" or "uid NUMBER" -> struct post_create_stats */
+static GHashTable *s_post_create_stats;
+static guint s_post_create_stats_timeout;
+
+/* Problems detected in the current and in the previous minute */
+static time_t s_detected_minute;
+static unsigned s_detected_now;
+static unsigned s_detected_before;
+static guint s_load_status_timeout;
+static bool s_degraded;
+
+/* Drains the requests left in the spool directory while abrtd was busy */
+static guint s_spool_drain_timeout;
 
 /* Helpers */
 static guint add_watch_or_die(GIOChannel *channel, unsigned condition, GIOFunc func)
@@ -107,212 +196,1061 @@ static guint add_watch_or_die(GIOChannel *channel, unsigned condition, GIOFunc f
     return r;
 }
 
-static void stop_abrt_server(struct abrt_server_proc *proc)
+/* Duplicates are searched among all problems of the user, so two problems
+ * can be marked as duplicates of each other only if they have the same user,
+ * type and executable.
+ */
+static void load_post_create_job_info(struct post_create_job *job)
+{
+    job->uid = -1;
+
+    char *path = concat_path_file(g_settings_dump_location, job->dirname);
+    struct dump_dir *dd = dd_opendir(path, DD_OPEN_READONLY | DD_FAIL_QUIETLY_ENOENT);
+    free(path);
+    if (dd == NULL)
+        return;
+
+    char *uid = dd_load_text_ext(dd, FILENAME_UID, DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    char *type = dd_load_text_ext(dd, FILENAME_TYPE, DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    char *executable = dd_load_text_ext(dd, FILENAME_EXECUTABLE, DD_FAIL_QUIETLY_ENOENT | DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE);
+    dd_close(dd);
+
+    job->dup_key = xasprintf("%s\n%s\n%s", uid ? uid : "", type ? type : "", executable ? executable : "");
+
+    if (uid != NULL)
+    {
+        char *end;
+        errno = 0;
+        const long l = strtol(uid, &end, 10);
+        if (errno == 0 && end != uid && *end == '\0' && l >= 0)
+            job->uid = l;
+    }
+
+    job->type = type;
+    free(executable);
+    free(uid);
+}
+
+/* PostCreatePriorities is a list of TYPE:PRIORITY pairs separated by commas */
+static int post_create_type_priority(const char *type)
+{
+    if (type == NULL)
+        return 0;
+
+    const char *priorities = g_settings_post_create_priorities;
+    if (priorities == NULL)
+        priorities = DEFAULT_POST_CREATE_PRIORITIES;
+
+    const size_t type_len = strlen(type);
+    const char *item = priorities;
+    while (*item != '\0')
+    {
+        item = skip_whitespace(item);
+        const char *colon = strchr(item, ':');
+        if (colon == NULL)
+            break;
+
+        if (colon - item == type_len && strncmp(item, type, type_len) == 0)
+            return strtol(colon + 1, NULL, 10);
+
+        item = strchrnul(colon, ',');
+        if (*item == ',')
+            ++item;
+    }
+
+    return 0;
+}
+
+static gboolean save_post_create_stats(gpointer unused)
+{
+    s_post_create_stats_timeout = 0;
+
+    struct strbuf *content = strbuf_new();
+    strbuf_append_str(content, "# KIND NAME QUEUED RUNNING STARTED TOTAL_WAIT_SEC MAX_WAIT_SEC\n");
+
+    GHashTableIter iter;
+    gpointer name, value;
+    g_hash_table_iter_init(&iter, s_post_create_stats);
+    while (g_hash_table_iter_next(&iter, &name, &value))
+    {
+        const struct post_create_stats *stats = value;
+        strbuf_append_strf(content, "%s %u %u %lu %llu %lu\n", (const char *)name,
+                stats->queued, stats->running, stats->started,
+                stats->total_wait, stats->max_wait);
+    }
+
+    char *tmp_path = xasprintf("%s.%lu", POST_CREATE_STATS_FILE, (long)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd < 0)
+        perror_msg("Can't create '%s'", tmp_path);
+    else
+    {
+        const ssize_t written = full_write(fd, content->buf, content->len);
+        if (close(fd) != 0 || written != (ssize_t)content->len
+            || rename(tmp_path, POST_CREATE_STATS_FILE) != 0)
+        {
+            perror_msg("Can't write '%s'", POST_CREATE_STATS_FILE);
+            unlink(tmp_path);
+        }
+    }
+
+    free(tmp_path);
+    strbuf_free(content);
+    return FALSE; /* Remove this event */
+}
+
+static void roll_detection_rate(time_t now)
+{
+    const time_t minute = now / 60;
+    if (minute == s_detected_minute)
+        return;
+
+    s_detected_before = minute == s_detected_minute + 1 ? s_detected_now : 0;
+    s_detected_now = 0;
+    s_detected_minute = minute;
+}
+
+/* Approximates the number of problems detected in the last 60 seconds by
+ * the current minute and the overlapping part of the previous one */
+static unsigned detection_rate(void)
+{
+    const time_t now = time(NULL);
+    roll_detection_rate(now);
+    return s_detected_now + s_detected_before * (60 - now % 60) / 60;
+}
+
+static gboolean publish_load_status(gpointer unused)
+{
+    s_load_status_timeout = 0;
+
+    struct load_status status;
+    status.running = g_hash_table_size(s_post_create_workers);
+    status.queued = g_hash_table_size(s_post_create_jobs) - status.running;
+    status.rate = detection_rate();
+    status.free_space = get_free_space_mb(g_settings_dump_location);
+    status.degraded =
+        (g_settings_degrade_queue_length != 0 && status.queued > g_settings_degrade_queue_length)
+        || (g_settings_degrade_rate != 0 && status.rate > g_settings_degrade_rate)
+        || (g_settings_nMaxCrashReportsSize != 0 && status.free_space < g_settings_nMaxCrashReportsSize / 2);
+
+    if (status.degraded != s_degraded)
+    {
+        s_degraded = status.degraded;
+        if (s_degraded)
+            log_warning("Asking the hooks to save less data: %u problems queued, "
+                        "%u detected in the last minute, %lu MiB free",
+                        status.queued, status.rate, status.free_space);
+        else
+            log_warning("The hooks can save all data again");
+    }
+
+    load_status_save(&status);
+
+    /* Keep the rate and the free space up to date until the load goes away */
+    if (status.degraded || status.rate != 0)
+        s_load_status_timeout = g_timeout_add_seconds(LOAD_STATUS_INTERVAL, publish_load_status, NULL);
+
+    return FALSE; /* Remove this event */
+}
+
+/* The status is published at most once a second */
+static void schedule_load_status(void)
+{
+    if (s_load_status_timeout != 0)
+        return;
+
+    s_load_status_timeout = g_timeout_add_seconds(1, publish_load_status, NULL);
+}
+
+static struct post_create_stats *post_create_stats_of(const char *kind, const char *name)
+{
+    char *key = xasprintf("%s %s", kind, name);
+    struct post_create_stats *stats = g_hash_table_lookup(s_post_create_stats, key);
+    if (stats == NULL)
+    {
+        stats = xzalloc(sizeof(*stats));
+        g_hash_table_insert(s_post_create_stats, key, stats);
+    }
+    else
+        free(key);
+
+    return stats;
+}
+
+/* Accounts the job in the statistics of its type and user, the file is
+ * updated at most once a second */
+static void update_post_create_stats(const struct post_create_job *job,
+        int queued, int running, long waited)
+{
+    char uid_str[sizeof(long) * 3 + 2];
+    sprintf(uid_str, "%ld", job->uid);
+
+    struct post_create_stats *stats[2] = {
+        post_create_stats_of("type", job->type ? job->type : "-"),
+        post_create_stats_of("uid", uid_str),
+    };
+
+    unsigned i;
+    for (i = 0; i < ARRAY_SIZE(stats); ++i)
+    {
+        stats[i]->queued += queued;
+        stats[i]->running += running;
+        if (waited >= 0)
+        {
+            ++stats[i]->started;
+            stats[i]->total_wait += waited;
+            if (stats[i]->max_wait < waited)
+                stats[i]->max_wait = waited;
+        }
+    }
+
+    if (s_post_create_stats_timeout == 0)
+        s_post_create_stats_timeout = g_timeout_add_seconds(1, save_post_create_stats, NULL);
+
+    schedule_load_status();
+}
+
+static unsigned max_post_create_jobs(void)
+{
+    if (g_settings_max_post_create_jobs != 0)
+        return g_settings_max_post_create_jobs;
+
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? cpus : 1;
+}
+
+static void post_create_job_free(struct post_create_job *job)
+{
+    if (job->reply_fd >= 0)
+        close(job->reply_fd);
+    free(job->type);
+    free(job->dup_key);
+    free(job->dirname);
+    free(job);
+}
+
+/* Replies to the client waiting for the result of post-create */
+static void reply_to_client_with_body(int *client_fd, unsigned code, const char *body)
+{
+    if (*client_fd < 0)
+        return;
+
+    char *reply = xasprintf("HTTP/1.1 %u \r\n\r\n%s", code, body);
+    const ssize_t len = strlen(reply);
+    /* The client might have gone away, never get SIGPIPE */
+    if (send(*client_fd, reply, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len)
+        log_debug("Can't reply %u to the client", code);
+
+    free(reply);
+    close(*client_fd);
+    *client_fd = -1;
+}
+
+static void reply_to_client(int *client_fd, unsigned code)
+{
+    reply_to_client_with_body(client_fd, code, "");
+}
+
+static gint post_create_job_cmp_seq(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const struct post_create_job *ja = a;
+    const struct post_create_job *jb = b;
+    return (ja->seq > jb->seq) - (ja->seq < jb->seq);
+}
+
+static void enqueue_post_create_job(const char *dirname, int reply_fd)
+{
+    if (g_hash_table_lookup(s_post_create_jobs, dirname) != NULL)
+    {
+        log_warning("Problem directory '%s' is already queued", dirname);
+        if (reply_fd >= 0)
+            close(reply_fd);
+        return;
+    }
+
+    struct post_create_job *job = xzalloc(sizeof(*job));
+    job->dirname = xstrdup(dirname);
+    load_post_create_job_info(job);
+    job->priority = post_create_type_priority(job->type);
+    job->enqueued = time(NULL);
+    job->seq = ++s_post_create_seq;
+    job->reply_fd = reply_fd;
+    g_hash_table_insert(s_post_create_jobs, job->dirname, job);
+    if (s_journal != NULL)
+        post_create_journal_enqueue(s_journal, dirname);
+
+    /* Problems without key can't be opened, post-create fails on them
+     * anyway. Serialize them among each other only. */
+    const char *key = job->dup_key ? job->dup_key : "";
+    GQueue *same_key = g_hash_table_lookup(s_post_create_keys, key);
+    if (same_key == NULL)
+    {
+        same_key = g_queue_new();
+        g_hash_table_insert(s_post_create_keys, xstrdup(key), same_key);
+    }
+    g_queue_push_tail(same_key, job);
+
+    if (g_queue_get_length(same_key) == 1)
+        g_queue_push_tail(&s_post_create_ready, job);
+
+    update_post_create_stats(job, /*queued*/1, /*running*/0, /*waited*/-1);
+
+    log_debug("Queued '%s' for post-create (%u queued)", dirname,
+              g_hash_table_size(s_post_create_jobs));
+}
+
+/* Removes the finished or cancelled job from the queue and frees it */
+static void remove_post_create_job(struct post_create_job *job)
+{
+    const char *key = job->dup_key ? job->dup_key : "";
+    GQueue *same_key = g_hash_table_lookup(s_post_create_keys, key);
+    const bool was_head = g_queue_peek_head(same_key) == job;
+    g_queue_remove(same_key, job);
+
+    if (job->pid != 0)
+    {
+        g_hash_table_remove(s_post_create_workers, GINT_TO_POINTER(job->pid));
+        update_post_create_stats(job, /*queued*/0, /*running*/-1, /*waited*/-1);
+    }
+    else
+    {
+        if (was_head)
+            g_queue_remove(&s_post_create_ready, job);
+        update_post_create_stats(job, /*queued*/-1, /*running*/0, /*waited*/-1);
+    }
+
+    /* A problem with the same key can be processed now */
+    if (g_queue_is_empty(same_key))
+        g_hash_table_remove(s_post_create_keys, key);
+    else if (was_head)
+        g_queue_insert_sorted(&s_post_create_ready, g_queue_peek_head(same_key),
+                              post_create_job_cmp_seq, NULL);
+
+    if (s_journal != NULL)
+        post_create_journal_complete(s_journal, job->dirname);
+    g_hash_table_remove(s_post_create_jobs, job->dirname);
+}
+
+static pid_t spawn_post_create(struct post_create_job *job)
+{
+    char *path = concat_path_file(g_settings_dump_location, job->dirname);
+
+    fflush(NULL); /* paranoia */
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror_msg("fork");
+        free(path);
+        return pid;
+    }
+    if (pid == 0) /* child */
+    {
+        xmove_fd(xopen("/dev/null", O_RDWR), STDIN_FILENO);
+        if (job->reply_fd >= 0)
+            xmove_fd(job->reply_fd, STDOUT_FILENO);
+        else
+            xdup2(STDIN_FILENO, STDOUT_FILENO);
+
+        char *argv[5];  /* abrt-server [-s] -r DIR NULL */
+        char **pp = argv;
+        *pp++ = (char*)"abrt-server";
+        if (logmode & LOGMODE_JOURNAL)
+            *pp++ = (char*)"-s";
+        *pp++ = (char*)"-r";
+        *pp++ = path;
+        *pp = NULL;
+
+        execvp(argv[0], argv);
+        perror_msg_and_die("Can't execute '%s'", argv[0]);
+    }
+
+    /* parent */
+    free(path);
+    return pid;
+}
+
+/* Picks the waiting problem to be processed next:
+ * - a user running less than a fair share of the slots goes first, so a user
+ *   crashing many programs does not hold back the others,
+ * - then the problem with the highest priority; waiting raises the priority
+ *   by one every PostCreateAging seconds, so nothing starves,
+ * - then the problem detected first.
+ */
+static struct post_create_job *pick_post_create_job(unsigned max_jobs)
+{
+    /* uid -> running jobs + 1, users with no running job have 1 */
+    GHashTable *users = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, s_post_create_workers);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        gpointer uid = GINT_TO_POINTER(((struct post_create_job *)value)->uid);
+        const unsigned running = GPOINTER_TO_UINT(g_hash_table_lookup(users, uid));
+        g_hash_table_insert(users, uid, GUINT_TO_POINTER(running ? running + 1 : 2));
+    }
+
+    GList *item;
+    for (item = s_post_create_ready.head; item != NULL; item = g_list_next(item))
+    {
+        gpointer uid = GINT_TO_POINTER(((struct post_create_job *)item->data)->uid);
+        if (g_hash_table_lookup(users, uid) == NULL)
+            g_hash_table_insert(users, uid, GUINT_TO_POINTER(1));
+    }
+
+    const unsigned fair_share = MAX(1, max_jobs / MAX(1, g_hash_table_size(users)));
+    const time_t now = time(NULL);
+
+    struct post_create_job *best = NULL;
+    bool best_fair = false;
+    long best_priority = 0;
+    for (item = s_post_create_ready.head; item != NULL; item = g_list_next(item))
+    {
+        struct post_create_job *job = (struct post_create_job *)item->data;
+        const unsigned running = GPOINTER_TO_UINT(g_hash_table_lookup(users, GINT_TO_POINTER(job->uid))) - 1;
+        const bool fair = running < fair_share;
+
+        long priority = job->priority;
+        if (g_settings_post_create_aging != 0 && now > job->enqueued)
+            priority += (now - job->enqueued) / g_settings_post_create_aging;
+
+        /* The ready queue is in the order of detection */
+        if (best == NULL
+            || (fair && !best_fair)
+            || (fair == best_fair && priority > best_priority))
+        {
+            best = job;
+            best_fair = fair;
+            best_priority = priority;
+        }
+    }
+
+    g_hash_table_destroy(users);
+
+    if (best != NULL)
+        g_queue_remove(&s_post_create_ready, best);
+
+    return best;
+}
+
+/* Starts post-create of the waiting problems while there are free slots */
+static void start_post_create_jobs(void)
+{
+    const unsigned max_jobs = max_post_create_jobs();
+    unsigned running = g_hash_table_size(s_post_create_workers);
+
+    struct post_create_job *job;
+    while (running < max_jobs && (job = pick_post_create_job(max_jobs)) != NULL)
+    {
+        pid_t pid = spawn_post_create(job);
+        if (pid < 0)
+        {
+            log_warning("Directory '%s' will not be processed", job->dirname);
+            reply_to_client(&job->reply_fd, 503);
+            remove_post_create_job(job);
+            continue;
+        }
+
+        const long waited = MAX(0, time(NULL) - job->enqueued);
+        log_debug("Starting post-create of '%s' (%u running, priority %d, waited %lds)",
+                  job->dirname, running, job->priority, waited);
+
+        job->pid = pid;
+        /* The child replies */
+        if (job->reply_fd >= 0)
+        {
+            close(job->reply_fd);
+            job->reply_fd = -1;
+        }
+        g_hash_table_insert(s_post_create_workers, GINT_TO_POINTER(pid), job);
+        update_post_create_stats(job, /*queued*/-1, /*running*/1, waited);
+        ++running;
+    }
+}
+
+static void post_create_finished(struct post_create_job *job, int status)
+{
+    /* post-create adds elements or deletes the directory of a duplicate */
+    dir_size_index_update(s_dir_sizes, job->dirname);
+
+    if (WIFSIGNALED(status))
+        log_warning("post-create of '%s' killed by signal %d", job->dirname, WTERMSIG(status));
+
+    remove_post_create_job(job);
+    start_post_create_jobs();
+}
+
+/* Queues the directories which were waiting for post-create when abrtd
+ * stopped, in the order of their detection.
+ */
+static void requeue_journaled_dump_dirs(void)
 {
-    kill(proc->pid, SIGINT);
+    if (s_journal == NULL)
+        return;
+
+    GList *pending = post_create_journal_pending(s_journal);
+    GList *item;
+    for (item = pending; item != NULL; item = g_list_next(item))
+    {
+        const char *dirname = (const char *)item->data;
+        char *path = concat_path_file(g_settings_dump_location, dirname);
+        char *count_path = concat_path_file(path, FILENAME_COUNT);
+
+        struct stat stat_buf;
+        if (lstat(path, &stat_buf) != 0 || !S_ISDIR(stat_buf.st_mode)
+            || lstat(count_path, &stat_buf) == 0)
+        {
+            /* Deleted or processed while abrtd was not running */
+            post_create_journal_complete(s_journal, dirname);
+        }
+        else
+        {
+            log_notice("Queueing unprocessed problem directory '%s'", dirname);
+            enqueue_post_create_job(dirname, /*reply_fd*/-1);
+        }
+
+        free(count_path);
+        free(path);
+    }
+    g_list_free_full(pending, free);
+
+    start_post_create_jobs();
+}
+
+/* Queueing the directories will also lead to cleaning up the dump location,
+ * once for all of them. The reply_fd is the client waiting for the result of
+ * post-create of the only directory.
+ */
+static void queue_post_create_dirs(GList *dirnames, int reply_fd)
+{
+    load_abrt_conf();
+
+    roll_detection_rate(time(NULL));
+
+    /* The problem directories are complete now */
+    GList *fresh = g_list_copy(dirnames);
+    GList *item;
+    for (item = fresh; item != NULL; item = g_list_next(item))
+    {
+        ++s_detected_now;
+        dir_size_index_update(s_dir_sizes, (const char *)item->data);
+    }
+
+    if (g_settings_nMaxCrashReportsSize == 0)
+        goto consider_processing;
+
+    /* The directories being processed must not be deleted. If there is none,
+     * the new one is going to be processed right away. */
+    GList *ignored = NULL;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, s_post_create_workers);
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+        ignored = g_list_prepend(ignored, ((struct post_create_job *)value)->dirname);
+    if (ignored == NULL && fresh != NULL)
+        ignored = g_list_prepend(ignored, fresh->data);
+
+    const double max_size = 1024 * 1024 * g_settings_nMaxCrashReportsSize;
+
+    /* Never delete anything because of an out of date index */
+    const time_t now = time(NULL);
+    if (dir_size_index_total(s_dir_sizes) >= max_size || now - s_dir_sizes_synced >= DIR_SIZES_SYNC_INTERVAL)
+    {
+        dir_size_index_sync(s_dir_sizes);
+        dir_size_index_save(s_dir_sizes);
+        s_dir_sizes_synced = now;
+    }
+
+    char *worst_dir = NULL;
+    while (dir_size_index_total(s_dir_sizes) >= max_size
+           && (worst_dir = dir_size_index_find_worst(s_dir_sizes, ignored)))
+    {
+        const char *kind = "old";
+
+        struct post_create_job *deleted_job = NULL;
+        GList *deleted_fresh = g_list_find_custom(fresh, worst_dir, (GCompareFunc)strcmp);
+        if (deleted_fresh != NULL)
+        {
+            kind = "new";
+            reply_to_client(&reply_fd, 413);
+            fresh = g_list_delete_link(fresh, deleted_fresh);
+        }
+        else if ((deleted_job = g_hash_table_lookup(s_post_create_jobs, worst_dir)))
+        {
+            kind = "unprocessed";
+            reply_to_client(&deleted_job->reply_fd, 413);
+            remove_post_create_job(deleted_job);
+        }
+
+        log_warning("Size of '%s' >= %u MB (MaxCrashReportsSize), deleting %s directory '%s'",
+                g_settings_dump_location, g_settings_nMaxCrashReportsSize,
+                kind, worst_dir);
+
+        char *deleted = concat_path_file(g_settings_dump_location, worst_dir);
+
+        struct dump_dir *dd = dd_opendir(deleted, DD_FAIL_QUIETLY_ENOENT);
+        if (dd != NULL)
+            dd_delete(dd);
+
+        /* Walks the directory again if it could not be deleted */
+        dir_size_index_update(s_dir_sizes, worst_dir);
+
+        free(deleted);
+        free(worst_dir);
+        worst_dir = NULL;
+
+        if (dd == NULL)
+            /* Do not try to delete it again and again */
+            break;
+    }
+
+    g_list_free(ignored);
+
+consider_processing:
+    /* If the directories survived cleaning up the dump location, append them
+     * to the post-create queue.
+     */
+    for (item = fresh; item != NULL; item = g_list_next(item))
+        enqueue_post_create_job((const char *)item->data, reply_fd);
+    g_list_free(fresh);
+
+    /* Start processing of the new directories if there is a free post-create
+     * slot and no queued problem can be their duplicate.
+     */
+    start_post_create_jobs();
+}
+
+static void queue_post_create(const char *dirname, int reply_fd)
+{
+    GList *dirnames = g_list_prepend(NULL, (gpointer)dirname);
+    queue_post_create_dirs(dirnames, reply_fd);
+    g_list_free(dirnames);
+}
+
+static void start_idle_timeout(void)
+{
+    if (s_timeout == 0 || s_clients != NULL || s_request_workers != NULL
+        || s_spool_drain_timeout != 0
+        || g_hash_table_size(s_post_create_jobs) > 0)
+        return;
+
+    s_timeout_src = g_timeout_add_seconds(s_timeout, (GSourceFunc)g_main_loop_quit, s_main_loop);
+}
+
+static void kill_idle_timeout(void)
+{
+    if (s_timeout == 0)
+        return;
+
+    if (s_timeout_src != 0)
+        g_source_remove(s_timeout_src);
+
+    s_timeout_src = 0;
+}
+
+
+static gboolean server_socket_cb(GIOChannel *source, GIOCondition condition, gpointer ptr_unused);
+
+static void post_create_worker_exited(pid_t pid, int status)
+{
+    struct post_create_job *job = g_hash_table_lookup(s_post_create_workers, GINT_TO_POINTER(pid));
+    if (job != NULL)
+        post_create_finished(job, status);
+}
+
+static unsigned busy_client_slots(void)
+{
+    return g_list_length(s_clients) + g_list_length(s_request_workers);
+}
+
+static void resume_accepting_clients(void)
+{
+    if (busy_client_slots() < MAX_CLIENT_COUNT && !channel_id_socket && channel_socket)
+    {
+        log_info("Accepting connections on '%s'", SOCKET_FILE);
+        channel_id_socket = add_watch_or_die(channel_socket, G_IO_IN | G_IO_PRI | G_IO_HUP, server_socket_cb);
+    }
+}
+
+static void client_free(struct abrt_client *client)
+{
+    s_clients = g_list_remove(s_clients, client);
+
+    if (client->watch_id > 0)
+        g_source_remove(client->watch_id);
+    if (client->timeout_id > 0)
+        g_source_remove(client->timeout_id);
+    if (client->copy_id > 0)
+        g_source_remove(client->copy_id);
+
+    g_io_channel_unref(client->channel);
+    if (client->fd >= 0)
+        close(client->fd);
+
+    abrt_request_destroy(&client->req);
+    free(client);
+
+    resume_accepting_clients();
+}
+
+static void reply_or_log(int *reply_fd, int code)
+{
+    if (*reply_fd >= 0)
+        reply_to_client(reply_fd, code);
+    else if (code >= 400)
+        log_warning("Spooled request failed with %d", code);
+}
+
+/* Runs in the request worker. Replies to the client and writes the paths of
+ * the new problem directories to paths_fd.
+ */
+static void carry_out_request(struct abrt_request *req, int *reply_fd, int paths_fd)
+{
+    GList *paths = NULL;
+    char *path = NULL;
+    int code;
+
+    switch (req->type)
+    {
+        case ABRT_REQUEST_DELETE:
+            code = abrt_request_delete(req);
+            break;
+
+        case ABRT_REQUEST_NEW_PROBLEM:
+            code = abrt_request_create_problem(req, &path);
+            if (path != NULL)
+                paths = g_list_prepend(paths, path);
+            break;
+
+        case ABRT_REQUEST_BATCH:
+        {
+            /* Replies with the codes and paths of all problems of the batch */
+            struct strbuf *status = strbuf_new();
+            paths = abrt_request_create_batch(req, status);
+
+            if (*reply_fd >= 0)
+                reply_to_client_with_body(reply_fd, 200, status->buf);
+            else
+                log_info("Spooled batch processed:\n%s", status->buf);
+            strbuf_free(status);
+            code = 200;
+            break;
+        }
+
+        default:
+            code = 400; /* Bad Request */
+            break;
+    }
+
+    /* We let the peer know that problem dir was created successfully
+     * _before_ it waits for potentially long-running post-create.
+     */
+    reply_or_log(reply_fd, code);
+
+    GList *item;
+    for (item = paths; item != NULL; item = g_list_next(item))
+    {
+        path = (char *)item->data;
+        if (abrt_request_check_new_dir(path) == 0
+            && full_write(paths_fd, path, strlen(path) + 1) < 0)
+            perror_msg("Can't hand '%s' over to abrtd", path);
+    }
+
+    g_list_free_full(paths, free);
+}
+
+static void request_worker_free(struct request_worker *worker)
+{
+    s_request_workers = g_list_remove(s_request_workers, worker);
+
+    if (worker->watch_id > 0)
+        g_source_remove(worker->watch_id);
+    g_io_channel_unref(worker->channel);
+    g_string_free(worker->paths, TRUE);
+    free(worker);
+
+    resume_accepting_clients();
 }
 
-static void dispose_abrt_server(struct abrt_server_proc *proc)
+/* Collects the paths sent by the worker, queues them once the worker is done */
+static gboolean request_worker_io_cb(GIOChannel *channel, GIOCondition condition, gpointer user_data)
 {
-    close(proc->fdout);
-    free(proc->dirname);
+    struct request_worker *worker = (struct request_worker *)user_data;
+    const int fd = g_io_channel_unix_get_fd(channel);
+    char buf[4 * 1024];
+    ssize_t rd;
+
+    while ((rd = safe_read(fd, buf, sizeof(buf))) > 0)
+        g_string_append_len(worker->paths, buf, rd);
+
+    if (rd < 0 && errno == EAGAIN)
+        return TRUE; /* Keep this event */
+
+    if (rd < 0)
+        perror_msg("Can't read from request worker %d", worker->pid);
+
+    /* A path cut off by the death of the worker is ignored */
+    GList *dirnames = NULL;
+    const char *path = worker->paths->str;
+    const char *const end = worker->paths->str + worker->paths->len;
+    const char *path_end;
+    while ((path_end = memchr(path, '\0', end - path)) != NULL)
+    {
+        const char *slash = strrchr(path, '/');
+        if (slash != NULL)
+            dirnames = g_list_prepend(dirnames, (gpointer)(slash + 1));
+        path = path_end + 1;
+    }
 
-    if (proc->watch_id > 0)
-        g_source_remove(proc->watch_id);
+    dirnames = g_list_reverse(dirnames);
+    if (dirnames != NULL)
+        queue_post_create_dirs(dirnames, /*reply_fd*/-1);
+    g_list_free(dirnames);
 
-    if (proc->channel != NULL)
-        g_io_channel_unref(proc->channel);
+    worker->watch_id = 0;
+    request_worker_free(worker);
+
+    start_idle_timeout();
+    return FALSE; /* Remove this event */
 }
 
-static void notify_next_post_create_process(struct abrt_server_proc *finished)
+/* Forks a worker carrying out the request. The worker takes the problem
+ * directories of the request over, the client's socket stays open in abrtd
+ * until the caller closes it.
+ */
+static void start_request_worker(struct abrt_request *req, int *reply_fd)
 {
-    if (finished != NULL)
-        s_dir_queue = g_list_remove(s_dir_queue, finished);
-
-    while (s_dir_queue != NULL)
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) != 0)
     {
-        struct abrt_server_proc *n = (struct abrt_server_proc *)s_dir_queue->data;
-        if (n->type == AS_POST_CREATE)
-            break;
+        perror_msg("pipe");
+        reply_or_log(reply_fd, 500); /* Internal Server Error */
+        return;
+    }
 
-        if (kill(n->pid, SIGUSR1) >= 0)
-        {
-            n->type = AS_POST_CREATE;
-            break;
-        }
+    fflush(NULL); /* paranoia */
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror_msg("fork");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        reply_or_log(reply_fd, 500); /* Internal Server Error */
+        return;
+    }
+    if (pid == 0) /* child */
+    {
+        close(pipefd[0]);
 
-        /* This could happen only if the notified process disappeared - crashed?
-         */
-        perror_msg("Failed to send SIGUSR1 to %d", n->pid);
-        log_warning("Directory '%s' will not be processed", n->dirname);
+        /* The signals of the worker are not for the main loop */
+        s_signal_pipe_write = -1;
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT,  SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
 
-        /* Remove the problematic process from the post-crate directory queue
-         * and go to try to notify another process.
-         */
-        s_dir_queue = g_list_delete_link(s_dir_queue, s_dir_queue);
+        carry_out_request(req, reply_fd, pipefd[1]);
+        _exit(0);
     }
+
+    /* parent */
+    close(pipefd[1]);
+    abrt_request_forget_dirs(req);
+    log_debug("Request worker %d started", pid);
+
+    struct request_worker *worker = xzalloc(sizeof(*worker));
+    worker->pid = pid;
+    worker->paths = g_string_new(NULL);
+    ndelay_on(pipefd[0]);
+    worker->channel = g_io_channel_unix_new(pipefd[0]);
+    g_io_channel_set_close_on_unref(worker->channel, TRUE);
+    worker->watch_id = g_io_add_watch(worker->channel, G_IO_IN | G_IO_HUP | G_IO_ERR, request_worker_io_cb, worker);
+    s_request_workers = g_list_prepend(s_request_workers, worker);
 }
 
-/* Queueing the process will also lead to cleaning up the dump location.
+/* Carries out the received request and replies to the client unless it waits
+ * for the result of post-create or a worker replies. The reply_fd is -1 for
+ * spooled requests.
  */
-static void queue_post_craete_process(struct abrt_server_proc *proc)
+static void handle_request(struct abrt_request *req, int *reply_fd)
 {
-    load_abrt_conf();
-    struct abrt_server_proc *running = s_dir_queue == NULL ? NULL
-                                                           : (struct abrt_server_proc *)s_dir_queue->data;
-    if (g_settings_nMaxCrashReportsSize == 0)
-        goto consider_processing;
-
-    const char *full_path_ignored = running != NULL ? running->dirname
-                                                    : proc->dirname;
-    const char *ignored = strrchr(full_path_ignored, '/');
-    if (NULL == ignored)
-        /* Paranoia, this should not happen. */
-        ignored = full_path_ignored;
-    else
-        /* Move behind '/' */
-        ++ignored;
+    int code;
 
-    char *worst_dir = NULL;
-    const double max_size = 1024 * 1024 * g_settings_nMaxCrashReportsSize;
-    while (get_dirsize_find_largest_dir(g_settings_dump_location, &worst_dir, ignored) >= max_size
-           && worst_dir)
+    switch (req->type)
     {
-        const char *kind = "old";
-
-        GList *proc_of_deleted_item = NULL;
-        if (proc != NULL && strcmp(worst_dir, proc->dirname) == 0)
-        {
-            kind = "new";
-            stop_abrt_server(proc);
-            proc = NULL;
-        }
-        else if ((proc_of_deleted_item = g_list_find_custom(s_dir_queue, worst_dir, (GCompareFunc)abrt_server_compare_dirname)))
-        {
-            kind = "unprocessed";
-            struct abrt_server_proc *removed_proc = (struct abrt_server_proc *)proc_of_deleted_item->data;
-            s_dir_queue = g_list_delete_link(s_dir_queue, proc_of_deleted_item);
-            stop_abrt_server(removed_proc);
-        }
+        case ABRT_REQUEST_CREATION_NOTIFICATION:
+            if (req->client_uid != 0)
+            {
+                error_msg("UID=%ld is not authorized to trigger post-create processing", (long)req->client_uid);
+                code = 403; /* Forbidden */
+                break;
+            }
 
-        log_warning("Size of '%s' >= %u MB (MaxCrashReportsSize), deleting %s directory '%s'",
-                g_settings_dump_location, g_settings_nMaxCrashReportsSize,
-                kind, worst_dir);
+            code = abrt_request_check_new_dir(req->buf);
+            if (code != 0)
+                break;
 
-        char *deleted = concat_path_file(g_settings_dump_location, worst_dir);
-        free(worst_dir);
-        worst_dir = NULL;
+            log_notice("Client notified about new problem: %s", req->buf);
+            /* The client waits for the result of post-create */
+            queue_post_create(strrchr(req->buf, '/') + 1, *reply_fd);
+            *reply_fd = -1;
+            return;
 
-        struct dump_dir *dd = dd_opendir(deleted, DD_FAIL_QUIETLY_ENOENT);
-        if (dd != NULL)
-            dd_delete(dd);
+        case ABRT_REQUEST_DELETE:
+        case ABRT_REQUEST_NEW_PROBLEM:
+        case ABRT_REQUEST_BATCH:
+            start_request_worker(req, reply_fd);
+            return;
 
-        free(deleted);
+        default:
+            code = 400; /* Bad Request */
+            break;
     }
 
-consider_processing:
-    /* If the process survived cleaning up the dump location, append it to the
-     * post-create queue.
-     */
-    if (proc != NULL)
-        s_dir_queue = g_list_append(s_dir_queue, proc);
+    reply_or_log(reply_fd, code);
+}
 
-    /* If there were no running post-crate process before we added the
-     * currently handled process to the post-create queue, start processing of
-     * the currently handled process.
-     */
-    if (running == NULL)
-        notify_next_post_create_process(NULL/*finished*/);
+/* Carries out the received request or replies with the error code */
+static void client_done(struct abrt_client *client, int code)
+{
+    kill_idle_timeout();
+
+    if (code == 0)
+        handle_request(&client->req, &client->fd);
+    else if (code > 0)
+        reply_to_client(&client->fd, code);
+
+    client_free(client);
+
+    start_idle_timeout();
 }
 
-static gboolean abrt_server_output_cb(GIOChannel *channel, GIOCondition condition, gpointer user_data)
+static gboolean client_timeout_cb(gpointer user_data)
 {
-    int fdout = g_io_channel_unix_get_fd(channel);
-    GList *item = g_list_find_custom(s_processes, &fdout, (GCompareFunc)abrt_server_compare_fdout);
-    if (item == NULL)
-    {
-        log_warning("Closing a pipe fd (%d) without a process assigned", fdout);
-        close(fdout);
-        return FALSE;
-    }
+    struct abrt_client *client = (struct abrt_client *)user_data;
+
+    error_msg("Client (pid %d) timed out", client->req.client_pid);
+    client->timeout_id = 0;
+    client_free(client);
 
-    struct abrt_server_proc *proc = (struct abrt_server_proc *)item->data;
+    start_idle_timeout();
+    return FALSE; /* Remove this event */
+}
+
+static gboolean client_io_cb(GIOChannel *channel, GIOCondition condition, gpointer user_data);
+
+/* Copies the next chunk of the passed file, reading of the request resumes
+ * once the file is copied */
+static gboolean client_copy_cb(gpointer user_data)
+{
+    struct abrt_client *client = (struct abrt_client *)user_data;
 
-    if (condition & G_IO_HUP)
+    const int code = abrt_request_copy(&client->req);
+    if (code != 0)
     {
-        log_debug("abrt-server(%d) closed its pipe", proc->pid);
-        proc->watch_id = 0;
-        return FALSE;
+        client->copy_id = 0;
+        client_done(client, code);
+        return FALSE; /* Remove this event */
     }
 
+    if (abrt_request_copying(&client->req))
+        return TRUE; /* Keep this event */
+
+    client->copy_id = 0;
+    client->watch_id = g_io_add_watch(client->channel, G_IO_IN | G_IO_HUP | G_IO_ERR, client_io_cb, client);
+    client->timeout_id = g_timeout_add_seconds(ABRT_REQUEST_TIMEOUT, client_timeout_cb, client);
+    return FALSE; /* Remove this event */
+}
+
+/* Reads the request of the client as it arrives, never blocks */
+static gboolean client_io_cb(GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+    struct abrt_client *client = (struct abrt_client *)user_data;
+    char buf[64 * 1024];
+    int code;
+
     for (;;)
     {
-        gchar *line;
-        gsize len = 0;
-        gsize pos = 0;
-        GError *error = NULL;
-
-        /* We use buffered channel so we do not need to read from the channel in a
-         * loop */
-        GIOStatus stat = g_io_channel_read_line(channel, &line, &len, &pos, &error);
-        if (stat == G_IO_STATUS_ERROR)
-            error_msg_and_die("Can't read from pipe of abrt-server(%d): '%s'", proc->pid, error ? error->message : "");
-        if (stat == G_IO_STATUS_EOF)
+        const ssize_t rd = abrt_request_recv(&client->req, client->fd, buf, sizeof(buf));
+        if (rd < 0)
         {
-            log_debug("abrt-server(%d)'s output read till end", proc->pid);
-            proc->watch_id = 0;
-            return FALSE; /* Remove this event */
-        }
-        if (stat == G_IO_STATUS_AGAIN)
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return TRUE; /* Keep this event */
+
+            perror_msg("Can't read from client");
+            code = -1;
             break;
+        }
 
-        /* G_IO_STATUS_NORMAL) */
-        line[pos] = '\0';
-        if (g_str_has_prefix(line, "NEW_PROBLEM_DETECTED: "))
+        if (rd == 0)
         {
-            if (proc->dirname != NULL)
-            {
-                log_warning("abrt-server(%d): already handling: %s", proc->pid, proc->dirname);
-                free(proc->dirname);
-                /* Because process can be only once in the dir queue */
-                s_dir_queue = g_list_remove(s_dir_queue, proc);
-            }
-
-            proc->dirname = xstrdup(line + strlen("NEW_PROBLEM_DETECTED: "));
-            log_notice("abrt-server(%d): handling new problem: %s", proc->pid, proc->dirname);
-            queue_post_craete_process(proc);
+            code = abrt_request_finish(&client->req);
+            break;
         }
-        else
-            log_warning("abrt-server(%d): not recognized message: '%s'", proc->pid, line);
 
-        g_free(line);
+        code = abrt_request_feed(&client->req, buf, rd);
+        /* DELETE doesn't wait for the body */
+        if (code != 0 || client->req.type == ABRT_REQUEST_DELETE)
+            break;
+
+        /* Don't read more until the passed file is copied, a large file
+         * doesn't time the client out */
+        if (abrt_request_copying(&client->req))
+        {
+            g_source_remove(client->timeout_id);
+            client->timeout_id = 0;
+            client->copy_id = g_idle_add(client_copy_cb, client);
+            client->watch_id = 0;
+            return FALSE; /* Remove this event */
+        }
     }
 
-    return TRUE; /* Keep this event */
+    client->watch_id = 0;
+    client_done(client, code);
+    return FALSE; /* Remove this event */
 }
 
-static void add_abrt_server_proc(const pid_t pid, int fdout)
+/* Callback called by glib main loop when a client connects to ABRT's socket. */
+static gboolean server_socket_cb(GIOChannel *source, GIOCondition condition, gpointer ptr_unused)
 {
-    struct abrt_server_proc *proc = xmalloc(sizeof(*proc));
-    proc->pid = pid;
-    proc->fdout = fdout;
-    proc->dirname = NULL;
-    proc->type = AS_UKNOWN;
-    proc->channel = abrt_gio_channel_unix_new(proc->fdout);
-    proc->watch_id = g_io_add_watch(proc->channel,
-                                    G_IO_IN | G_IO_HUP,
-                                    abrt_server_output_cb,
-                                    proc);
+    kill_idle_timeout();
+    load_abrt_conf();
+
+    int socket = accept(g_io_channel_unix_get_fd(source), NULL, NULL);
+    if (socket == -1)
+    {
+        perror_msg("accept");
+        goto server_socket_finitio;
+    }
 
-    GError *error = NULL;
-    g_io_channel_set_flags(proc->channel, G_IO_FLAG_NONBLOCK, &error);
-    if (error != NULL)
-        error_msg_and_die("g_io_channel_set_flags failed: '%s'", error->message);
+    log_notice("New client connected");
+    /* Kept until the request is done or post-create replies, never leak it
+     * to the children */
+    close_on_exec_on(socket);
+    ndelay_on(socket);
+
+    /* Get uid of the connected client */
+    struct ucred cr;
+    socklen_t crlen = sizeof(cr);
+    if (0 != getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &cr, &crlen))
+    {
+        perror_msg("getsockopt(SO_PEERCRED)");
+        close(socket);
+        goto server_socket_finitio;
+    }
 
-    g_io_channel_set_buffered(proc->channel, TRUE);
+    struct abrt_client *client = xzalloc(sizeof(*client));
+    client->fd = socket;
+    abrt_request_init(&client->req, cr.uid, cr.pid);
+    /* The socket can be handed over to post-create, don't close it on unref */
+    client->channel = g_io_channel_unix_new(socket);
+    client->watch_id = g_io_add_watch(client->channel, G_IO_IN | G_IO_HUP | G_IO_ERR, client_io_cb, client);
+    client->timeout_id = g_timeout_add_seconds(ABRT_REQUEST_TIMEOUT, client_timeout_cb, client);
+    s_clients = g_list_prepend(s_clients, client);
 
-    s_processes = g_list_append(s_processes, proc);
-    if (g_list_length(s_processes) >= MAX_CLIENT_COUNT)
+    if (busy_client_slots() >= MAX_CLIENT_COUNT)
     {
         error_msg("Too many clients, refusing connections to '%s'", SOCKET_FILE);
         /* To avoid infinite loop caused by the descriptor in "ready" state,
@@ -321,115 +1259,224 @@ static void add_abrt_server_proc(const pid_t pid, int fdout)
         g_source_remove(channel_id_socket);
         channel_id_socket = 0;
     }
-}
-
-static void start_idle_timeout(void)
-{
-    if (s_timeout == 0 || child_count > 0)
-        return;
 
-    s_timeout_src = g_timeout_add_seconds(s_timeout, (GSourceFunc)g_main_loop_quit, s_main_loop);
+server_socket_finitio:
+    start_idle_timeout();
+    return TRUE;
 }
 
-static void kill_idle_timeout(void)
+/* Processes one spooled request, the owner of the file is the client */
+static void process_spooled_request(const char *spool_dir, const char *name)
 {
-    if (s_timeout == 0)
-        return;
+    char *path = concat_path_file(spool_dir, name);
+    struct abrt_request req;
+    bool req_initialized = false;
 
-    if (s_timeout_src != 0)
-        g_source_remove(s_timeout_src);
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        perror_msg("Can't open spooled request '%s'", path);
+        unlink(path);
+        goto ret;
+    }
 
-    s_timeout_src = 0;
-}
+    /* Never process the same request twice */
+    if (unlink(path) != 0)
+    {
+        perror_msg("Can't remove spooled request '%s'", path);
+        goto ret;
+    }
 
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0)
+    {
+        perror_msg("Can't stat spooled request '%s'", path);
+        goto ret;
+    }
 
-static gboolean server_socket_cb(GIOChannel *source, GIOCondition condition, gpointer ptr_unused);
+    /* A hard link would pass a file of another user off as his request */
+    if (!S_ISREG(stat_buf.st_mode) || stat_buf.st_nlink != 0)
+    {
+        error_msg("Spooled request '%s' is not a regular file with single link", path);
+        goto ret;
+    }
 
-static void remove_abrt_server_proc(pid_t pid, int status)
-{
-    GList *item = g_list_find_custom(s_processes, &pid, (GCompareFunc)abrt_server_compare_pid);
-    if (item == NULL)
-        return;
+    if (stat_buf.st_size > ABRT_REQUEST_MAX_SIZE)
+    {
+        error_msg("Spooled request '%s' is too long", path);
+        goto ret;
+    }
 
-    struct abrt_server_proc *proc = (struct abrt_server_proc *)item->data;
-    item->data = NULL;
-    s_processes = g_list_delete_link(s_processes, item);
+    log_notice("Processing spooled request '%s' of uid %ld", name, (long)stat_buf.st_uid);
+    abrt_request_init(&req, stat_buf.st_uid, /*unknown pid*/0);
+    req_initialized = true;
 
-    if (proc->type == AS_POST_CREATE)
-        notify_next_post_create_process(proc);
-    else
-    {   /* Make sure out-of-order exited abrt-server post-create processes do
-         * not stay in the post-create queue.
-         */
-        s_dir_queue = g_list_remove(s_dir_queue, proc);
+    int code = 0;
+    char buf[8 * 1024];
+    ssize_t rd = 0;
+    while (code == 0 && (rd = safe_read(fd, buf, sizeof(buf))) > 0)
+        code = abrt_request_feed(&req, buf, rd);
+
+    if (rd < 0)
+    {
+        perror_msg("Can't read spooled request '%s'", path);
+        goto ret;
     }
 
-    dispose_abrt_server(proc);
-    free(proc);
+    if (code == 0)
+        code = abrt_request_finish(&req);
 
-    if (g_list_length(s_processes) < MAX_CLIENT_COUNT && !channel_id_socket)
+    if (code != 0)
     {
-        log_info("Accepting connections on '%s'", SOCKET_FILE);
-        channel_id_socket = add_watch_or_die(channel_socket, G_IO_IN | G_IO_PRI | G_IO_HUP, server_socket_cb);
+        error_msg("Spooled request '%s' is invalid (%d)", path, code);
+        goto ret;
     }
+
+    int reply_fd = -1;
+    handle_request(&req, &reply_fd);
+
+ ret:
+    if (req_initialized)
+        abrt_request_destroy(&req);
+    if (fd >= 0)
+        close(fd);
+    free(path);
 }
 
-/* Callback called by glib main loop when a client connects to ABRT's socket. */
-static gboolean server_socket_cb(GIOChannel *source, GIOCondition condition, gpointer ptr_unused)
+struct spool_usage
 {
-    kill_idle_timeout();
-    load_abrt_conf();
+    unsigned requests;
+    unsigned long long bytes;
+};
 
-    int socket = accept(g_io_channel_unix_get_fd(source), NULL, NULL);
-    if (socket == -1)
+/* Removes the files of every user over SPOOL_MAX_REQUESTS_PER_UID and
+ * SPOOL_MAX_BYTES_PER_UID, the requests being written count too. The removed
+ * entries are freed and set to NULL.
+ */
+static void enforce_spool_quota(const char *spool_dir, struct dirent **entries, int count)
+{
+    /* uid -> struct spool_usage */
+    GHashTable *usage = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+    int i;
+    for (i = 0; i < count; ++i)
     {
-        perror_msg("accept");
-        goto server_socket_finitio;
-    }
+        const char *name = entries[i]->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
 
-    log_notice("New client connected");
-    fflush(NULL); /* paranoia */
+        char *path = concat_path_file(spool_dir, name);
+        struct stat stat_buf;
+        /* root can fill the file system anyway */
+        if (lstat(path, &stat_buf) != 0 || stat_buf.st_uid == 0)
+        {
+            free(path);
+            continue;
+        }
 
-    int pipefd[2];
-    xpipe(pipefd);
+        struct spool_usage *user = g_hash_table_lookup(usage, GINT_TO_POINTER(stat_buf.st_uid));
+        if (user == NULL)
+        {
+            user = xzalloc(sizeof(*user));
+            g_hash_table_insert(usage, GINT_TO_POINTER(stat_buf.st_uid), user);
+        }
 
-    pid_t pid = fork();
-    if (pid < 0)
-    {
-        perror_msg("fork");
-        close(socket);
-        close(pipefd[0]);
-        close(pipefd[1]);
-        goto server_socket_finitio;
+        user->requests += 1;
+        user->bytes += stat_buf.st_size;
+        if (user->requests > SPOOL_MAX_REQUESTS_PER_UID || user->bytes > SPOOL_MAX_BYTES_PER_UID)
+        {
+            error_msg("Removing spool file '%s', uid %ld spooled too much",
+                      path, (long)stat_buf.st_uid);
+            unlink(path);
+            /* The removed file doesn't use the quota */
+            user->requests -= 1;
+            user->bytes -= stat_buf.st_size;
+
+            free(entries[i]);
+            entries[i] = NULL;
+        }
+        free(path);
     }
-    if (pid == 0) /* child */
+
+    g_hash_table_destroy(usage);
+}
+
+/* Processes at most SPOOL_DRAIN_BATCH spooled requests in the order of
+ * submission. The clients connected to abrt.socket go first.
+ */
+static gboolean drain_spool(gpointer unused)
+{
+    const char *spool_dir = spool_dir_name();
+    struct dirent **entries = NULL;
+    const int count = scandir(spool_dir, &entries, NULL, alphasort);
+    if (count < 0)
     {
-        xdup2(socket, STDIN_FILENO);
-        xdup2(socket, STDOUT_FILENO);
-        close(socket);
+        perror_msg("Can't list spool directory '%s'", spool_dir);
+        s_spool_drain_timeout = 0;
+        return FALSE;
+    }
 
-        close(pipefd[0]);
-        xmove_fd(pipefd[1], STDERR_FILENO);
+    /* Even if abrtd is too busy to process the requests */
+    enforce_spool_quota(spool_dir, entries, count);
 
-        char *argv[3];  /* abrt-server [-s] NULL */
-        char **pp = argv;
-        *pp++ = (char*)"abrt-server";
-        if (logmode & LOGMODE_JOURNAL)
-            *pp++ = (char*)"-s";
-        *pp = NULL;
+    load_abrt_conf();
 
-        execvp(argv[0], argv);
-        perror_msg_and_die("Can't execute '%s'", argv[0]);
+    const time_t now = time(NULL);
+    unsigned processed = 0;
+    bool pending = false;
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+        if (entries[i] == NULL)
+            continue;
+
+        const char *name = entries[i]->d_name;
+        if (name[0] == '.')
+        {
+            char *tmp_path = concat_path_file(spool_dir, name);
+            struct stat stat_buf;
+            if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0
+                && lstat(tmp_path, &stat_buf) == 0
+                && now - stat_buf.st_mtime > SPOOL_STALE_TIMEOUT)
+            {
+                log_notice("Removing stale spool file '%s'", tmp_path);
+                unlink(tmp_path);
+            }
+            free(tmp_path);
+        }
+        else if (processed < SPOOL_DRAIN_BATCH && busy_client_slots() < MAX_CLIENT_COUNT)
+        {
+            process_spooled_request(spool_dir, name);
+            ++processed;
+        }
+        else
+            pending = true;
+
+        free(entries[i]);
     }
+    free(entries);
 
-    /* parent */
-    close(socket);
-    close(pipefd[1]);
-    add_abrt_server_proc(pid, pipefd[0]);
+    if (pending)
+        return TRUE; /* Keep draining */
 
-server_socket_finitio:
+    s_spool_drain_timeout = 0;
     start_idle_timeout();
-    return TRUE;
+    return FALSE;
+}
+
+static void schedule_spool_drain(void)
+{
+    if (s_spool_drain_timeout == 0)
+        s_spool_drain_timeout = g_timeout_add_seconds(1, drain_spool, NULL);
+}
+
+/* A hidden file is a request being written, it is checked against the quota */
+static void handle_spool_inotify_cb(struct abrt_inotify_watch *watch, struct inotify_event *event, gpointer ptr_unused)
+{
+    if (event->len == 0)
+        return;
+
+    kill_idle_timeout();
+    schedule_spool_drain();
 }
 
 /* Signal pipe handler */
@@ -460,7 +1507,7 @@ static gboolean handle_signal_cb(GIOChannel *gio, GIOCondition condition, gpoint
                     continue;
                 }
 
-                remove_abrt_server_proc(cpid, status);
+                post_create_worker_exited(cpid, status);
             }
         }
     }
@@ -477,6 +1524,8 @@ static void sanitize_dump_dir_rights(void)
     ensure_writable_dir_group(g_settings_dump_location, DEFAULT_DUMP_LOCATION_MODE, "root", "abrt");
     /* temp dir */
     ensure_writable_dir(VAR_RUN"/abrt", 0755, "root");
+    /* everybody can leave a request there, nobody can see the others' */
+    ensure_writable_dir(spool_dir_name(), SPOOL_DIR_MODE, "root");
 }
 
 /* Inotify handler */
@@ -493,6 +1542,34 @@ static void handle_inotify_cb(struct abrt_inotify_watch *watch, struct inotify_e
 
         sanitize_dump_dir_rights();
         abrt_inotify_watch_reset(watch, g_settings_dump_location, IN_DUMP_LOCATION_FLAGS);
+
+        dir_size_index_free(s_dir_sizes);
+        s_dir_sizes = dir_size_index_new(g_settings_dump_location);
+        dir_size_index_sync(s_dir_sizes);
+        s_dir_sizes_synced = time(NULL);
+
+        post_create_journal_close(s_journal);
+        s_journal = post_create_journal_open(g_settings_dump_location);
+    }
+    else if (event->len != 0 && event->name[0] != '.')
+    {
+        /* A problem directory appeared or disappeared. Newly created
+         * directories are walked again once they are queued. */
+        if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            dir_size_index_remove(s_dir_sizes, event->name);
+
+            /* Nothing to process anymore */
+            struct post_create_job *job = g_hash_table_lookup(s_post_create_jobs, event->name);
+            if (job != NULL && job->pid == 0)
+            {
+                log_notice("Problem directory '%s' disappeared from the post-create queue", event->name);
+                reply_to_client(&job->reply_fd, 413);
+                remove_post_create_job(job);
+            }
+        }
+        else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+            dir_size_index_update(s_dir_sizes, event->name);
     }
 
     start_idle_timeout();
@@ -527,11 +1604,20 @@ static void dumpsocket_init(void)
 /* Releases all resources used by dumpsocket. */
 static void dumpsocket_shutdown(void)
 {
+    /* Drop the clients which haven't sent their requests yet */
+    while (s_clients != NULL)
+        client_free((struct abrt_client *)s_clients->data);
+
+    /* The running workers finish their requests on their own */
+    while (s_request_workers != NULL)
+        request_worker_free((struct request_worker *)s_request_workers->data);
+
     /* Set everything to pre-initialization state. */
     if (channel_socket)
     {
         /* Undo add_watch_or_die */
-        g_source_remove(channel_id_socket);
+        if (channel_id_socket > 0)
+            g_source_remove(channel_id_socket);
         /* Undo g_io_channel_unix_new */
         g_io_channel_unref(channel_socket);
         channel_socket = NULL;
@@ -627,8 +1713,20 @@ static void start_logging(void)
  *
  * Relying on content of dump directory has one problem. If a hook provides
  * FILENAME_COUNT abrtd will consider the dump directory as processed.
+ *
+ * The directories pending in the post-create journal are queued again instead.
+ * Only the directories without both items are opened.
  */
-static void mark_unprocessed_dump_dirs_not_reportable(const char *path)
+static bool dump_dir_has_item(DIR *dp, const char *dirname, const char *item)
+{
+    struct stat stat_buf;
+    char *item_path = concat_path_file(dirname, item);
+    const bool exists = fstatat(dirfd(dp), item_path, &stat_buf, AT_SYMLINK_NOFOLLOW) == 0;
+    free(item_path);
+    return exists;
+}
+
+static void mark_unprocessed_dump_dirs_not_reportable(const char *path, post_create_journal_t *journal)
 {
     log_notice("Searching for unprocessed dump directories");
 
@@ -642,8 +1740,24 @@ static void mark_unprocessed_dump_dirs_not_reportable(const char *path)
     struct dirent *dent;
     while ((dent = readdir(dp)) != NULL)
     {
-        if (dot_or_dotdot(dent->d_name))
-            continue; /* skip "." and ".." */
+        /* abrtd was killed while a client was streaming the problem data */
+        if (prefixcmp(dent->d_name, ABRT_INCOMING_DIR_PREFIX) == 0)
+        {
+            char *full_name = concat_path_file(path, dent->d_name);
+            log_warning("Removing incomplete problem directory '%s'", full_name);
+            struct dump_dir *dd = dd_opendir(full_name, /*flags*/0);
+            if (dd)
+                dd_delete(dd);
+            free(full_name);
+            continue;
+        }
+
+        /* skip ".", ".." and the hidden files of the dump location */
+        if (dent->d_name[0] == '.')
+            continue;
+
+        if (journal != NULL && post_create_journal_is_pending(journal, dent->d_name))
+            continue;
 
         char *full_name = concat_path_file(path, dent->d_name);
 
@@ -658,6 +1772,10 @@ static void mark_unprocessed_dump_dirs_not_reportable(const char *path)
             /* This is expected. The dump location contains some aux files */
             goto next_dd;
 
+        if (dump_dir_has_item(dp, dent->d_name, FILENAME_COUNT)
+            || dump_dir_has_item(dp, dent->d_name, FILENAME_NOT_REPORTABLE))
+            goto next_dd;
+
         struct dump_dir *dd = dd_opendir(full_name, /*flags*/0);
         if (dd)
         {
@@ -775,6 +1893,7 @@ int main(int argc, char** argv)
     guint channel_id_signal_event = 0;
     bool pidfile_created = false;
     struct abrt_inotify_watch *aiw = NULL;
+    struct abrt_inotify_watch *spool_aiw = NULL;
     int ret = 1;
 
     /* Initialization */
@@ -787,7 +1906,8 @@ int main(int argc, char** argv)
      * mark_unprocessed_dump_dirs_not_reportable() is slightly unpredictable.
      */
     sanitize_dump_dir_rights();
-    mark_unprocessed_dump_dirs_not_reportable(g_settings_dump_location);
+    s_journal = post_create_journal_open(g_settings_dump_location);
+    mark_unprocessed_dump_dirs_not_reportable(g_settings_dump_location, s_journal);
 
     /* Daemonize unless -d */
     if (!(opts & OPT_d))
@@ -834,6 +1954,11 @@ int main(int argc, char** argv)
     aiw = abrt_inotify_watch_init(g_settings_dump_location,
             IN_DUMP_LOCATION_FLAGS, handle_inotify_cb, /*user data*/NULL);
 
+    /* The clients rename their complete requests into the spool, the written
+     * files are checked against the quota */
+    spool_aiw = abrt_inotify_watch_init(spool_dir_name(),
+            IN_MOVED_TO | IN_CLOSE_WRITE, handle_spool_inotify_cb, /*user data*/NULL);
+
     /* Add an event source which waits for INT/TERM signal */
     log_notice("Adding signal pipe watch to glib main loop");
     channel_signal = abrt_gio_channel_unix_new(s_signal_pipe[0]);
@@ -849,6 +1974,13 @@ int main(int argc, char** argv)
         goto init_error;
     pidfile_created = true;
 
+    s_post_create_jobs = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               NULL, (GDestroyNotify)post_create_job_free);
+    s_post_create_keys = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               free, (GDestroyNotify)g_queue_free);
+    s_post_create_workers = g_hash_table_new(g_direct_hash, g_direct_equal);
+    s_post_create_stats = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+
     /* Open socket to receive new problem data (from python etc). */
     dumpsocket_init();
 
@@ -864,6 +1996,19 @@ int main(int argc, char** argv)
     /* Only now we want signal pipe to work */
     s_signal_pipe_write = s_signal_pipe[1];
 
+    /* Walks only the problem directories changed since the last run */
+    log_notice("Synchronizing size index of '%s'", g_settings_dump_location);
+    s_dir_sizes = dir_size_index_new(g_settings_dump_location);
+    dir_size_index_sync(s_dir_sizes);
+    dir_size_index_save(s_dir_sizes);
+    s_dir_sizes_synced = time(NULL);
+
+    requeue_journaled_dump_dirs();
+    publish_load_status(NULL);
+
+    /* The requests spooled while abrtd was not running */
+    schedule_spool_drain();
+
     /* Own a name on D-Bus */
     name_id = g_bus_own_name(G_BUS_TYPE_SYSTEM,
                              ABRTD_DBUS_NAME,
@@ -909,6 +2054,34 @@ int main(int argc, char** argv)
         g_io_channel_unref(channel_signal);
 
     abrt_inotify_watch_destroy(aiw);
+    abrt_inotify_watch_destroy(spool_aiw);
+    if (s_spool_drain_timeout != 0)
+        g_source_remove(s_spool_drain_timeout);
+
+    if (s_dir_sizes)
+    {
+        dir_size_index_save(s_dir_sizes);
+        dir_size_index_free(s_dir_sizes);
+    }
+
+    post_create_journal_close(s_journal);
+
+    if (s_post_create_jobs)
+    {
+        /* Running post-create processes finish on their own */
+        g_queue_clear(&s_post_create_ready);
+        g_hash_table_destroy(s_post_create_workers);
+        g_hash_table_destroy(s_post_create_keys);
+        g_hash_table_destroy(s_post_create_jobs);
+
+        if (s_post_create_stats_timeout != 0)
+            g_source_remove(s_post_create_stats_timeout);
+        g_hash_table_destroy(s_post_create_stats);
+
+        if (s_load_status_timeout != 0)
+            g_source_remove(s_load_status_timeout);
+        load_status_remove();
+    }
 
     if (s_main_loop)
         g_main_loop_unref(s_main_loop);
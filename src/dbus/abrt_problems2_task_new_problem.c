@@ -237,9 +237,10 @@ static int abrt_p2_task_new_problem_notify_directory_task(AbrtP2TaskNewProblem *
 
         code = ABRT_P2_TASK_NEW_PROBLEM_DROPPED;
     }
-    else if (r == 200)
+    else if (r == 200 || r == 202)
     {
         /* 200 - the problem was accepted */
+        /* 202 - the daemon was busy, it processes the spooled notification later */
         *new_path = xstrdup(abrt_p2_object_path(task->pv->p2tnp_obj));
 
         code = ABRT_P2_TASK_NEW_PROBLEM_ACCEPTED;
@@ -30,6 +30,13 @@ typedef char *security_context_t;
 #include <sys/resource.h>
 
 #include <sys/types.h>
+#include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+#include <syslog.h>
+#include <elf.h>
+#include <systemd/sd-journal.h>
 
 /* capabilities */
 #include <sys/capability.h>
@@ -42,8 +49,15 @@ typedef char *security_context_t;
 
 #define KERNEL_PIPE_BUFFER_SIZE 65536
 
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
 static int g_user_core_flags;
 static int g_need_nonrelative;
+static bool g_sparse_core;
+static bool g_core_write_behind;
+static unsigned long long g_core_write_bandwidth; /* bytes per second */
 
 /* I want to use -Werror, but gcc-4.4 throws a curveball:
  * "warning: ignoring return value of 'ftruncate', declared with attribute warn_unused_result"
@@ -266,8 +280,9 @@ static int open_user_core(uid_t uid, uid_t fsuid, gid_t fsgid, pid_t pid, char *
     if (/* SELinux is disabled  */ newcon == NULL
      || /* or the call succeeds */ setfscreatecon_raw(newcon) >= 0)
     {
-        /* Do not O_TRUNC: if later checks fail, we do not want to have file already modified here */
-        user_core_fd = openat(dirfd(proc_cwd), core_basename, O_WRONLY | O_CREAT | O_NOFOLLOW | g_user_core_flags, 0600); /* kernel makes 0600 too */
+        /* Do not O_TRUNC: if later checks fail, we do not want to have file already modified here.
+         * The core file compressor must not inherit the fd. */
+        user_core_fd = openat(dirfd(proc_cwd), core_basename, O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC | g_user_core_flags, 0600); /* kernel makes 0600 too */
 
         /* Do the error check here and print the error message in order to
          * avoid interference in 'errno' usage caused by SELinux functions */
@@ -349,13 +364,637 @@ static ssize_t splice_entire_per_partes(int in_fd, int out_fd, size_t size_limit
     return bytes;
 }
 
+/* Core files of processes with huge address spaces consist mostly of zeros
+ * because kernel writes zero pages in place of unpopulated memory. It is far
+ * cheaper to check the stream in page-sized blocks and seek over all-zero
+ * blocks than to write them, and the resulting files are sparse.
+ *
+ * The data must be read to user space for that, so splice() is used instead
+ * if SparseCore is disabled.
+ *
+ * CoreWriteBehind: a core of tens of GiB would push the hot data of the other
+ * processes out of page cache and the final fsync() would stall on gigabytes of
+ * dirty pages. The written data is sent to disk in chunks instead; the chunk
+ * before the last one is waited for and dropped from page cache, so at most
+ * two chunks of a core file are dirty at any moment.
+ */
+#define CORE_BLOCK_SIZE 4096
+#define CORE_BUFFER_SIZE (256 * CORE_BLOCK_SIZE)
+#define CORE_WRITE_BEHIND_CHUNK (8 * 1024 * 1024)
+
+struct core_file
+{
+    int fd;
+    size_t limit;
+    size_t size;        /* bytes of the stream stored in the file */
+    off_t hole;         /* trailing zero bytes not seeked over yet */
+    off_t offset;       /* file offset of the write head */
+    off_t written_out;  /* offset up to which the writeback was started */
+    size_t written;     /* bytes actually written */
+    bool sparse;
+    bool write_behind;
+    bool failed;
+};
+
+static void core_file_init(struct core_file *cf, int fd, size_t limit)
+{
+    cf->fd = fd;
+    cf->limit = limit;
+    cf->size = 0;
+    cf->hole = 0;
+    cf->offset = 0;
+    cf->written_out = 0;
+    cf->written = 0;
+    /* The pipe to the compressor cannot have holes */
+    const bool seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+    cf->sparse = g_sparse_core && seekable;
+    cf->write_behind = g_core_write_behind && seekable;
+    cf->failed = false;
+}
+
+static bool is_zero_block(const char *buf, size_t size)
+{
+    return buf[0] == 0 && memcmp(buf, buf + 1, size - 1) == 0;
+}
+
+static void core_file_write_behind(struct core_file *cf)
+{
+    while (cf->offset - cf->written_out >= CORE_WRITE_BEHIND_CHUNK)
+    {
+        const off_t start = cf->written_out;
+        /* Errors are reported by fsync() at the end */
+        sync_file_range(cf->fd, start, CORE_WRITE_BEHIND_CHUNK, SYNC_FILE_RANGE_WRITE);
+        if (start >= CORE_WRITE_BEHIND_CHUNK)
+        {
+            sync_file_range(cf->fd, start - CORE_WRITE_BEHIND_CHUNK, CORE_WRITE_BEHIND_CHUNK,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(cf->fd, start - CORE_WRITE_BEHIND_CHUNK, CORE_WRITE_BEHIND_CHUNK,
+                    POSIX_FADV_DONTNEED);
+        }
+        cf->written_out += CORE_WRITE_BEHIND_CHUNK;
+    }
+}
+
+static void core_file_flush(struct core_file *cf, const char *data, size_t size)
+{
+    if (size == 0)
+        return;
+
+    if (cf->hole != 0)
+    {
+        if (lseek(cf->fd, cf->hole, SEEK_CUR) < 0)
+        {
+            perror_msg("Failed to seek in core file");
+            cf->failed = true;
+            return;
+        }
+        cf->offset += cf->hole;
+        cf->hole = 0;
+    }
+
+    if (full_write(cf->fd, data, size) != (ssize_t)size)
+    {
+        perror_msg("Failed to write core file");
+        cf->failed = true;
+        return;
+    }
+    cf->offset += size;
+    cf->written += size;
+
+    if (cf->write_behind)
+        core_file_write_behind(cf);
+}
+
+static void core_file_write(struct core_file *cf, const char *buf, size_t size)
+{
+    if (cf->failed || cf->size >= cf->limit)
+        return;
+
+    if (size > cf->limit - cf->size)
+        size = cf->limit - cf->size;
+
+    size_t data_start = 0;
+    size_t pos = 0;
+    while (pos < size && cf->sparse)
+    {
+        const size_t block = (size - pos < CORE_BLOCK_SIZE) ? size - pos : CORE_BLOCK_SIZE;
+        if (is_zero_block(buf + pos, block))
+        {
+            core_file_flush(cf, buf + data_start, pos - data_start);
+            cf->hole += block;
+            data_start = pos + block;
+        }
+        pos += block;
+    }
+    core_file_flush(cf, buf + data_start, size - data_start);
+
+    cf->size += size;
+}
+
+static int core_file_finish(struct core_file *cf)
+{
+    /* Seeking past the end does not change the file size. */
+    if (!cf->failed && cf->hole != 0 && ftruncate(cf->fd, cf->size) != 0)
+    {
+        perror_msg("Failed to extend core file to %zu bytes", cf->size);
+        cf->failed = true;
+    }
+
+    /* Drop the rest from page cache, the caller's fsync() has nothing to do */
+    if (!cf->failed && cf->write_behind)
+    {
+        if (fdatasync(cf->fd) != 0)
+        {
+            perror_msg("Failed to write core file");
+            cf->failed = true;
+        }
+        else
+            posix_fadvise(cf->fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    return cf->failed ? -1 : 0;
+}
+
+/* CoreFilter = minimal
+ *
+ * Kernel writes one PT_LOAD segment per memory mapping. Contents of read-only
+ * file-backed mappings without private modifications are identical to the
+ * mapped files which gdb and eu-unstrip read from disk anyway. The filter
+ * drops data of such segments from the ABRT core and moves the following
+ * segments to lower offsets. The first page of a mapping of the beginning of a
+ * file is kept because it holds ELF headers with the build-id. Kernel does
+ * the same for the ELF headers bit of coredump_filter.
+ *
+ * Cores the filter does not understand are passed through untouched.
+ */
+#define CORE_FILTER_MAX_HEAD_SIZE (16 * 1024 * 1024)
+
+struct recoverable_mapping
+{
+    uint64_t start;
+    bool file_start;
+};
+
+struct core_segment
+{
+    uint64_t offset;
+    uint64_t filesz;
+    uint64_t keep;          /* leading bytes kept in the filtered core */
+    uint64_t new_offset;
+};
+
+struct core_filter
+{
+    struct recoverable_mapping *mappings;
+    unsigned mapping_count;
+    char *head;             /* ELF header and program headers */
+    size_t head_size;
+    size_t head_len;        /* 0 until the ELF header is read */
+    bool passthrough;
+    struct core_segment *segments;
+    unsigned segment_count;
+    unsigned current;       /* the first segment not consumed yet */
+    uint64_t data_start;
+    uint64_t pos;           /* in the original core */
+    uint64_t dropped;
+};
+
+static int cmp_recoverable_mapping(const void *a, const void *b)
+{
+    const uint64_t l = ((const struct recoverable_mapping *)a)->start;
+    const uint64_t r = ((const struct recoverable_mapping *)b)->start;
+    return l < r ? -1 : l > r;
+}
+
+/* The mapped file must be still on disk, otherwise its contents must be in
+ * the core.
+ */
+static bool mapped_file_is_unchanged(pid_t pid, const char *path, unsigned dev_major, unsigned dev_minor, unsigned long inode)
+{
+    if (path[0] != '/' || suffixcmp(path, " (deleted)") == 0)
+        return false;
+
+    char *root_path = xasprintf("/proc/%lu/root%s", (long)pid, path);
+    struct stat sb;
+    const int r = stat(root_path, &sb);
+    free(root_path);
+
+    return r == 0 && sb.st_ino == inode
+        && major(sb.st_dev) == dev_major && minor(sb.st_dev) == dev_minor;
+}
+
+/* Finds mappings that can be recovered from mapped files. Uses smaps instead
+ * of FILENAME_MAPS because only smaps tells whether a private mapping has
+ * been modified (e.g. relocated RELRO data).
+ */
+static void core_filter_init(struct core_filter *filter, pid_t pid)
+{
+    memset(filter, 0, sizeof(*filter));
+
+    char path[sizeof("/proc/%lu/smaps") + sizeof(long)*3];
+    sprintf(path, "/proc/%lu/smaps", (long)pid);
+    FILE *smaps = fopen(path, "r");
+    if (smaps == NULL)
+    {
+        perror_msg("Can't open '%s', CoreFilter is disabled", path);
+        filter->passthrough = true;
+        return;
+    }
+
+    unsigned allocated = 0;
+    bool candidate = false;
+    uint64_t start = 0;
+    bool file_start = false;
+    char *line;
+    while ((line = xmalloc_fgetline(smaps)) != NULL)
+    {
+        unsigned long long begin, end, pgoff;
+        unsigned dev_major, dev_minor;
+        unsigned long inode;
+        char perms[5];
+        int path_ofs = 0;
+        unsigned long long anonymous;
+
+        if (sscanf(line, "%llx-%llx %4s %llx %x:%x %lu %n",
+                   &begin, &end, perms, &pgoff, &dev_major, &dev_minor, &inode, &path_ofs) >= 7
+            && path_ofs != 0)
+        {
+            start = begin;
+            file_start = (pgoff == 0);
+            candidate = inode != 0 && perms[1] != 'w'
+                && mapped_file_is_unchanged(pid, line + path_ofs, dev_major, dev_minor, inode);
+        }
+        else if (candidate && sscanf(line, "Anonymous: %llu kB", &anonymous) == 1)
+        {
+            if (anonymous == 0)
+            {
+                if (filter->mapping_count == allocated)
+                {
+                    allocated = allocated ? allocated * 2 : 64;
+                    filter->mappings = xrealloc(filter->mappings, allocated * sizeof(filter->mappings[0]));
+                }
+                filter->mappings[filter->mapping_count].start = start;
+                filter->mappings[filter->mapping_count].file_start = file_start;
+                ++filter->mapping_count;
+            }
+            candidate = false;
+        }
+        free(line);
+    }
+    fclose(smaps);
+
+    qsort(filter->mappings, filter->mapping_count, sizeof(filter->mappings[0]), cmp_recoverable_mapping);
+    log_debug("CoreFilter: %u mappings can be recovered from files", filter->mapping_count);
+}
+
+static void core_filter_free(struct core_filter *filter)
+{
+    free(filter->mappings);
+    free(filter->head);
+    free(filter->segments);
+}
+
+/* Returns the number of bytes of the headers, 0 for unsupported cores. */
+static size_t core_filter_head_len(const char *head)
+{
+    const Elf64_Ehdr *ehdr64 = (const Elf64_Ehdr *)head;
+    const Elf32_Ehdr *ehdr32 = (const Elf32_Ehdr *)head;
+
+    if (memcmp(head, ELFMAG, SELFMAG) != 0)
+        return 0;
+
+    uint64_t phoff, phentsize, phnum, shoff;
+    if (head[EI_CLASS] == ELFCLASS64 && ehdr64->e_type == ET_CORE && ehdr64->e_phentsize == sizeof(Elf64_Phdr))
+    {
+        phoff = ehdr64->e_phoff;
+        phentsize = ehdr64->e_phentsize;
+        phnum = ehdr64->e_phnum;
+        shoff = ehdr64->e_shoff;
+    }
+    else if (head[EI_CLASS] == ELFCLASS32 && ehdr32->e_type == ET_CORE && ehdr32->e_phentsize == sizeof(Elf32_Phdr))
+    {
+        phoff = ehdr32->e_phoff;
+        phentsize = ehdr32->e_phentsize;
+        phnum = ehdr32->e_phnum;
+        shoff = ehdr32->e_shoff;
+    }
+    else
+        return 0;
+
+    /* Extended numbering stores the number of segments in a section header
+     * at the end of the core. */
+    if (phnum == PN_XNUM || shoff != 0 || phoff < sizeof(Elf32_Ehdr))
+        return 0;
+
+    const uint64_t len = phoff + phentsize * phnum;
+    return len <= CORE_FILTER_MAX_HEAD_SIZE ? len : 0;
+}
+
+static struct recoverable_mapping *core_filter_find_mapping(struct core_filter *filter, uint64_t vaddr)
+{
+    struct recoverable_mapping key = { .start = vaddr };
+    return bsearch(&key, filter->mappings, filter->mapping_count, sizeof(key), cmp_recoverable_mapping);
+}
+
+/* Decides what to keep and rewrites program headers in the buffered head. */
+static bool core_filter_plan(struct core_filter *filter)
+{
+    const bool is64 = (filter->head[EI_CLASS] == ELFCLASS64);
+    const uint64_t phoff = is64 ? ((Elf64_Ehdr *)filter->head)->e_phoff : ((Elf32_Ehdr *)filter->head)->e_phoff;
+    const unsigned phnum = is64 ? ((Elf64_Ehdr *)filter->head)->e_phnum : ((Elf32_Ehdr *)filter->head)->e_phnum;
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+    filter->segments = xzalloc(phnum * sizeof(filter->segments[0]));
+    filter->data_start = UINT64_MAX;
+
+    unsigned i;
+    for (i = 0; i < phnum; ++i)
+    {
+        uint32_t type;
+        uint64_t offset, vaddr, filesz;
+        if (is64)
+        {
+            const Elf64_Phdr *phdr = (Elf64_Phdr *)(filter->head + phoff) + i;
+            type = phdr->p_type, offset = phdr->p_offset, vaddr = phdr->p_vaddr, filesz = phdr->p_filesz;
+        }
+        else
+        {
+            const Elf32_Phdr *phdr = (Elf32_Phdr *)(filter->head + phoff) + i;
+            type = phdr->p_type, offset = phdr->p_offset, vaddr = phdr->p_vaddr, filesz = phdr->p_filesz;
+        }
+
+        if (filesz == 0)
+            continue;
+
+        if (type != PT_LOAD)
+        {   /* Notes must precede memory contents which we move */
+            if (filter->segment_count != 0)
+                return false;
+            continue;
+        }
+
+        struct core_segment *seg = &filter->segments[filter->segment_count];
+        seg->offset = offset;
+        seg->filesz = filesz;
+        seg->keep = filesz;
+
+        if (filter->segment_count == 0)
+        {
+            if (offset < filter->head_len || offset % page_size != 0)
+                return false;
+            filter->data_start = offset;
+            seg->new_offset = offset;
+        }
+        else
+        {
+            const struct core_segment *prev = seg - 1;
+            if (offset < prev->offset + prev->filesz || (offset - filter->data_start) % page_size != 0)
+                return false;
+            seg->new_offset = prev->new_offset + prev->keep;
+        }
+
+        const struct recoverable_mapping *m = core_filter_find_mapping(filter, vaddr);
+        if (m != NULL)
+        {
+            seg->keep = (m->file_start && filesz >= page_size) ? page_size : 0;
+            filter->dropped += filesz - seg->keep;
+        }
+
+        if (seg->keep % page_size != 0 && seg->keep != filesz)
+            return false;
+
+        ++filter->segment_count;
+    }
+
+    /* Now, when the plan is consistent, rewrite program headers */
+    unsigned s = 0;
+    for (i = 0; i < phnum && s < filter->segment_count; ++i)
+    {
+        if (is64)
+        {
+            Elf64_Phdr *phdr = (Elf64_Phdr *)(filter->head + phoff) + i;
+            if (phdr->p_type != PT_LOAD || phdr->p_filesz == 0)
+                continue;
+            phdr->p_offset = filter->segments[s].new_offset;
+            phdr->p_filesz = filter->segments[s].keep;
+        }
+        else
+        {
+            Elf32_Phdr *phdr = (Elf32_Phdr *)(filter->head + phoff) + i;
+            if (phdr->p_type != PT_LOAD || phdr->p_filesz == 0)
+                continue;
+            phdr->p_offset = filter->segments[s].new_offset;
+            phdr->p_filesz = filter->segments[s].keep;
+        }
+        ++s;
+    }
+
+    return true;
+}
+
+/* Buffers the head of the core. Returns the number of consumed bytes. */
+static size_t core_filter_read_head(struct core_filter *filter, struct core_file *cf, const char *buf, size_t size)
+{
+    size_t consumed = 0;
+    while (consumed < size)
+    {
+        const size_t needed = filter->head_len ? filter->head_len : sizeof(Elf64_Ehdr);
+        const size_t n = (needed - filter->head_size < size - consumed) ? needed - filter->head_size : size - consumed;
+        filter->head = xrealloc(filter->head, needed);
+        memcpy(filter->head + filter->head_size, buf + consumed, n);
+        filter->head_size += n;
+        consumed += n;
+
+        if (filter->head_size < needed)
+            break;
+
+        if (filter->head_len == 0)
+        {
+            filter->head_len = core_filter_head_len(filter->head);
+            if (filter->head_len > filter->head_size)
+                continue;
+        }
+
+        if (filter->head_len == 0 || !core_filter_plan(filter))
+        {
+            log_notice("CoreFilter: unsupported core layout, saving the full core");
+            filter->passthrough = true;
+        }
+
+        core_file_write(cf, filter->head, filter->head_size);
+        filter->pos = filter->head_size;
+        break;
+    }
+
+    return consumed;
+}
+
+static void core_filter_write(struct core_filter *filter, struct core_file *cf, const char *buf, size_t size)
+{
+    if (!filter->passthrough && filter->pos == 0)
+    {
+        const size_t consumed = core_filter_read_head(filter, cf, buf, size);
+        buf += consumed;
+        size -= consumed;
+    }
+
+    if (filter->passthrough)
+    {
+        core_file_write(cf, buf, size);
+        return;
+    }
+
+    while (size > 0)
+    {
+        uint64_t end;
+        bool keep;
+
+        while (filter->current < filter->segment_count
+               && filter->pos >= filter->segments[filter->current].offset + filter->segments[filter->current].filesz)
+            ++filter->current;
+
+        const struct core_segment *seg = &filter->segments[filter->current];
+        if (filter->pos < filter->data_start)
+        {   /* Notes */
+            end = filter->data_start;
+            keep = true;
+        }
+        else if (filter->current == filter->segment_count)
+        {   /* Nothing refers to the data */
+            end = UINT64_MAX;
+            keep = false;
+        }
+        else if (filter->pos < seg->offset)
+        {
+            end = seg->offset;
+            keep = false;
+        }
+        else if (filter->pos < seg->offset + seg->keep)
+        {
+            end = seg->offset + seg->keep;
+            keep = true;
+        }
+        else
+        {
+            end = seg->offset + seg->filesz;
+            keep = false;
+        }
+
+        const size_t n = (end - filter->pos < size) ? end - filter->pos : size;
+        if (keep)
+            core_file_write(cf, buf, n);
+
+        buf += n;
+        size -= n;
+        filter->pos += n;
+    }
+}
+
+/* MaxCoreWriteBandwidth: sleeps until the bytes written so far fit in the
+ * allowed bandwidth. Zero blocks seeked over are not counted.
+ */
+static void throttle_core_files(struct core_file *files, unsigned count, const struct timespec *started)
+{
+    unsigned long long written = 0;
+    unsigned i;
+    for (i = 0; i < count; ++i)
+        written += files[i].written;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const unsigned long long elapsed_ns = (now.tv_sec - started->tv_sec) * 1000000000ULL
+                                          + now.tv_nsec - started->tv_nsec;
+    const unsigned long long allowed_ns = written / g_core_write_bandwidth * 1000000000ULL
+            + (written % g_core_write_bandwidth) * 1000000000ULL / g_core_write_bandwidth;
+
+    if (allowed_ns > elapsed_ns)
+    {
+        const unsigned long long wait_ns = allowed_ns - elapsed_ns;
+        struct timespec wait = { .tv_sec = wait_ns / 1000000000ULL, .tv_nsec = wait_ns % 1000000000ULL };
+        while (nanosleep(&wait, &wait) != 0 && errno == EINTR)
+            continue;
+    }
+}
+
+/* Reads the core from STDIN and writes it to all files until all of them hit
+ * their limits or there is no more data. If filter is not NULL, it is applied
+ * to the first file.
+ */
+static void write_core_files(struct core_file *files, unsigned count, struct core_filter *filter)
+{
+    /* Let kernel write more data at once, it's fine if it doesn't work. */
+    IGNORE_RESULT(fcntl(STDIN_FILENO, F_SETPIPE_SZ, CORE_BUFFER_SIZE));
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    unsigned i;
+    char *buf = xmalloc(CORE_BUFFER_SIZE);
+    for (;;)
+    {
+        if (g_core_write_bandwidth != 0)
+            throttle_core_files(files, count, &started);
+
+        size_t need_data = 0;
+        for (i = 0; i < count; ++i)
+            if (!files[i].failed && files[i].limit - files[i].size > need_data)
+                need_data = files[i].limit - files[i].size;
+
+        if (need_data == 0)
+            break;
+
+        /* Do not consume data past the limits, the caller may pass the rest
+         * of the core on. The filter stores less data than it reads. */
+        if (filter != NULL || need_data > CORE_BUFFER_SIZE)
+            need_data = CORE_BUFFER_SIZE;
+
+        /* Reads entire blocks unless it hits EOF */
+        const ssize_t r = full_read(STDIN_FILENO, buf, need_data);
+        if (r < 0)
+        {
+            perror_msg("Failed to read core dump");
+            for (i = 0; i < count; ++i)
+                files[i].failed = true;
+            break;
+        }
+
+        if (r == 0)
+            break;
+
+        i = 0;
+        if (filter != NULL)
+            core_filter_write(filter, &files[i++], buf, r);
+
+        for (; i < count; ++i)
+            core_file_write(&files[i], buf, r);
+    }
+    free(buf);
+
+    /* The core was shorter than its headers */
+    if (filter != NULL && !filter->passthrough && filter->pos == 0)
+        core_file_write(&files[0], filter->head, filter->head_size);
+
+    for (i = 0; i < count; ++i)
+        core_file_finish(&files[i]);
+}
+
 static int create_user_core(int user_core_fd, pid_t pid, off_t ulimit_c)
 {
     int err = 1;
     if (user_core_fd >= 0)
     {
         errno = 0;
-        ssize_t core_size = splice_entire_per_partes(STDIN_FILENO, user_core_fd, ulimit_c);
+        ssize_t core_size;
+        if (g_sparse_core || g_core_write_behind || g_core_write_bandwidth != 0)
+        {
+            struct core_file cf;
+            core_file_init(&cf, user_core_fd, ulimit_c);
+            write_core_files(&cf, 1, /*filter:*/ NULL);
+            core_size = cf.failed ? -1 : (ssize_t)cf.size;
+        }
+        else
+            core_size = splice_entire_per_partes(STDIN_FILENO, user_core_fd, ulimit_c);
+
         if (core_size < 0)
             perror_msg("Failed to create user core '%s' in '%s'", core_basename, user_pwd);
 
@@ -389,6 +1028,39 @@ static bool is_path_ignored(const GList *list, const char *path)
     return false;
 }
 
+static bool is_process_traced(const char *proc_pid_status)
+{
+    const char *tracer = strstr(proc_pid_status, "\nTracerPid:");
+    return tracer && strtoul(tracer + strlen("\nTracerPid:"), NULL, 10) != 0;
+}
+
+/* Returns the first pattern matching a NAME=VALUE line of environ */
+static const char *find_ignored_environment(const GList *list, const char *environ)
+{
+    char *copy = xstrdup(environ);
+    const char *pattern = NULL;
+    char *line = copy;
+    while (pattern == NULL && line != NULL && *line != '\0')
+    {
+        char *next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+
+        const GList *li;
+        for (li = list; li != NULL; li = g_list_next(li))
+        {
+            if (fnmatch((char*)li->data, line, /*flags:*/ 0) == 0)
+            {
+                pattern = (char*)li->data;
+                break;
+            }
+        }
+        line = next;
+    }
+    free(copy);
+    return pattern;
+}
+
 static bool is_user_allowed(uid_t uid, const GList *list)
 {
     const GList *li;
@@ -670,21 +1342,192 @@ static int dump_two_core_files(int abrt_core_fd, size_t *abrt_limit, int user_co
             }
         }
 
-        /* Check EOF. */
-        if (spliced == 0 || *spliced_core_size >= spliced_core_limit)
-            break;
+        /* Check EOF. */
+        if (spliced == 0 || *spliced_core_size >= spliced_core_limit)
+            break;
+    }
+
+    int r = 0;
+    if (cp[0] < 0)
+    {
+        if (abrt_limit < user_limit)
+            r |= DUMP_ABRT_CORE_FAILED;
+        else
+            r |= DUMP_USER_CORE_FAILED;
+    }
+    else
+        pipe_close(cp);
+
+    return r;
+}
+
+/* Reflinks need both files on the same file system supporting them (btrfs,
+ * XFS with reflink=1). Cloning the empty ABRT core file to the empty CWD core
+ * file tells both without touching any data.
+ */
+static bool can_clone_core_files(int abrt_core_fd, int user_core_fd)
+{
+    if (ioctl(user_core_fd, FICLONE, abrt_core_fd) == 0)
+        return true;
+
+    log_debug("Can't clone ABRT core file: %s", strerror(errno));
+    return false;
+}
+
+/* Continues writing the core from STDIN to the file holding its first size
+ * bytes until the file reaches limit. Returns the new size of the file or -1.
+ */
+static ssize_t write_core_file_from(int fd, size_t size, size_t limit)
+{
+    if (lseek(fd, size, SEEK_SET) < 0)
+        return -1;
+
+    if (g_sparse_core || g_core_write_behind || g_core_write_bandwidth != 0)
+    {
+        struct core_file cf;
+        core_file_init(&cf, fd, limit);
+        cf.size = size;
+        cf.offset = cf.written_out = size;
+        write_core_files(&cf, 1, /*filter:*/ NULL);
+        return cf.failed ? -1 : (ssize_t)cf.size;
+    }
+
+    const ssize_t r = splice_entire_per_partes(STDIN_FILENO, fd, limit - size);
+    return r < 0 ? r : (ssize_t)(size + r);
+}
+
+/* Writes the core up to the lower limit to the ABRT core file and makes the
+ * CWD core file its reflink clone, so the data hits the disk once. The rest of
+ * the core up to the higher limit is appended to the other file, so neither
+ * file ever exceeds its limit. The caller must check can_clone_core_files().
+ */
+static int clone_two_core_files(int abrt_core_fd, size_t *abrt_limit, int user_core_fd, size_t *user_limit)
+{
+    const size_t common_limit = *abrt_limit < *user_limit ? *abrt_limit : *user_limit;
+
+    const ssize_t core_size = write_core_file_from(abrt_core_fd, 0, common_limit);
+    if (core_size < 0)
+    {
+        perror_msg("Failed to write ABRT core file");
+        *abrt_limit = *user_limit = 0;
+        return DUMP_ABRT_CORE_FAILED | DUMP_USER_CORE_FAILED;
+    }
+
+    int r = 0;
+    if (ioctl(user_core_fd, FICLONE, abrt_core_fd) != 0)
+    {
+        perror_msg("Failed to clone ABRT core file");
+        r |= DUMP_USER_CORE_FAILED;
+    }
+
+    size_t abrt_size = core_size;
+    size_t user_size = core_size;
+    /* Shorter than the lower limit means the whole core has been read */
+    if ((size_t)core_size == common_limit && *abrt_limit != *user_limit)
+    {
+        const bool abrt_longer = *abrt_limit > *user_limit;
+        if (abrt_longer || !(r & DUMP_USER_CORE_FAILED))
+        {
+            const ssize_t size = abrt_longer
+                    ? write_core_file_from(abrt_core_fd, core_size, *abrt_limit)
+                    : write_core_file_from(user_core_fd, core_size, *user_limit);
+            if (size < 0)
+            {
+                perror_msg("Failed to write %s core file", abrt_longer ? "ABRT" : "user");
+                r |= abrt_longer ? DUMP_ABRT_CORE_FAILED : DUMP_USER_CORE_FAILED;
+            }
+            else if (abrt_longer)
+                abrt_size = size;
+            else
+                user_size = size;
+        }
+    }
+
+    *abrt_limit = abrt_size;
+    *user_limit = user_size;
+
+    return r;
+}
+
+/* Starts the compressor writing its standard input to FILENAME_COREDUMP_XZ.
+ *
+ * Returns the write end of a pipe connected to the compressor, so the core
+ * can be passed on with splice() exactly as if it was a regular file, or -1
+ * on errors. The compressed file's fd is stored to compressed_fd because the
+ * caller must fsync() it once the compressor is done.
+ */
+static int open_compressed_core(struct dump_dir *dd, pid_t *compressor_pid, int *compressed_fd)
+{
+    if (access(XZ, X_OK) != 0)
+    {
+        perror_msg("Can't compress core file with '%s'", XZ);
+        return -1;
+    }
+
+    const int xz_fd = dd_open_item(dd, FILENAME_COREDUMP_XZ, O_RDWR);
+    if (xz_fd < 0)
+        return -1;
+
+    int pipefd[2];
+    if (pipe(pipefd) < 0)
+    {
+        perror_msg("Failed to create pipe for core file compressor");
+        goto open_fail;
+    }
+
+    /* Do not get killed if the compressor dies prematurely; failed writes are
+     * detected by checking return values. */
+    signal(SIGPIPE, SIG_IGN);
+
+    *compressor_pid = fork();
+    if (*compressor_pid < 0)
+    {
+        perror_msg("fork");
+        pipe_close(pipefd);
+        goto open_fail;
+    }
+
+    if (*compressor_pid == 0)
+    {
+        close(pipefd[1]);
+        /* Replaces the kernel's pipe, the compressor must not hold it. */
+        xmove_fd(pipefd[0], STDIN_FILENO);
+        xmove_fd(xz_fd, STDOUT_FILENO);
+        /* Use all CPUs and the fastest preset, the crashed process is waiting
+         * for us. */
+        execl(XZ, XZ, "-T0", "-0", "-c", (char *)NULL);
+        perror_msg_and_die("Can't execute '%s'", XZ);
     }
 
+    close(pipefd[0]);
+    *compressed_fd = xz_fd;
+    return pipefd[1];
+
+open_fail:
+    close(xz_fd);
+    dd_delete_item(dd, FILENAME_COREDUMP_XZ);
+    return -1;
+}
+
+static int close_compressed_core(int core_pipe_fd, pid_t compressor_pid, int compressed_fd)
+{
     int r = 0;
-    if (cp[0] < 0)
+
+    /* Let the compressor see EOF */
+    close(core_pipe_fd);
+
+    int status;
+    if (safe_waitpid(compressor_pid, &status, 0) < 0 || status != 0)
     {
-        if (abrt_limit < user_limit)
-            r |= DUMP_ABRT_CORE_FAILED;
-        else
-            r |= DUMP_USER_CORE_FAILED;
+        error_msg("'%s' failed to compress core file", XZ);
+        r = -1;
+    }
+
+    if (fsync(compressed_fd) != 0 || close(compressed_fd) != 0)
+    {
+        perror_msg("Failed to close compressed ABRT core file");
+        r = -1;
     }
-    else
-        pipe_close(cp);
 
     return r;
 }
@@ -826,6 +1669,458 @@ no_core_backtrace_generated_failure:
 #endif /*ENABLE_DUMP_TIME_UNWIND*/
 }
 
+#define FINGERPRINT_STACK_SIZE  8192
+#define FINGERPRINT_MAX_FRAMES  16
+
+struct code_mapping
+{
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long file_offset;
+    char *path;
+};
+
+/* Prints the address as an offset into the mapped file, so the result does
+ * not depend on where the file was loaded.
+ */
+static bool fingerprint_append_address(struct strbuf *buf, struct code_mapping *mappings,
+                                       unsigned count, unsigned long long address)
+{
+    unsigned i;
+    for (i = 0; i < count; i++)
+    {
+        if (address >= mappings[i].start && address < mappings[i].end)
+        {
+            strbuf_append_strf(buf, "%s+0x%llx\n", mappings[i].path,
+                               address - mappings[i].start + mappings[i].file_offset);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Computes a hash of the crash from what the kernel shows about the process
+ * being dumped: the instruction pointer of the crashing thread and the first
+ * code pointers found on the top of its stack. It is much cheaper than the dump
+ * time unwind, which can run only after the core has been read from stdin.
+ *
+ * Returns NULL if the kernel does not report the registers.
+ */
+static char *crash_fingerprint(pid_t pid, pid_t tid, uid_t uid, int signal_no)
+{
+    char *fingerprint = NULL;
+    struct code_mapping *mappings = NULL;
+    unsigned mapping_count = 0;
+    unsigned i;
+    FILE *fp = NULL;
+    int mem_fd = -1;
+    char *stack = NULL;
+
+    char *path = xasprintf("/proc/%lu/task/%lu/stat", (long)pid, (long)tid);
+    char *stat = xmalloc_open_read_close(path, /*maxsz:*/ NULL);
+    free(path);
+    if (!stat)
+        return NULL;
+
+    /* kstkesp and kstkeip are the 29th and 30th fields; the 2nd one (comm)
+     * may contain spaces, so count from the closing parenthesis */
+    unsigned long long sp = 0, ip = 0;
+    char *field = strrchr(stat, ')');
+    for (i = 3; field && i <= 30; i++)
+    {
+        field = strchr(field, ' ');
+        if (!field)
+            break;
+        ++field;
+        if (i == 29)
+            sp = strtoull(field, NULL, 10);
+        else if (i == 30)
+            ip = strtoull(field, NULL, 10);
+    }
+    free(stat);
+
+    if (ip == 0 || sp == 0)
+    {
+        log_notice("Kernel does not report registers of thread %lu", (long)tid);
+        return NULL;
+    }
+
+    path = xasprintf("/proc/%lu/maps", (long)pid);
+    fp = fopen(path, "r");
+    free(path);
+    if (!fp)
+        return NULL;
+
+    unsigned long long stack_end = sp;
+    char *line;
+    while ((line = xmalloc_fgetline(fp)) != NULL)
+    {
+        unsigned long long start, end, offset;
+        char perms[5];
+        int path_pos = 0;
+        if (sscanf(line, "%llx-%llx %4s %llx %*s %*s %n", &start, &end, perms, &offset, &path_pos) >= 4
+            && path_pos > 0)
+        {
+            if (sp >= start && sp < end)
+                stack_end = end;
+
+            if (perms[2] == 'x' && line[path_pos] == '/')
+            {
+                mappings = xrealloc(mappings, (mapping_count + 1) * sizeof(*mappings));
+                mappings[mapping_count].start = start;
+                mappings[mapping_count].end = end;
+                mappings[mapping_count].file_offset = offset;
+                mappings[mapping_count].path = xstrdup(line + path_pos);
+                ++mapping_count;
+            }
+        }
+        free(line);
+    }
+    fclose(fp);
+
+    struct strbuf *buf = strbuf_new();
+    strbuf_append_strf(buf, "%lu\n%d\n", (long)uid, signal_no);
+    if (!fingerprint_append_address(buf, mappings, mapping_count, ip))
+        /* A jump to nowhere; the stack tells the rest */
+        strbuf_append_str(buf, "?\n");
+
+    /* The word size of the process is the class of its executable */
+    path = xasprintf("/proc/%lu/exe", (long)pid);
+    int exe_fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    unsigned char ident[EI_NIDENT];
+    unsigned word_size = sizeof(long);
+    if (exe_fd >= 0)
+    {
+        if (full_read(exe_fd, ident, sizeof(ident)) == sizeof(ident)
+            && memcmp(ident, ELFMAG, SELFMAG) == 0)
+            word_size = ident[EI_CLASS] == ELFCLASS32 ? 4 : 8;
+        close(exe_fd);
+    }
+
+    path = xasprintf("/proc/%lu/mem", (long)pid);
+    mem_fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (mem_fd < 0)
+    {
+        perror_msg("Can't open memory of process %lu", (long)pid);
+        goto ret;
+    }
+
+    size_t stack_size = stack_end - sp < FINGERPRINT_STACK_SIZE ? stack_end - sp : FINGERPRINT_STACK_SIZE;
+    stack = xmalloc(stack_size);
+    ssize_t r = pread(mem_fd, stack, stack_size, (off_t)sp);
+    if (r < 0)
+    {
+        perror_msg("Can't read stack of process %lu", (long)pid);
+        goto ret;
+    }
+
+    unsigned frames = 0;
+    size_t pos;
+    for (pos = 0; pos + word_size <= (size_t)r && frames < FINGERPRINT_MAX_FRAMES; pos += word_size)
+    {
+        unsigned long long word;
+        if (word_size == 4)
+        {
+            uint32_t w;
+            memcpy(&w, stack + pos, sizeof(w));
+            word = w;
+        }
+        else
+            memcpy(&word, stack + pos, sizeof(word));
+
+        if (fingerprint_append_address(buf, mappings, mapping_count, word))
+            ++frames;
+    }
+
+    log_debug("Crash fingerprint of %lu:\n%s", (long)pid, buf->buf);
+
+    fingerprint = xmalloc(SHA1_RESULT_LEN*2 + 1);
+    str_to_sha1str(fingerprint, buf->buf);
+
+ ret:
+    strbuf_free(buf);
+    free(stack);
+    if (mem_fd >= 0)
+        close(mem_fd);
+    for (i = 0; i < mapping_count; i++)
+        free(mappings[i].path);
+    free(mappings);
+    return fingerprint;
+}
+
+/* Counts the crash in the problem directory the fingerprint points to, instead
+ * of creating a new one. Returns false if there is no such directory.
+ */
+static bool update_duplicate_problem(const char *fingerprint, uid_t uid, const char *executable)
+{
+    char *dir_name = dup_index_find(g_settings_dump_location, FILENAME_CRASH_FINGERPRINT, fingerprint);
+    if (!dir_name)
+        return false;
+
+    bool updated = false;
+    char *dir_path = concat_path_file(g_settings_dump_location, dir_name);
+    struct dump_dir *dup_dd = dd_opendir(dir_path, DD_FAIL_QUIETLY_ENOENT);
+    if (!dup_dd)
+        goto ret;
+
+    /* The index is only a cache, it must not merge crashes of different
+     * programs or users */
+    char *dd_uid = dd_load_text_ext(dup_dd, FILENAME_UID, DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE | DD_FAIL_QUIETLY_ENOENT);
+    char *dd_type = dd_load_text_ext(dup_dd, FILENAME_TYPE, DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE | DD_FAIL_QUIETLY_ENOENT);
+    char *dd_executable = dd_load_text_ext(dup_dd, FILENAME_EXECUTABLE, DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE | DD_FAIL_QUIETLY_ENOENT);
+    char uid_str[sizeof(long) * 3 + 2];
+    sprintf(uid_str, "%lu", (long)uid);
+
+    if (dd_uid && strcmp(dd_uid, uid_str) == 0
+        && dd_type && strcmp(dd_type, "CCpp") == 0
+        && dd_executable && strcmp(dd_executable, executable) == 0)
+    {
+        char *count_str = dd_load_text_ext(dup_dd, FILENAME_COUNT, DD_LOAD_TEXT_RETURN_NULL_ON_FAILURE | DD_FAIL_QUIETLY_ENOENT);
+        unsigned long count = count_str ? strtoul(count_str, NULL, 10) : 0;
+        free(count_str);
+
+        char new_count_str[sizeof(long)*3 + 2];
+        sprintf(new_count_str, "%lu", count + 1);
+        dd_save_text(dup_dd, FILENAME_COUNT, new_count_str);
+
+        char *last_ocr = xasprintf("%lu", (long)time(NULL));
+        dd_save_text(dup_dd, FILENAME_LAST_OCCURRENCE, last_ocr);
+        free(last_ocr);
+
+        log_notice("Crash is a duplicate of '%s'", dir_path);
+        updated = true;
+    }
+
+    free(dd_executable);
+    free(dd_type);
+    free(dd_uid);
+    dd_close(dup_dd);
+ ret:
+    free(dir_path);
+    free(dir_name);
+    return updated;
+}
+
+/* Monotonic durations and byte counts of the slow steps of the hook. The
+ * timings are saved in the dump directory and sent to the journal as
+ * structured debug fields. With VerboseLog, they are also added to the
+ * aggregate counters shared by all hook runs.
+ */
+#define HOOK_TIMINGS_COUNTERS_PATH VAR_RUN"/abrt/hook-timings"
+
+enum hook_phase
+{
+    HOOK_PHASE_CONFIG,
+    HOOK_PHASE_PROC,
+    HOOK_PHASE_BINARY,
+    HOOK_PHASE_CORE,
+    HOOK_PHASE_PACKAGE_DATA,
+    HOOK_PHASE_CORE_BACKTRACE,
+    HOOK_PHASE_TOTAL,
+    HOOK_PHASE_COUNT,
+};
+
+static const char *const hook_phase_names[HOOK_PHASE_COUNT] = {
+    [HOOK_PHASE_CONFIG]         = "config",
+    [HOOK_PHASE_PROC]           = "proc",
+    [HOOK_PHASE_BINARY]         = "binary",
+    [HOOK_PHASE_CORE]           = "core",
+    [HOOK_PHASE_PACKAGE_DATA]   = "package_data",
+    [HOOK_PHASE_CORE_BACKTRACE] = "core_backtrace",
+    [HOOK_PHASE_TOTAL]          = "total",
+};
+
+static struct hook_timing
+{
+    bool done;
+    unsigned long long usec;
+    unsigned long long bytes;
+} g_hook_timings[HOOK_PHASE_COUNT];
+
+static unsigned long long monotonic_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Returns the end of the phase, it can be used as the start of the next one. */
+static unsigned long long hook_phase_done(enum hook_phase phase, unsigned long long start,
+        unsigned long long bytes)
+{
+    const unsigned long long now = monotonic_usec();
+    g_hook_timings[phase].done = true;
+    g_hook_timings[phase].usec += now - start;
+    g_hook_timings[phase].bytes += bytes;
+    return now;
+}
+
+static unsigned long long dd_items_size(struct dump_dir *dd, const char *const *items)
+{
+    unsigned long long size = 0;
+    for (; *items != NULL; ++items)
+    {
+        const long item_size = dd_get_item_size(dd, *items);
+        if (item_size > 0)
+            size += item_size;
+    }
+    return size;
+}
+
+static void save_hook_timings(struct dump_dir *dd)
+{
+    struct strbuf *timings = strbuf_new();
+    unsigned i;
+    for (i = 0; i < HOOK_PHASE_COUNT; ++i)
+    {
+        if (g_hook_timings[i].done)
+            strbuf_append_strf(timings, "%s %llu %llu\n", hook_phase_names[i],
+                    g_hook_timings[i].usec, g_hook_timings[i].bytes);
+    }
+
+    dd_save_text(dd, FILENAME_HOOK_TIMINGS, timings->buf);
+    strbuf_free(timings);
+}
+
+static void log_hook_timings(pid_t pid, const char *executable, const char *path)
+{
+    /* MESSAGE, PRIORITY, SYSLOG_IDENTIFIER, ABRT_PID, ABRT_EXECUTABLE,
+     * ABRT_PROBLEM_DIR and two fields per phase */
+    struct iovec fields[6 + 2 * HOOK_PHASE_COUNT];
+    unsigned count = 0;
+
+    fields[count++].iov_base = xasprintf("MESSAGE=Hook of pid %lu (%s) took %llu ms",
+            (long)pid, executable, g_hook_timings[HOOK_PHASE_TOTAL].usec / 1000);
+    fields[count++].iov_base = xasprintf("PRIORITY=%d", LOG_DEBUG);
+    fields[count++].iov_base = xasprintf("SYSLOG_IDENTIFIER=%s", g_progname);
+    fields[count++].iov_base = xasprintf("ABRT_PID=%lu", (long)pid);
+    fields[count++].iov_base = xasprintf("ABRT_EXECUTABLE=%s", executable);
+    fields[count++].iov_base = xasprintf("ABRT_PROBLEM_DIR=%s", path);
+
+    unsigned i;
+    for (i = 0; i < HOOK_PHASE_COUNT; ++i)
+    {
+        if (!g_hook_timings[i].done)
+            continue;
+
+        /* Journal field names are upper case */
+        char name[32];
+        unsigned j;
+        for (j = 0; hook_phase_names[i][j] != '\0' && j < sizeof(name) - 1; ++j)
+            name[j] = toupper(hook_phase_names[i][j]);
+        name[j] = '\0';
+
+        fields[count++].iov_base = xasprintf("ABRT_HOOK_%s_USEC=%llu", name, g_hook_timings[i].usec);
+        fields[count++].iov_base = xasprintf("ABRT_HOOK_%s_BYTES=%llu", name, g_hook_timings[i].bytes);
+    }
+
+    for (i = 0; i < count; ++i)
+        fields[i].iov_len = strlen(fields[i].iov_base);
+
+    const int r = sd_journal_sendv(fields, count);
+    if (r < 0)
+        log_info("Failed to send the hook timings to the journal: %s", strerror(-r));
+
+    for (i = 0; i < count; ++i)
+        free(fields[i].iov_base);
+}
+
+/* The counters file has a line per phase:
+ *
+ *   PHASE RUNS TOTAL_USEC MAX_USEC TOTAL_BYTES
+ *
+ * Readers should take a shared flock() to get a consistent snapshot.
+ *
+ * Every update serializes all concurrent hooks on one lock, hence the
+ * counters are maintained only if VerboseLog is enabled.
+ */
+static void update_hook_timings_counters(void)
+{
+    int fd = open(HOOK_TIMINGS_COUNTERS_PATH, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        /* abrtd creates the directory, it does not exist in standalone mode */
+        log_debug("Can't open '%s': %s", HOOK_TIMINGS_COUNTERS_PATH, strerror(errno));
+        return;
+    }
+
+    if (flock(fd, LOCK_EX) < 0)
+    {
+        perror_msg("Can't lock '%s'", HOOK_TIMINGS_COUNTERS_PATH);
+        close(fd);
+        return;
+    }
+
+    struct
+    {
+        unsigned long long runs;
+        unsigned long long usec;
+        unsigned long long max_usec;
+        unsigned long long bytes;
+    } counters[HOOK_PHASE_COUNT];
+    memset(counters, 0, sizeof(counters));
+
+    unsigned i;
+    FILE *fp = fdopen(fd, "r+");
+    if (!fp)
+    {
+        perror_msg("fdopen");
+        close(fd);
+        return;
+    }
+
+    char *line;
+    while ((line = xmalloc_fgetline(fp)) != NULL)
+    {
+        char name[32];
+        unsigned long long runs, usec, max_usec, bytes;
+        if (sscanf(line, "%31s %llu %llu %llu %llu", name, &runs, &usec, &max_usec, &bytes) == 5)
+        {
+            for (i = 0; i < HOOK_PHASE_COUNT; ++i)
+            {
+                if (strcmp(name, hook_phase_names[i]) == 0)
+                {
+                    counters[i].runs = runs;
+                    counters[i].usec = usec;
+                    counters[i].max_usec = max_usec;
+                    counters[i].bytes = bytes;
+                    break;
+                }
+            }
+        }
+        free(line);
+    }
+
+    struct strbuf *content = strbuf_new();
+    for (i = 0; i < HOOK_PHASE_COUNT; ++i)
+    {
+        if (g_hook_timings[i].done)
+        {
+            counters[i].runs += 1;
+            counters[i].usec += g_hook_timings[i].usec;
+            counters[i].bytes += g_hook_timings[i].bytes;
+            if (counters[i].max_usec < g_hook_timings[i].usec)
+                counters[i].max_usec = g_hook_timings[i].usec;
+        }
+
+        strbuf_append_strf(content, "%s %llu %llu %llu %llu\n", hook_phase_names[i],
+                counters[i].runs, counters[i].usec, counters[i].max_usec, counters[i].bytes);
+    }
+
+    if (lseek(fd, 0, SEEK_SET) < 0
+        || ftruncate(fd, 0) < 0
+        || full_write(fd, content->buf, content->len) != (ssize_t)content->len)
+    {
+        perror_msg("Can't write '%s'", HOOK_TIMINGS_COUNTERS_PATH);
+    }
+
+    strbuf_free(content);
+    /* Releases the lock too */
+    fclose(fp);
+}
+
 int main(int argc, char** argv)
 {
     /* Kernel starts us with all fd's closed.
@@ -839,7 +2134,11 @@ int main(int argc, char** argv)
     if (fd > 2)
         close(fd);
 
+    const unsigned long long hook_start = monotonic_usec();
+    unsigned long long phase_start = hook_start;
+
     int err = 1;
+    char *degraded = NULL;
     logmode = LOGMODE_JOURNAL;
 
     /* Parse abrt.conf */
@@ -858,12 +2157,18 @@ int main(int argc, char** argv)
     bool setting_MakeCompatCore;
     bool setting_SaveBinaryImage;
     bool setting_SaveFullCore;
+    bool setting_CompressCore;
+    bool setting_CoreFilterMinimal = false;
     bool setting_CreateCoreBacktrace;
+    bool setting_SkipDuplicateCores;
+    bool setting_IgnoreTracedProcesses;
     bool setting_SaveContainerizedPackageData;
     bool setting_StandaloneHook;
+    bool setting_DegradeUnderLoad;
     unsigned int setting_MaxCoreFileSize = g_settings_nMaxCrashReportsSize;
 
     GList *setting_ignored_paths = NULL;
+    GList *setting_ignored_environment = NULL;
     GList *setting_allowed_users = NULL;
     GList *setting_allowed_groups = NULL;
     {
@@ -876,11 +2181,36 @@ int main(int argc, char** argv)
         setting_SaveBinaryImage = value && string_to_bool(value);
         value = get_map_string_item_or_NULL(settings, "SaveFullCore");
         setting_SaveFullCore = value ? string_to_bool(value) : true;
+        value = get_map_string_item_or_NULL(settings, "SparseCore");
+        g_sparse_core = value && string_to_bool(value);
+        value = get_map_string_item_or_NULL(settings, "CoreWriteBehind");
+        g_core_write_behind = value && string_to_bool(value);
+        unsigned int bandwidth = 0;
+        value = get_map_string_item_or_NULL(settings, "MaxCoreWriteBandwidth");
+        if (value && !try_get_map_string_item_as_uint(settings, "MaxCoreWriteBandwidth", &bandwidth))
+            log_warning("The MaxCoreWriteBandwidth option in the CCpp.conf file holds an invalid value");
+        g_core_write_bandwidth = bandwidth * 1024ULL * 1024ULL;
+        value = get_map_string_item_or_NULL(settings, "CoreFilter");
+        if (value && strcmp(value, "minimal") == 0)
+            setting_CoreFilterMinimal = true;
+        else if (value && strcmp(value, "full") != 0)
+            log_warning("The CoreFilter option in the CCpp.conf file holds an invalid value");
+        value = get_map_string_item_or_NULL(settings, "CompressCore");
+        setting_CompressCore = value && string_to_bool(value);
         value = get_map_string_item_or_NULL(settings, "CreateCoreBacktrace");
         setting_CreateCoreBacktrace = value ? string_to_bool(value) : true;
+        value = get_map_string_item_or_NULL(settings, "SkipDuplicateCores");
+        setting_SkipDuplicateCores = value && string_to_bool(value);
+        value = get_map_string_item_or_NULL(settings, "DegradeUnderLoad");
+        setting_DegradeUnderLoad = value ? string_to_bool(value) : true;
         value = get_map_string_item_or_NULL(settings, "IgnoredPaths");
         if (value)
             setting_ignored_paths = parse_list(value);
+        value = get_map_string_item_or_NULL(settings, "IgnoredEnvironment");
+        /* An empty value turns the rule off */
+        setting_ignored_environment = parse_list(value ? value : "ABRT_IGNORE_ALL=1, ABRT_IGNORE_CCPP=1");
+        value = get_map_string_item_or_NULL(settings, "IgnoreTracedProcesses");
+        setting_IgnoreTracedProcesses = value ? string_to_bool(value) : true;
 
         value = get_map_string_item_or_NULL(settings, "AllowedUsers");
         if (value)
@@ -912,6 +2242,8 @@ int main(int argc, char** argv)
         free_map_string(settings);
     }
 
+    hook_phase_done(HOOK_PHASE_CONFIG, phase_start, 0);
+
     if (argc == 2 && !strcmp(argv[1], "--test-config"))
         return test_configuration(setting_SaveFullCore, setting_CreateCoreBacktrace);
 
@@ -964,6 +2296,9 @@ int main(int argc, char** argv)
     const char *global_pid_str = argv[7];
     pid_t pid = xatoi_positive(argv[7]);
     const int pid_proc_fd = open_proc_pid_dir(pid);
+    /* The core file compressor must not inherit the fd */
+    if (pid_proc_fd >= 0)
+        close_on_exec_on(pid_proc_fd);
 
     user_pwd = get_cwd_at(pid_proc_fd); /* may be NULL on error */
     log_notice("user_pwd:'%s'", user_pwd);
@@ -1014,8 +2349,6 @@ int main(int argc, char** argv)
         }
     }
 
-    snprintf(path, sizeof(path), "%s/last-ccpp", g_settings_dump_location);
-
     /* Open a fd to compat coredump, if requested and is possible */
     int user_core_fd = -1;
     if (setting_MakeCompatCore && ulimit_c != 0)
@@ -1043,6 +2376,30 @@ int main(int argc, char** argv)
 
         return 0;
     }
+    /* the rules the post-create event used to evaluate after the core had
+     * been written */
+    if (setting_IgnoreTracedProcesses && is_process_traced(proc_pid_status))
+    {
+        /* Debuggers have wide variety of bugs where they leak SIGTRAP
+         * to traced process and nuke it. */
+        error_msg_ignore_crash(pid_str, last_slash, (long unsigned)uid, signal_no,
+                signame, "the process was ptraced");
+
+        return create_user_core(user_core_fd, pid, ulimit_c);
+    }
+    if (setting_ignored_environment)
+    {
+        char *environ = get_environ_at(pid_proc_fd);
+        const char *pattern = environ ? find_ignored_environment(setting_ignored_environment, environ) : NULL;
+        free(environ);
+        if (pattern)
+        {
+            error_msg_ignore_crash(pid_str, last_slash, (long unsigned)uid, signal_no,
+                    signame, "'%s' listed in 'IgnoredEnvironment' found in environment", pattern);
+
+            return create_user_core(user_core_fd, pid, ulimit_c);
+        }
+    }
     /* do not dump abrt-hook-ccpp crashes */
     if (executable && strstr(executable, "/abrt-hook-ccpp"))
     {
@@ -1062,17 +2419,6 @@ int main(int argc, char** argv)
 
         exit(0);
     }
-    /* Check /var/tmp/abrt/last-ccpp marker, do not dump repeated crashes
-     * if they happen too often. Else, write new marker value.
-     */
-    if (check_recent_crash_file(path, executable))
-    {
-        error_msg_ignore_crash(pid_str, last_slash, (long unsigned)uid, signal_no,
-                signame, "repeated crash");
-
-        /* It is a repeating crash */
-        return create_user_core(user_core_fd, pid, ulimit_c);
-    }
     const bool abrt_crash = (last_slash && (strncmp(last_slash, "abrt", 4) == 0));
     if (abrt_crash && g_settings_debug_level == 0)
     {
@@ -1132,10 +2478,6 @@ int main(int argc, char** argv)
         }
     }
 
-    // processing crash - inform user about it
-    error_msg_process_crash(pid_str, last_slash, (long unsigned)uid,
-                signal_no, signame, "dumping core");
-
     pid_t tid = -1;
     const char *tid_str = argv[8];
     if (tid_str)
@@ -1143,6 +2485,50 @@ int main(int argc, char** argv)
         tid = xatoi_positive(tid_str);
     }
 
+    /* known problem - do not pay for writing its core again */
+    char *fingerprint = NULL;
+    if (setting_SkipDuplicateCores && tid > 0 && !abrt_crash)
+    {
+        fingerprint = crash_fingerprint(pid, tid, uid, signal_no);
+        if (fingerprint && update_duplicate_problem(fingerprint, uid, executable))
+        {
+            error_msg_ignore_crash(pid_str, last_slash, (long unsigned)uid, signal_no,
+                                    signame, "duplicate of a known problem");
+            return create_user_core(user_core_fd, pid, ulimit_c);
+        }
+    }
+
+    /* Do not dump repeated crashes if they happen too often. Checked after all
+     * the other reasons to ignore the crash, only the saved crashes take
+     * a token. */
+    if (!crash_admission_check(g_settings_dump_location, executable, uid,
+                g_settings_crash_rate_burst, g_settings_crash_rate_interval))
+    {
+        error_msg_ignore_crash(pid_str, last_slash, (long unsigned)uid, signal_no,
+                signame, "repeated crash");
+
+        /* It is a repeating crash */
+        return create_user_core(user_core_fd, pid, ulimit_c);
+    }
+
+    /* abrtd can't keep up - save only what is needed to recognize the problem */
+#ifdef ENABLE_DUMP_TIME_UNWIND
+    if (setting_DegradeUnderLoad && setting_CreateCoreBacktrace && tid > 0 && !abrt_crash)
+    {
+        struct load_status load;
+        if (load_status_read(&load) == 0 && load.degraded)
+        {
+            degraded = load_status_describe(&load);
+            setting_SaveFullCore = false;
+            setting_SaveBinaryImage = false;
+        }
+    }
+#endif /*ENABLE_DUMP_TIME_UNWIND*/
+
+    // processing crash - inform user about it
+    error_msg_process_crash(pid_str, last_slash, (long unsigned)uid,
+                signal_no, signame, degraded ? "saving core backtrace only" : "dumping core");
+
     if (setting_StandaloneHook)
         ensure_writable_dir(g_settings_dump_location, DEFAULT_DUMP_LOCATION_MODE, "abrt");
 
@@ -1157,6 +2543,7 @@ int main(int argc, char** argv)
             g_settings_dump_location, iso_date_string(NULL), (long)pid);
     if (path_len >= (sizeof(path) - sizeof("/"FILENAME_COREDUMP)))
     {
+        free(degraded);
         return create_user_core(user_core_fd, pid, ulimit_c);
     }
 
@@ -1173,6 +2560,8 @@ int main(int argc, char** argv)
     dd = dd_create(path, /*fs owner*/0, DEFAULT_DUMP_DIR_MODE);
     if (dd)
     {
+        phase_start = monotonic_usec();
+
         char source_filename[sizeof("/proc/%lu/somewhat_long_name") + sizeof(long)*3];
         int source_base_ofs = sprintf(source_filename, "/proc/%lu/root", (long)pid);
         source_base_ofs -= strlen("root");
@@ -1243,6 +2632,8 @@ int main(int argc, char** argv)
         dd_save_text(dd, FILENAME_ANALYZER, "abrt-ccpp");
         dd_save_text(dd, FILENAME_TYPE, "CCpp");
         dd_save_text(dd, FILENAME_EXECUTABLE, executable);
+        if (fingerprint)
+            dd_save_text(dd, FILENAME_CRASH_FINGERPRINT, fingerprint);
         dd_save_text(dd, FILENAME_PID, pid_str);
         dd_save_text(dd, FILENAME_GLOBAL_PID, global_pid_str);
         dd_save_text(dd, FILENAME_PROC_PID_STATUS, proc_pid_status);
@@ -1281,6 +2672,9 @@ int main(int argc, char** argv)
 
         dd_save_text(dd, FILENAME_ABRT_VERSION, VERSION);
 
+        if (degraded)
+            dd_save_text(dd, FILENAME_DEGRADED, degraded);
+
         /* In case of errors, treat the process as if it has locked memory */
         long unsigned lck_bytes = ULONG_MAX;
         const char *vmlck = strstr(proc_pid_status, "VmLck:");
@@ -1302,6 +2696,13 @@ int main(int argc, char** argv)
                     "bug tracking tools");
         }
 
+        static const char *const proc_items[] = {
+            FILENAME_MAPS, FILENAME_LIMITS, FILENAME_CGROUP, FILENAME_MOUNTINFO,
+            FILENAME_OPEN_FDS, FILENAME_NAMESPACES, FILENAME_PROC_PID_STATUS,
+            FILENAME_CMDLINE, FILENAME_ENVIRON, NULL
+        };
+        phase_start = hook_phase_done(HOOK_PHASE_PROC, phase_start, dd_items_size(dd, proc_items));
+
         if (setting_SaveBinaryImage)
         {
             if (save_crashing_binary(pid, dd))
@@ -1310,12 +2711,30 @@ int main(int argc, char** argv)
 
                 goto cleanup_and_exit;
             }
+
+            const long binary_size = dd_get_item_size(dd, FILENAME_BINARY);
+            phase_start = hook_phase_done(HOOK_PHASE_BINARY, phase_start, binary_size > 0 ? binary_size : 0);
         }
 
         size_t core_size = 0;
         if (setting_SaveFullCore)
         {
-            int abrt_core_fd = dd_open_item(dd, FILENAME_COREDUMP, O_RDWR);
+            pid_t compressor_pid = -1;
+            int compressed_core_fd = -1;
+            int abrt_core_fd = -1;
+            if (setting_CompressCore)
+            {
+                abrt_core_fd = open_compressed_core(dd, &compressor_pid, &compressed_core_fd);
+                if (abrt_core_fd < 0)
+                {
+                    log_warning("Falling back to uncompressed ABRT core file");
+                    setting_CompressCore = false;
+                }
+            }
+
+            if (!setting_CompressCore)
+                abrt_core_fd = dd_open_item(dd, FILENAME_COREDUMP, O_RDWR);
+
             if (abrt_core_fd < 0)
             {   /* Avoid the need to deal with two destinations. */
                 perror_msg("Failed to create ABRT core file in '%s'", dd->dd_dirname);
@@ -1345,7 +2764,47 @@ int main(int argc, char** argv)
                 else
                     abrt_limit = SIZE_MAX;
 
-                if (user_core_fd < 0)
+                if (user_core_fd >= 0 && !setting_CompressCore && !setting_CoreFilterMinimal
+                    && can_clone_core_files(abrt_core_fd, user_core_fd))
+                {
+                    size_t user_limit = ulimit_c;
+                    const int r = clone_two_core_files(abrt_core_fd, &abrt_limit, user_core_fd, &user_limit);
+
+                    close_user_core(user_core_fd, (r & DUMP_USER_CORE_FAILED) ? -1 : (off_t)user_limit);
+
+                    if (!(r & DUMP_ABRT_CORE_FAILED))
+                        core_size = abrt_limit;
+                }
+                else if (g_sparse_core || g_core_write_behind || g_core_write_bandwidth != 0
+                    || setting_CoreFilterMinimal)
+                {
+                    struct core_file files[2];
+                    unsigned count = 0;
+                    core_file_init(&files[count++], abrt_core_fd, abrt_limit);
+                    if (user_core_fd >= 0)
+                        core_file_init(&files[count++], user_core_fd, ulimit_c);
+
+                    struct core_filter filter;
+                    if (setting_CoreFilterMinimal)
+                        core_filter_init(&filter, pid);
+
+                    write_core_files(files, count, setting_CoreFilterMinimal ? &filter : NULL);
+
+                    if (!files[0].failed)
+                        core_size = files[0].size;
+
+                    if (setting_CoreFilterMinimal)
+                    {
+                        if (filter.dropped != 0)
+                            log_notice("CoreFilter: %llu bytes recoverable from mapped files not saved",
+                                       (unsigned long long)filter.dropped);
+                        core_filter_free(&filter);
+                    }
+
+                    if (user_core_fd >= 0)
+                        close_user_core(user_core_fd, files[1].failed ? -1 : (off_t)files[1].size);
+                }
+                else if (user_core_fd < 0)
                 {
                     const ssize_t r = splice_entire_per_partes(STDIN_FILENO, abrt_core_fd, abrt_limit);
                     if (r < 0)
@@ -1364,7 +2823,15 @@ int main(int argc, char** argv)
                         core_size = abrt_limit;
                 }
 
-                if (fsync(abrt_core_fd) != 0 || close(abrt_core_fd) != 0)
+                if (setting_CompressCore)
+                {
+                    if (close_compressed_core(abrt_core_fd, compressor_pid, compressed_core_fd) != 0)
+                    {
+                        dd_delete_item(dd, FILENAME_COREDUMP_XZ);
+                        core_size = 0;
+                    }
+                }
+                else if (fsync(abrt_core_fd) != 0 || close(abrt_core_fd) != 0)
                     perror_msg("Failed to close ABRT core file");
             }
         }
@@ -1377,6 +2844,8 @@ int main(int argc, char** argv)
         /* User core is either written or closed */
         user_core_fd = -1;
 
+        phase_start = hook_phase_done(HOOK_PHASE_CORE, phase_start, core_size);
+
         /*
          * ! No other errors should cause removal of the user core !
          */
@@ -1433,6 +2902,8 @@ int main(int argc, char** argv)
             pid_t pid = fork_execv_on_steroids(0, (char **)cmd_args, NULL, NULL, path, 0);
             int stat;
             safe_waitpid(pid, &stat, 0);
+
+            phase_start = hook_phase_done(HOOK_PHASE_PACKAGE_DATA, phase_start, 0);
         }
 
         enum create_core_backtrace_status cbr = 0;
@@ -1443,6 +2914,10 @@ int main(int argc, char** argv)
             cbr = create_core_backtrace(dd, uid, fsuid, gid, fsgid, tid, executable, signal_no);
             if (cbr & CB_DISABLED)
                 log_warning("CreateCoreBacktrace is enabled but dump time unwinding is not supported");
+
+            const long backtrace_size = dd_get_item_size(dd, FILENAME_CORE_BACKTRACE);
+            phase_start = hook_phase_done(HOOK_PHASE_CORE_BACKTRACE, phase_start,
+                    backtrace_size > 0 ? backtrace_size : 0);
         }
 
         /* Make sure we closed STDIN_FILENO to let kernel to wipe out the process. */
@@ -1455,6 +2930,10 @@ int main(int argc, char** argv)
          * will wait for us), and we won't be able to delete their dumps.
          * Classic deadlock.
          */
+        const off_t dump_dir_size = dd_compute_size(dd, /*no flags*/0);
+        hook_phase_done(HOOK_PHASE_TOTAL, hook_start, dump_dir_size > 0 ? dump_dir_size : 0);
+        save_hook_timings(dd);
+
         dd_close(dd);
         dd = NULL;
 
@@ -1469,6 +2948,10 @@ int main(int argc, char** argv)
             log_notice("Saved core dump of pid %lu (%s) to %s (%zu bytes)",
                        (long)pid, executable, path, core_size);
 
+        log_hook_timings(pid, executable, path);
+        if (g_verbose > 0)
+            update_hook_timings_counters();
+
         if (abrtd_running)
             notify_new_path(path);
 
@@ -1488,10 +2971,13 @@ int main(int argc, char** argv)
     else
     {
         /* We didn't create abrt dump, but may need to create compat coredump */
+        free(degraded);
         return create_user_core(user_core_fd, pid, ulimit_c);
     }
 
 cleanup_and_exit:
+    free(degraded);
+
     if (dd)
         dd_delete(dd);
 
@@ -24,6 +24,22 @@
 extern "C" {
 #endif
 
+/* Compressed variant of FILENAME_COREDUMP */
+#define FILENAME_COREDUMP_XZ FILENAME_COREDUMP".xz"
+/* Hash of the crash state abrt-hook-ccpp reads from /proc, see dup_index_find() */
+#define FILENAME_CRASH_FINGERPRINT "crash_fingerprint"
+/* Keys of the frames of the crash thread, see crash_frames_load() */
+#define FILENAME_CRASH_FRAMES "crash_frames"
+/* Durations and sizes of the steps abrt-hook-ccpp performed */
+#define FILENAME_HOOK_TIMINGS "hook_timings"
+/* Why the hook saved less data than usually */
+#define FILENAME_DEGRADED "degraded"
+/* The problem was received through the spool directory, the data from /proc
+ * were sent by the client */
+#define FILENAME_SPOOLED "spooled"
+/* Stack trace systemd-coredump logged for a crash, see abrt-dump-journal-core */
+#define FILENAME_JOURNAL_STACKTRACE "journal_stacktrace"
+
 /* Some libc's forget to declare these, do it ourself */
 extern char **environ;
 #if defined(__GLIBC__) && __GLIBC__ < 2
@@ -48,6 +64,27 @@ void ensure_writable_dir_uid_gid(const char *dir, mode_t mode, uid_t uid, gid_t
 void ensure_writable_dir(const char *dir, mode_t mode, const char *user);
 #define ensure_writable_dir_group abrt_ensure_writable_dir_group
 void ensure_writable_dir_group(const char *dir, mode_t mode, const char *user, const char *group);
+#define decompress_coredump abrt_decompress_coredump
+/**
+  @brief Gives a consumer an uncompressed core dump of the problem directory
+
+  If the directory holds only FILENAME_COREDUMP_XZ written by the CompressCore
+  option, the core dump is decompressed to a temporary file named
+  FILENAME_COREDUMP in a directory of its own. The problem directory is never
+  modified.
+
+  @param dump_dir_name Problem directory
+  @returns A malloced path of the core dump to be passed to
+  release_coredump(); NULL if there is no core dump or it can't be
+  decompressed
+*/
+char *decompress_coredump(const char *dump_dir_name);
+#define release_coredump abrt_release_coredump
+/**
+  @brief Removes the temporary core dump of decompress_coredump() and frees
+  the path
+*/
+void release_coredump(char *core_path);
 #define run_unstrip_n abrt_run_unstrip_n
 char *run_unstrip_n(const char *dump_dir_name, unsigned timeout_sec);
 #define get_backtrace abrt_get_backtrace
@@ -83,6 +120,20 @@ extern bool          g_settings_shortenedreporting;
 extern bool          g_settings_explorechroots;
 #define g_settings_debug_level abrt_g_settings_debug_level
 extern unsigned int  g_settings_debug_level;
+#define g_settings_crash_rate_burst abrt_g_settings_crash_rate_burst
+extern unsigned int  g_settings_crash_rate_burst;
+#define g_settings_crash_rate_interval abrt_g_settings_crash_rate_interval
+extern unsigned int  g_settings_crash_rate_interval;
+#define g_settings_max_post_create_jobs abrt_g_settings_max_post_create_jobs
+extern unsigned int  g_settings_max_post_create_jobs;
+#define g_settings_post_create_priorities abrt_g_settings_post_create_priorities
+extern char *        g_settings_post_create_priorities;
+#define g_settings_post_create_aging abrt_g_settings_post_create_aging
+extern unsigned int  g_settings_post_create_aging;
+#define g_settings_degrade_queue_length abrt_g_settings_degrade_queue_length
+extern unsigned int  g_settings_degrade_queue_length;
+#define g_settings_degrade_rate abrt_g_settings_degrade_rate
+extern unsigned int  g_settings_degrade_rate;
 
 
 #define load_abrt_conf abrt_load_abrt_conf
@@ -105,7 +156,24 @@ int save_abrt_plugin_conf_file(const char *file, map_string_t *settings);
 
 void migrate_to_xdg_dirs(void);
 
-int check_recent_crash_file(const char *filename, const char *executable);
+/**
+  @brief Decides whether a crash of the executable run by the user should be
+  saved
+
+  Each executable and user pair has a token bucket holding at most burst
+  tokens. A saved crash takes one token and a token is added every
+  interval_sec seconds. The buckets are shared by all processes using the
+  same dump location and never block each other.
+
+  @param dump_location A directory holding the shared buckets
+  @param burst Maximum number of crashes saved at once; 0 saves all crashes
+  @param interval_sec Seconds to refill one token; 0 saves all crashes
+  @return 1 if the crash should be saved; 0 if it exceeds the allowed rate.
+  Returns 1 in case of any error.
+*/
+#define crash_admission_check abrt_crash_admission_check
+int crash_admission_check(const char *dump_location, const char *executable, uid_t uid,
+        unsigned burst, unsigned interval_sec);
 
 /* Returns 1 if abrtd daemon is running, 0 otherwise. */
 #define daemon_is_ok abrt_daemon_is_ok
@@ -125,7 +193,8 @@ wait for the reply
 
 @param path Path to the problem directory containing the problem data
 @param message The abrtd reply
-@return -errno on error otherwise return value of abrtd
+@return -errno on error, 202 if abrtd was busy and the notification was
+spooled, otherwise return value of abrtd
 */
 #define notify_new_path_with_response abrt_notify_new_path_with_response
 int notify_new_path_with_response(const char *path, char **message);
@@ -342,6 +411,353 @@ void ignored_problems_remove_problem_data(ignored_problems_t *set, problem_data_
 */
 bool ignored_problems_contains_problem_data(ignored_problems_t *set, problem_data_t *pd);
 
+/**
+  @brief Looks up a problem directory in the duplicate index of a dump location
+
+  The index maps values of problem elements (e.g. FILENAME_CRASH_FINGERPRINT)
+  to problem directories. Rows pointing to no longer existing directories are
+  skipped. The caller must verify the returned directory because the index is
+  only a cache.
+
+  @param dump_location A directory holding the index
+  @param name A name of the problem element
+  @param value A value of the problem element
+  @return A malloced base name of the most recently indexed directory or NULL
+*/
+#define dup_index_find abrt_dup_index_find
+char *dup_index_find(const char *dump_location, const char *name, const char *value);
+
+/**
+  @brief Adds a problem directory to the duplicate index of a dump location
+
+  The row supersedes the earlier rows of the element of the directory. Rows
+  pointing to no longer existing directories are dropped once the index is
+  compacted.
+
+  @param dump_location A directory holding the index
+  @param name A name of the problem element
+  @param value A value of the problem element
+  @param dir_name A base name of the problem directory in dump_location
+  @return 0 on success; otherwise a negative number
+*/
+#define dup_index_add abrt_dup_index_add
+int dup_index_add(const char *dump_location, const char *name, const char *value, const char *dir_name);
+
+/**
+  @brief Looks up all problem directories with the value in the duplicate index
+
+  @param dump_location A directory holding the index
+  @param name A name of the problem element
+  @param value A value of the problem element
+  @param indexed Set to true if the index has a row of the element name, the
+  index must be built by the caller otherwise
+  @return A list of malloced base names, the most recently indexed first
+*/
+#define dup_index_find_all abrt_dup_index_find_all
+GList *dup_index_find_all(const char *dump_location, const char *name, const char *value, bool *indexed);
+
+/**
+  @brief Adds many problem directories to the duplicate index at once
+
+  The rows supersede the earlier rows of the element of the directories.
+
+  @param dump_location A directory holding the index
+  @param name A name of the problem element
+  @param values Maps base names of problem directories to their values of
+  the element, the invalid ones are skipped
+  @return 0 on success; otherwise a negative number
+*/
+#define dup_index_add_all abrt_dup_index_add_all
+int dup_index_add_all(const char *dump_location, const char *name, GHashTable *values);
+
+/**
+  @brief Looks up the values of an element of the problem directories
+
+  The existence of the directories is not checked.
+
+  @param dump_location A directory holding the index
+  @param name A name of the problem element
+  @param dir_names A list of base names of problem directories
+  @return A hash table mapping the base names of the indexed directories to
+  their most recently indexed values, all malloced
+*/
+#define dup_index_find_values abrt_dup_index_find_values
+GHashTable *dup_index_find_values(const char *dump_location, const char *name, GList *dir_names);
+
+/* The key of a frame that is never similar to any other frame */
+#define CRASH_FRAME_UNKNOWN 0
+
+/**
+  @brief Reduces the frames of the crash thread of a core backtrace to keys
+
+  Similar frames have the same key.
+
+  @param core_backtrace A JSON core backtrace
+  @param count Set to the number of frames
+  @return A malloced array of the frame keys or NULL if the core backtrace
+  can't be parsed or has no crash thread
+*/
+#define crash_frames_from_core_backtrace abrt_crash_frames_from_core_backtrace
+uint64_t *crash_frames_from_core_backtrace(const char *core_backtrace, unsigned *count);
+
+/**
+  @brief Saves the crash frames to the FILENAME_CRASH_FRAMES element
+*/
+#define crash_frames_save abrt_crash_frames_save
+void crash_frames_save(struct dump_dir *dd, const uint64_t *frames, unsigned count);
+
+/**
+  @brief Loads the crash frames of a problem directory
+
+  @param dd A problem directory
+  @param count Set to the number of frames
+  @return A malloced array of the frame keys or NULL if the problem
+  directory has no valid FILENAME_CRASH_FRAMES element
+*/
+#define crash_frames_load abrt_crash_frames_load
+uint64_t *crash_frames_load(const struct dump_dir *dd, unsigned *count);
+
+/**
+  @brief Computes the Damerau-Levenshtein distance of two threads of frame ids
+
+  Similar frames have the same id, frames of the id 0 are never similar.
+
+  @param max_distance The computation ends as soon as the distance is known
+  to be greater
+  @return The distance divided by the number of frames of the longer thread,
+  1.0 if it is greater than max_distance or both threads have no frames
+*/
+#define frame_ids_distance abrt_frame_ids_distance
+float frame_ids_distance(const uint32_t *ids1, unsigned count1,
+                         const uint32_t *ids2, unsigned count2,
+                         float max_distance);
+
+/**
+  @brief Computes the Damerau-Levenshtein distance of two crash threads
+
+  @see frame_ids_distance()
+*/
+#define crash_frames_distance abrt_crash_frames_distance
+float crash_frames_distance(const uint64_t *frames1, unsigned count1,
+                            const uint64_t *frames2, unsigned count2,
+                            float max_distance);
+
+/**
+  @brief Computes the MinHash signature of the crash frames
+
+  The threads within the duplicate threshold distance have matching signatures
+  with a high probability, see crash_frames_lsh_match().
+
+  @return A malloced printable signature or NULL if all frames are unknown
+*/
+#define crash_frames_lsh_signature abrt_crash_frames_lsh_signature
+char *crash_frames_lsh_signature(const uint64_t *frames, unsigned count);
+
+/**
+  @brief Checks whether two crash threads can be similar by their signatures
+
+  @return false if the threads are not similar; true if they can be similar
+  or a signature is malformed
+*/
+#define crash_frames_lsh_match abrt_crash_frames_lsh_match
+bool crash_frames_lsh_match(const char *signature1, const char *signature2);
+
+/**
+  @struct dir_size_index
+  @brief An opaque structure holding sizes of entries of a directory
+*/
+typedef struct dir_size_index dir_size_index_t;
+
+/**
+  @brief Creates a size index of the directory
+
+  Loads the index persisted by dir_size_index_save(). The loaded index can be
+  out of date; call dir_size_index_sync() before relying on it.
+
+  @param dirname A directory whose entries are indexed
+  @return An instance which must be destroyed by dir_size_index_free()
+*/
+#define dir_size_index_new abrt_dir_size_index_new
+dir_size_index_t *dir_size_index_new(const char *dirname);
+
+#define dir_size_index_free abrt_dir_size_index_free
+void dir_size_index_free(dir_size_index_t *index);
+
+/**
+  @brief Brings the index up to date with the directory
+
+  Only the subdirectories whose modification time differs from the indexed
+  one are walked. Hidden entries are used by ABRT itself and are not indexed.
+
+  @return The number of walked subdirectories
+*/
+#define dir_size_index_sync abrt_dir_size_index_sync
+unsigned dir_size_index_sync(dir_size_index_t *index);
+
+/**
+  @brief Walks the entry again or removes it if it no longer exists
+
+  @param name A base name of the entry
+*/
+#define dir_size_index_update abrt_dir_size_index_update
+void dir_size_index_update(dir_size_index_t *index, const char *name);
+
+#define dir_size_index_remove abrt_dir_size_index_remove
+void dir_size_index_remove(dir_size_index_t *index, const char *name);
+
+/**
+  @return The size of the directory in Bytes
+*/
+#define dir_size_index_total abrt_dir_size_index_total
+double dir_size_index_total(dir_size_index_t *index);
+
+/**
+  @brief Finds the subdirectory to delete first
+
+  Uses the same size and age weighting as get_dirsize_find_largest_dir().
+  The weights are updated at most once a minute.
+
+  @param excluded A list of base names which must not be returned
+  @return A malloced base name or NULL
+*/
+#define dir_size_index_find_worst abrt_dir_size_index_find_worst
+char *dir_size_index_find_worst(dir_size_index_t *index, GList *excluded);
+
+/**
+  @brief Persists the index in the indexed directory
+
+  @return 0 on success; otherwise -1
+*/
+#define dir_size_index_save abrt_dir_size_index_save
+int dir_size_index_save(dir_size_index_t *index);
+
+/**
+  @struct post_create_journal
+  @brief An opaque structure holding the journal of the post-create queue
+*/
+typedef struct post_create_journal post_create_journal_t;
+
+/**
+  @brief Opens the journal of the post-create queue in the dump location
+
+  Replays the journal, so the directories which were waiting for post-create
+  when the journal was used last time are pending.
+
+  @param dump_location A path to the dump location
+  @return An instance which must be destroyed by post_create_journal_close()
+  or NULL on errors
+*/
+#define post_create_journal_open abrt_post_create_journal_open
+post_create_journal_t *post_create_journal_open(const char *dump_location);
+
+#define post_create_journal_close abrt_post_create_journal_close
+void post_create_journal_close(post_create_journal_t *journal);
+
+/**
+  @return A list of malloced basenames of the pending problem directories
+  in the order they were enqueued
+*/
+#define post_create_journal_pending abrt_post_create_journal_pending
+GList *post_create_journal_pending(post_create_journal_t *journal);
+
+#define post_create_journal_is_pending abrt_post_create_journal_is_pending
+bool post_create_journal_is_pending(post_create_journal_t *journal, const char *dirname);
+
+/**
+  @brief Durably records that the problem directory waits for post-create
+
+  Does nothing if the directory is already pending.
+
+  @param dirname A basename of the problem directory
+  @return 0 on success; otherwise non-zero
+*/
+#define post_create_journal_enqueue abrt_post_create_journal_enqueue
+int post_create_journal_enqueue(post_create_journal_t *journal, const char *dirname);
+
+/**
+  @brief Records that the problem directory no longer waits for post-create
+
+  @param dirname A basename of the problem directory
+  @return 0 on success; otherwise non-zero
+*/
+#define post_create_journal_complete abrt_post_create_journal_complete
+int post_create_journal_complete(post_create_journal_t *journal, const char *dirname);
+
+/**
+  @brief Returns the number of MiB available to unprivileged users in path
+
+  @return ULONG_MAX if the number can't be obtained
+*/
+#define get_free_space_mb abrt_get_free_space_mb
+unsigned long get_free_space_mb(const char *path);
+
+/**
+  @struct load_status
+  @brief The load of abrtd published for the crash hooks
+*/
+struct load_status
+{
+    /* problems waiting for post-create */
+    unsigned queued;
+    /* problems running post-create */
+    unsigned running;
+    /* problems detected in the last minute */
+    unsigned rate;
+    /* MiB available in the dump location */
+    unsigned long free_space;
+    /* the hooks should save only the most important data */
+    bool degraded;
+};
+
+/**
+  @brief Publishes the load of the calling abrtd
+
+  @return 0 on success; otherwise -1
+*/
+#define load_status_save abrt_load_status_save
+int load_status_save(const struct load_status *status);
+
+#define load_status_remove abrt_load_status_remove
+void load_status_remove(void);
+
+/**
+  @brief Reads the load published by abrtd
+
+  @param status Zeroed if the load is not known
+  @return 0 on success; -ENOENT if abrtd publishes nothing and -ESRCH if the
+  publishing abrtd is gone
+*/
+#define load_status_read abrt_load_status_read
+int load_status_read(struct load_status *status);
+
+/**
+  @brief Describes the load for the 'degraded' element of a problem
+
+  @return A malloced string
+*/
+#define load_status_describe abrt_load_status_describe
+char *load_status_describe(const struct load_status *status);
+
+/**
+  @brief Returns the directory where the clients of abrt.socket leave their
+  requests while abrtd does not accept connections
+*/
+#define spool_dir_name abrt_spool_dir_name
+const char *spool_dir_name(void);
+
+/**
+  @brief Leaves the request for abrtd in the spool directory
+
+  The request has the same format as the one sent to abrt.socket. The spooled
+  file appears under its final name complete, abrtd never sees partial data.
+  abrtd does not read /proc of the client of a spooled request, a new problem
+  must carry the items like cmdline and environ itself.
+
+  @return 0 on success; otherwise -errno
+*/
+#define spool_request abrt_spool_request
+int spool_request(const char *request, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
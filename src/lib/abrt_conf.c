@@ -29,6 +29,13 @@ char *        g_settings_autoreporting_event = NULL;
 bool          g_settings_shortenedreporting = 0;
 bool          g_settings_explorechroots = 0;
 unsigned int  g_settings_debug_level = 0;
+unsigned int  g_settings_crash_rate_burst = 1;
+unsigned int  g_settings_crash_rate_interval = 20;
+unsigned int  g_settings_max_post_create_jobs = 0;
+char *        g_settings_post_create_priorities = NULL;
+unsigned int  g_settings_post_create_aging = 60;
+unsigned int  g_settings_degrade_queue_length = 100;
+unsigned int  g_settings_degrade_rate = 60;
 
 void free_abrt_conf_data()
 {
@@ -40,6 +47,9 @@ void free_abrt_conf_data()
 
     free(g_settings_autoreporting_event);
     g_settings_autoreporting_event = NULL;
+
+    free(g_settings_post_create_priorities);
+    g_settings_post_create_priorities = NULL;
 }
 
 /* Beware - the function normalizes only slashes - that's the most often
@@ -156,6 +166,92 @@ static void ParseCommon(map_string_t *settings, const char *conf_filename)
         remove_map_string_item(settings, "DebugLevel");
     }
 
+    value = get_map_string_item_or_NULL(settings, "CrashRateBurst");
+    if (value)
+    {
+        char *end;
+        errno = 0;
+        unsigned long ul = strtoul(value, &end, 10);
+        if (errno || end == value || *end != '\0' || ul > INT_MAX)
+            error_msg("Error parsing %s setting: '%s'", "CrashRateBurst", value);
+        else
+            g_settings_crash_rate_burst = ul;
+        remove_map_string_item(settings, "CrashRateBurst");
+    }
+
+    value = get_map_string_item_or_NULL(settings, "CrashRateInterval");
+    if (value)
+    {
+        char *end;
+        errno = 0;
+        unsigned long ul = strtoul(value, &end, 10);
+        if (errno || end == value || *end != '\0' || ul > INT_MAX)
+            error_msg("Error parsing %s setting: '%s'", "CrashRateInterval", value);
+        else
+            g_settings_crash_rate_interval = ul;
+        remove_map_string_item(settings, "CrashRateInterval");
+    }
+
+    value = get_map_string_item_or_NULL(settings, "MaxPostCreateJobs");
+    if (value)
+    {
+        char *end;
+        errno = 0;
+        unsigned long ul = strtoul(value, &end, 10);
+        if (errno || end == value || *end != '\0' || ul > INT_MAX)
+            error_msg("Error parsing %s setting: '%s'", "MaxPostCreateJobs", value);
+        else
+            g_settings_max_post_create_jobs = ul;
+        remove_map_string_item(settings, "MaxPostCreateJobs");
+    }
+
+    value = get_map_string_item_or_NULL(settings, "PostCreatePriorities");
+    if (value)
+    {
+        free(g_settings_post_create_priorities);
+        g_settings_post_create_priorities = xstrdup(value);
+        remove_map_string_item(settings, "PostCreatePriorities");
+    }
+
+    value = get_map_string_item_or_NULL(settings, "PostCreateAging");
+    if (value)
+    {
+        char *end;
+        errno = 0;
+        unsigned long ul = strtoul(value, &end, 10);
+        if (errno || end == value || *end != '\0' || ul > INT_MAX)
+            error_msg("Error parsing %s setting: '%s'", "PostCreateAging", value);
+        else
+            g_settings_post_create_aging = ul;
+        remove_map_string_item(settings, "PostCreateAging");
+    }
+
+    value = get_map_string_item_or_NULL(settings, "DegradeQueueLength");
+    if (value)
+    {
+        char *end;
+        errno = 0;
+        unsigned long ul = strtoul(value, &end, 10);
+        if (errno || end == value || *end != '\0' || ul > INT_MAX)
+            error_msg("Error parsing %s setting: '%s'", "DegradeQueueLength", value);
+        else
+            g_settings_degrade_queue_length = ul;
+        remove_map_string_item(settings, "DegradeQueueLength");
+    }
+
+    value = get_map_string_item_or_NULL(settings, "DegradeRate");
+    if (value)
+    {
+        char *end;
+        errno = 0;
+        unsigned long ul = strtoul(value, &end, 10);
+        if (errno || end == value || *end != '\0' || ul > INT_MAX)
+            error_msg("Error parsing %s setting: '%s'", "DegradeRate", value);
+        else
+            g_settings_degrade_rate = ul;
+        remove_map_string_item(settings, "DegradeRate");
+    }
+
     GHashTableIter iter;
     const char *name;
     /*char *value; - already declared */
@@ -0,0 +1,230 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Crash admission is a token bucket per executable and user shared by all
+ * processes detecting crashes. The buckets live in a small hash table in a
+ * memory mapped file in the root of the dump location.
+ *
+ * A bucket is a single 64bit word holding a tag of the executable and user in
+ * the upper half and the time in seconds when the bucket becomes full again
+ * (the theoretical arrival time of the generic cell rate algorithm) in the
+ * lower half. Admitting a crash moves the time by one refill interval forward.
+ * The time can be at most burst intervals ahead of the current time. A slot
+ * whose bucket is full is free for any other key. Claiming a slot and taking
+ * a token is a single compare-and-swap of the whole word, so the concurrent
+ * hooks never wait for each other and never take a token from a bucket
+ * somebody else has just claimed. Two hooks can still claim two free slots for
+ * one key at once; the claimers then merge the buckets into the first slot of
+ * the probe sequence.
+ */
+
+#include <sys/mman.h>
+#include "internal_libabrt.h"
+
+#define CRASH_ADMISSION_FILE_NAME ".crash-admission"
+#define CRASH_ADMISSION_SLOTS 1024
+/* Keep the probe sequence short; it is searched on every crash */
+#define CRASH_ADMISSION_MAX_PROBES 16
+
+#define BUCKET(tag, full_at) (((uint64_t)(tag) << 32) | (uint32_t)(full_at))
+#define BUCKET_TAG(bucket) ((uint32_t)((bucket) >> 32))
+#define BUCKET_FULL_AT(bucket) ((uint32_t)(bucket))
+
+static uint32_t crash_admission_tag(const char *executable, uid_t uid)
+{
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char *c;
+    for (c = (const unsigned char *)executable; *c != '\0'; ++c)
+        hash = (hash ^ *c) * 0x100000001b3ULL;
+
+    unsigned i;
+    for (i = 0; i < sizeof(uid); ++i)
+        hash = (hash ^ ((uid >> (i * 8)) & 0xff)) * 0x100000001b3ULL;
+
+    /* 0 marks an empty slot */
+    const uint32_t tag = hash ^ (hash >> 32);
+    return tag != 0 ? tag : 1;
+}
+
+static uint64_t *crash_admission_map(const char *dump_location)
+{
+    const size_t size = CRASH_ADMISSION_SLOTS * sizeof(uint64_t);
+    uint64_t *table = NULL;
+
+    char *path = concat_path_file(dump_location, CRASH_ADMISSION_FILE_NAME);
+    int fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        perror_msg("Can't open '%s'", path);
+        goto ret_map;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        perror_msg("Can't stat '%s'", path);
+        goto ret_close;
+    }
+
+    /* Concurrent creators extend the file to the same size, zeroes are
+     * empty slots */
+    if (st.st_size < (off_t)size && ftruncate(fd, size) < 0)
+    {
+        perror_msg("Can't resize '%s'", path);
+        goto ret_close;
+    }
+
+    table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (table == MAP_FAILED)
+    {
+        perror_msg("Can't map '%s'", path);
+        table = NULL;
+    }
+
+ ret_close:
+    close(fd);
+ ret_map:
+    free(path);
+    return table;
+}
+
+/* Takes a token from the bucket of tag in slot, which must either be the
+ * bucket of tag or a full bucket to be claimed. Returns 1 if the crash is
+ * admitted, 0 if the bucket is empty and -1 if the slot belongs to another
+ * tag.
+ */
+static int crash_admission_take(uint64_t *slot, uint32_t tag, uint32_t now,
+        uint32_t interval, uint32_t window)
+{
+    uint64_t bucket = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    for (;;)
+    {
+        uint32_t full_at = BUCKET_FULL_AT(bucket);
+        if (BUCKET_TAG(bucket) != tag)
+        {
+            /* Only a full bucket can change its owner */
+            if (bucket != 0 && full_at > now)
+                return -1;
+            full_at = now;
+        }
+
+        /* An empty bucket; full_at far in the future means the clock went
+         * backwards, start over in that case */
+        const uint32_t base = (full_at < now || full_at > now + window) ? now : full_at;
+        if (base + interval > now + window)
+            return 0;
+
+        if (__atomic_compare_exchange_n(slot, &bucket, BUCKET(tag, base + interval),
+                    /*weak:*/ false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return 1;
+        /* bucket holds the current value, retry */
+    }
+}
+
+/* Merges the buckets of tag into the first one in its probe sequence. The time
+ * the other buckets are ahead of now moves the first one forward, so no
+ * token taken by a concurrent claimer is lost.
+ */
+static void crash_admission_merge(uint64_t *table, uint32_t tag, uint32_t now, uint32_t window)
+{
+    uint64_t *first = NULL;
+    unsigned i;
+    for (i = 0; i < CRASH_ADMISSION_MAX_PROBES; ++i)
+    {
+        uint64_t *slot = &table[(tag + i) % CRASH_ADMISSION_SLOTS];
+        uint64_t bucket = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (BUCKET_TAG(bucket) != tag)
+            continue;
+
+        if (first == NULL)
+        {
+            first = slot;
+            continue;
+        }
+
+        /* Only one of the merging hooks releases the slot */
+        if (!__atomic_compare_exchange_n(slot, &bucket, 0,
+                    /*weak:*/ false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            continue;
+
+        const uint32_t ahead = BUCKET_FULL_AT(bucket) > now ? BUCKET_FULL_AT(bucket) - now : 0;
+        uint64_t first_bucket = __atomic_load_n(first, __ATOMIC_ACQUIRE);
+        /* Gives up if the first bucket has been reclaimed meanwhile */
+        while (BUCKET_TAG(first_bucket) == tag)
+        {
+            const uint32_t full_at = MAX(BUCKET_FULL_AT(first_bucket), now);
+            const uint32_t merged = MIN(full_at + ahead, now + window);
+            if (__atomic_compare_exchange_n(first, &first_bucket, BUCKET(tag, merged),
+                        /*weak:*/ false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                break;
+        }
+    }
+}
+
+int crash_admission_check(const char *dump_location, const char *executable, uid_t uid,
+        unsigned burst, unsigned interval_sec)
+{
+    INITIALIZE_LIBABRT();
+
+    if (burst == 0 || interval_sec == 0)
+        return 1;
+
+    uint64_t *table = crash_admission_map(dump_location);
+    if (!table)
+        /* Rather save a crash more than lose one */
+        return 1;
+
+    const uint32_t tag = crash_admission_tag(executable, uid);
+    const uint32_t now = time(NULL);
+    const uint32_t window = MIN((uint64_t)burst * interval_sec, UINT32_MAX / 4);
+    const uint32_t interval = MIN(interval_sec, window);
+
+    /* The bucket of the tag first, then any full bucket */
+    int admitted = -1;
+    unsigned pass, i;
+    for (pass = 0; pass < 2 && admitted < 0; ++pass)
+    {
+        for (i = 0; i < CRASH_ADMISSION_MAX_PROBES && admitted < 0; ++i)
+        {
+            uint64_t *slot = &table[(tag + i) % CRASH_ADMISSION_SLOTS];
+            const uint64_t bucket = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+            if (pass == 0 ? BUCKET_TAG(bucket) == tag
+                          : (bucket == 0 || BUCKET_FULL_AT(bucket) <= now))
+                admitted = crash_admission_take(slot, tag, now, interval, window);
+        }
+    }
+
+    /* A free slot was claimed in the second pass, a concurrent hook might
+     * have claimed another one for the tag */
+    if (pass == 2 && admitted >= 0)
+        crash_admission_merge(table, tag, now, window);
+
+    if (admitted < 0)
+    {
+        log_notice("Crash admission table is full, admitting '%s'", executable);
+        admitted = 1;
+    }
+    else
+        log_debug("Crash of '%s' (uid %lu) %s", executable, (long)uid,
+                admitted ? "admitted" : "exceeds the crash rate");
+
+    munmap(table, CRASH_ADMISSION_SLOTS * sizeof(uint64_t));
+    return admitted;
+}
@@ -0,0 +1,454 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* The crash frames are the frames of the crash thread of a core backtrace,
+ * each one reduced to a 64-bit key, so the duplicates can be found without
+ * parsing the JSON core backtraces of the older problems:
+ *
+ *   "ABRTCF01"
+ *   uint32_t  number of frames
+ *   uint64_t  key of every frame
+ *
+ * The numbers are in the host byte order, the file never leaves the machine.
+ * Two frames are similar if their keys are equal, as satyr compares the core
+ * frames: the function names, or the build ids and offsets if the function is
+ * not known, and the file names. Frames of "??" functions are never similar.
+ *
+ * The MinHash signature of the frames is stored in the duplicate index, so
+ * the threads that can't be similar are skipped without loading their frames.
+ * The signature is made of LSH_BANDS bands of LSH_ROWS minimum hashes of the
+ * known frames, the second occurrence of a frame is a different shingle than
+ * the first one. Two threads of the distance d have at least (1 - d) / (1 + d)
+ * of the shingles in common, so the threads of the duplicate threshold 0.3
+ * share a band with the probability of at least 99.5 %, the unrelated threads
+ * rarely do.
+ */
+
+#include <satyr/core/frame.h>
+#include <satyr/stacktrace.h>
+#include <satyr/thread.h>
+
+#include "internal_libabrt.h"
+
+#define CRASH_FRAMES_MAGIC "ABRTCF01"
+#define CRASH_FRAMES_HEADER_SIZE (sizeof(CRASH_FRAMES_MAGIC) - 1 + sizeof(uint32_t))
+/* Crash threads have a few dozen frames */
+#define CRASH_FRAMES_MAX_COUNT (64 * 1024)
+
+#define LSH_BANDS 16
+#define LSH_ROWS 2
+/* A band is written as 8 hex digits */
+#define LSH_BAND_LEN 8
+
+/* FNV-1a */
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for (; size > 0; --size, ++bytes)
+    {
+        hash ^= *bytes;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/* Hashes the terminating NUL too, so the fields can't run into each other */
+static uint64_t hash_str(uint64_t hash, const char *str)
+{
+    return hash_bytes(hash, str ? str : "", (str ? strlen(str) : 0) + 1);
+}
+
+static uint64_t crash_frame_key(const struct sr_core_frame *frame)
+{
+    if (frame->function_name != NULL && strcmp(frame->function_name, "??") == 0)
+        return CRASH_FRAME_UNKNOWN;
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    if (frame->function_name != NULL)
+    {
+        hash = hash_str(hash, "f");
+        hash = hash_str(hash, frame->function_name);
+    }
+    else
+    {
+        hash = hash_str(hash, "b");
+        hash = hash_str(hash, frame->build_id);
+        hash = hash_bytes(hash, &frame->build_id_offset, sizeof(frame->build_id_offset));
+    }
+    hash = hash_str(hash, frame->file_name);
+
+    /* Keep the unknown key for the unknown frames */
+    return hash == CRASH_FRAME_UNKNOWN ? 1 : hash;
+}
+
+uint64_t *crash_frames_from_core_backtrace(const char *core_backtrace, unsigned *count)
+{
+    INITIALIZE_LIBABRT();
+
+    char *error_message = NULL;
+    struct sr_stacktrace *stacktrace = sr_stacktrace_parse(SR_REPORT_CORE, core_backtrace, &error_message);
+    if (stacktrace == NULL)
+    {
+        log_notice("Failed to parse core backtrace: %s", error_message);
+        free(error_message);
+        return NULL;
+    }
+
+    uint64_t *frames = NULL;
+    struct sr_thread *thread = sr_stacktrace_find_crash_thread(stacktrace);
+    if (thread == NULL)
+    {
+        log_notice("Core backtrace has no crash thread");
+        goto ret;
+    }
+
+    *count = sr_thread_frame_count(thread);
+    frames = xmalloc(sizeof(*frames) * (*count + 1));
+
+    unsigned i = 0;
+    struct sr_frame *frame;
+    for (frame = sr_thread_frames(thread); frame != NULL && i < *count; frame = sr_frame_next(frame))
+        frames[i++] = crash_frame_key((struct sr_core_frame *)frame);
+    *count = i;
+
+ ret:
+    sr_stacktrace_free(stacktrace);
+    return frames;
+}
+
+void crash_frames_save(struct dump_dir *dd, const uint64_t *frames, unsigned count)
+{
+    INITIALIZE_LIBABRT();
+
+    const size_t size = CRASH_FRAMES_HEADER_SIZE + sizeof(*frames) * count;
+    char *data = xmalloc(size);
+    const uint32_t count32 = count;
+    memcpy(data, CRASH_FRAMES_MAGIC, sizeof(CRASH_FRAMES_MAGIC) - 1);
+    memcpy(data + sizeof(CRASH_FRAMES_MAGIC) - 1, &count32, sizeof(count32));
+    memcpy(data + CRASH_FRAMES_HEADER_SIZE, frames, sizeof(*frames) * count);
+
+    dd_save_binary(dd, FILENAME_CRASH_FRAMES, data, size);
+    free(data);
+}
+
+uint64_t *crash_frames_load(const struct dump_dir *dd, unsigned *count)
+{
+    INITIALIZE_LIBABRT();
+
+    uint64_t *frames = NULL;
+    char *data = NULL;
+    char *path = concat_path_file(dd->dd_dirname, FILENAME_CRASH_FRAMES);
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+            perror_msg("Can't open '%s'", path);
+        goto ret;
+    }
+
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode)
+        || (size_t)stat_buf.st_size < CRASH_FRAMES_HEADER_SIZE
+        || (size_t)stat_buf.st_size > CRASH_FRAMES_HEADER_SIZE + sizeof(*frames) * CRASH_FRAMES_MAX_COUNT)
+    {
+        log_notice("Ignoring invalid '%s'", path);
+        goto ret;
+    }
+
+    data = xmalloc(stat_buf.st_size);
+    if (full_read(fd, data, stat_buf.st_size) != stat_buf.st_size)
+    {
+        perror_msg("Can't read '%s'", path);
+        goto ret;
+    }
+
+    uint32_t count32;
+    memcpy(&count32, data + sizeof(CRASH_FRAMES_MAGIC) - 1, sizeof(count32));
+    if (memcmp(data, CRASH_FRAMES_MAGIC, sizeof(CRASH_FRAMES_MAGIC) - 1) != 0
+        || (size_t)stat_buf.st_size != CRASH_FRAMES_HEADER_SIZE + sizeof(*frames) * count32)
+    {
+        log_notice("Ignoring invalid '%s'", path);
+        goto ret;
+    }
+
+    *count = count32;
+    frames = xmalloc(sizeof(*frames) * (count32 + 1));
+    memcpy(frames, data + CRASH_FRAMES_HEADER_SIZE, sizeof(*frames) * count32);
+
+ ret:
+    if (fd >= 0)
+        close(fd);
+    free(data);
+    free(path);
+    return frames;
+}
+
+/* The largest number of edits of the distance up to max_distance */
+static unsigned max_edits(float max_distance, unsigned max_count)
+{
+    if (max_distance >= 1.0)
+        return max_count;
+
+    unsigned edits = max_distance * max_count + 1;
+    while (edits > 0 && (float)edits / max_count > max_distance)
+        --edits;
+    return edits;
+}
+
+/* The bit-parallel optimal string alignment distance of Hyyro, an extension
+ * of the Myers' algorithm to transpositions, on the blocks of 64 frames of
+ * ids1. The column of the dynamic programming matrix of one frame of ids2 is
+ * computed at once as the vertical positive and negative deltas.
+ */
+float frame_ids_distance(const uint32_t *ids1, unsigned count1,
+                         const uint32_t *ids2, unsigned count2,
+                         float max_distance)
+{
+    INITIALIZE_LIBABRT();
+
+    const unsigned max_count = MAX(count1, count2);
+    if (max_count == 0)
+        return 1.0;
+
+    const unsigned edits = max_edits(max_distance, max_count);
+    if (MAX(count1, count2) - MIN(count1, count2) > edits)
+        return 1.0;
+
+    if (count1 == 0 || count2 == 0)
+        return 1.0;
+
+    unsigned id_count = 1;
+    unsigned i, j, b;
+    for (i = 0; i < count1; ++i)
+        id_count = MAX(id_count, ids1[i] + 1);
+
+    /* The bit i of the row of id in block i / 64 is set if ids1[i] is id, the
+     * row of 0 stays empty */
+    const unsigned blocks = (count1 + 63) / 64;
+    uint64_t *peq = xzalloc(sizeof(*peq) * blocks * id_count);
+    for (i = 0; i < count1; ++i)
+    {
+        if (ids1[i] != 0)
+            peq[ids1[i] * blocks + i / 64] |= 1ULL << (i % 64);
+    }
+
+    /* The deltas and the diagonal zeros of the previous column */
+    uint64_t *vp = xmalloc(sizeof(*vp) * blocks * 3);
+    uint64_t *vn = vp + blocks;
+    uint64_t *d0 = vn + blocks;
+    for (b = 0; b < blocks; ++b)
+    {
+        vp[b] = ~0ULL;
+        vn[b] = 0;
+        d0[b] = 0;
+    }
+
+    const uint64_t last_bit = 1ULL << ((count1 - 1) % 64);
+    const uint64_t *eq_prev = peq;
+    unsigned dist = count1;
+    for (j = 0; j < count2; ++j)
+    {
+        const uint64_t *eq_row = peq + (ids2[j] < id_count ? ids2[j] : 0) * blocks;
+
+        /* The horizontal delta entering the block, the first row grows */
+        int h_in = 1;
+        uint64_t tr_carry = 0;
+        for (b = 0; b < blocks; ++b)
+        {
+            const uint64_t eq = eq_row[b];
+
+            /* Frames i - 1 and i transposed in ids2[j - 1] and ids2[j] */
+            const uint64_t tr_src = ~d0[b] & eq;
+            const uint64_t tr = ((tr_src << 1) | tr_carry) & eq_prev[b];
+            tr_carry = tr_src >> 63;
+
+            const uint64_t xv = eq | vn[b] | tr;
+            const uint64_t eq_h = h_in < 0 ? eq | 1 : eq;
+            const uint64_t xh = (((eq_h & vp[b]) + vp[b]) ^ vp[b]) | eq_h | tr;
+
+            uint64_t hp = vn[b] | ~(xh | vp[b]);
+            uint64_t hn = vp[b] & xh;
+
+            const uint64_t top_bit = b == blocks - 1 ? last_bit : 1ULL << 63;
+            const int h_out = (hp & top_bit) ? 1 : (hn & top_bit) ? -1 : 0;
+
+            hp = (hp << 1) | (h_in > 0);
+            hn = (hn << 1) | (h_in < 0);
+
+            vp[b] = hn | ~(xv | hp);
+            vn[b] = hp & xv;
+            d0[b] = xh | xv;
+            h_in = h_out;
+        }
+
+        /* h_in is the delta of the last row now */
+        dist += h_in;
+
+        /* The distance decreases by one per frame at most */
+        if (dist > edits + (count2 - j - 1))
+        {
+            dist = max_count;
+            break;
+        }
+
+        eq_prev = eq_row;
+    }
+
+    free(vp);
+    free(peq);
+
+    if (dist > edits)
+        return 1.0;
+
+    return (float)dist / max_count;
+}
+
+static int compare_frames(const void *frame1, const void *frame2)
+{
+    const uint64_t key1 = *(const uint64_t *)frame1;
+    const uint64_t key2 = *(const uint64_t *)frame2;
+    return (key1 > key2) - (key1 < key2);
+}
+
+/* The index of the frame in the sorted unique frames plus one, 0 for the
+ * unknown frames and the frames that are not there */
+static uint32_t frame_id(uint64_t frame, const uint64_t *unique, unsigned unique_count)
+{
+    if (frame == CRASH_FRAME_UNKNOWN)
+        return 0;
+
+    const uint64_t *found = bsearch(&frame, unique, unique_count, sizeof(*unique), compare_frames);
+    return found ? found - unique + 1 : 0;
+}
+
+float crash_frames_distance(const uint64_t *frames1, unsigned count1,
+                            const uint64_t *frames2, unsigned count2,
+                            float max_distance)
+{
+    INITIALIZE_LIBABRT();
+
+    /* Intern the frames of the first thread, the other frames of the second
+     * thread can't be similar to any of them */
+    uint64_t *unique = xmalloc(sizeof(*unique) * (count1 + 1));
+    memcpy(unique, frames1, sizeof(*unique) * count1);
+    qsort(unique, count1, sizeof(*unique), compare_frames);
+    unsigned unique_count = 0;
+    unsigned i;
+    for (i = 0; i < count1; ++i)
+    {
+        if (unique_count == 0 || unique[unique_count - 1] != unique[i])
+            unique[unique_count++] = unique[i];
+    }
+
+    uint32_t *ids1 = xmalloc(sizeof(*ids1) * (count1 + count2 + 1));
+    uint32_t *ids2 = ids1 + count1;
+    for (i = 0; i < count1; ++i)
+        ids1[i] = frame_id(frames1[i], unique, unique_count);
+    for (i = 0; i < count2; ++i)
+        ids2[i] = frame_id(frames2[i], unique, unique_count);
+
+    const float distance = frame_ids_distance(ids1, count1, ids2, count2, max_distance);
+
+    free(ids1);
+    free(unique);
+    return distance;
+}
+
+/* splitmix64 finalizer */
+static uint64_t mix_hash(uint64_t hash)
+{
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+char *crash_frames_lsh_signature(const uint64_t *frames, unsigned count)
+{
+    INITIALIZE_LIBABRT();
+
+    /* The shingles are a multiset, the order of the frames doesn't matter */
+    uint64_t *sorted = xmalloc(sizeof(*sorted) * (count + 1));
+    memcpy(sorted, frames, sizeof(*sorted) * count);
+    qsort(sorted, count, sizeof(*sorted), compare_frames);
+
+    uint64_t minhash[LSH_BANDS * LSH_ROWS];
+    unsigned h;
+    for (h = 0; h < ARRAY_SIZE(minhash); ++h)
+        minhash[h] = UINT64_MAX;
+
+    bool known = false;
+    uint64_t occurrence = 0;
+    unsigned i;
+    for (i = 0; i < count; ++i)
+    {
+        if (sorted[i] == CRASH_FRAME_UNKNOWN)
+            continue;
+
+        occurrence = (i > 0 && sorted[i - 1] == sorted[i]) ? occurrence + 1 : 0;
+        const uint64_t shingle = mix_hash(sorted[i] ^ mix_hash(occurrence));
+        for (h = 0; h < ARRAY_SIZE(minhash); ++h)
+        {
+            /* A differently seeded hash function for every row */
+            const uint64_t hash = mix_hash(shingle + (h + 1) * 0x9e3779b97f4a7c15ULL);
+            minhash[h] = MIN(minhash[h], hash);
+        }
+        known = true;
+    }
+    free(sorted);
+
+    if (!known)
+        return NULL;
+
+    char *signature = xmalloc(LSH_BANDS * LSH_BAND_LEN + 1);
+    unsigned band;
+    for (band = 0; band < LSH_BANDS; ++band)
+    {
+        uint64_t hash = FNV_OFFSET_BASIS;
+        hash = hash_bytes(hash, minhash + band * LSH_ROWS, sizeof(*minhash) * LSH_ROWS);
+        sprintf(signature + band * LSH_BAND_LEN, "%08x", (unsigned)(mix_hash(hash) >> 32));
+    }
+
+    return signature;
+}
+
+bool crash_frames_lsh_match(const char *signature1, const char *signature2)
+{
+    INITIALIZE_LIBABRT();
+
+    /* Unknown signatures can't rule out anything */
+    if (strlen(signature1) != LSH_BANDS * LSH_BAND_LEN
+        || strlen(signature2) != LSH_BANDS * LSH_BAND_LEN)
+        return true;
+
+    unsigned band;
+    for (band = 0; band < LSH_BANDS; ++band)
+    {
+        if (memcmp(signature1 + band * LSH_BAND_LEN, signature2 + band * LSH_BAND_LEN, LSH_BAND_LEN) == 0)
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,457 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* The size index remembers the size and the modification time of every entry
+ * of a directory, so the size of the directory and the best candidate for
+ * deletion can be found without walking all the problem directories.
+ *
+ * A problem directory is walked again only if its modification time differs
+ * from the indexed one; adding or removing an item changes it. Hidden entries
+ * belong to ABRT itself, they are neither indexed nor deleted.
+ *
+ * The candidates for deletion are kept in a binary max-heap ordered by their
+ * weight. The weights depend on the current time, so the heap is rebuilt
+ * when its weights are older than a minute. The index is persisted in a file
+ * in the indexed directory:
+ *
+ *   NAME<TAB>SIZE<TAB>MTIME_SEC<TAB>MTIME_NSEC<TAB>IS_DIR
+ */
+
+#include "internal_libabrt.h"
+
+#define DIR_SIZE_INDEX_FILE_NAME ".dir-size-index"
+#define DIR_SIZE_HEAP_MAX_AGE 60
+
+struct dir_size_entry
+{
+    const char *name;   /* the key in the entries table */
+    double size;
+    long long mtime_sec;
+    long mtime_nsec;
+    bool is_dir;
+    unsigned generation;
+    double weight;
+    int heap_pos;       /* -1 if not a candidate for deletion */
+};
+
+struct dir_size_index
+{
+    char *dirname;
+    /* name -> struct dir_size_entry */
+    GHashTable *entries;
+    double total;
+    unsigned generation;
+    /* struct dir_size_entry *, the heaviest first */
+    GPtrArray *heap;
+    time_t heap_time;
+};
+
+/* The same "weighted" size and age as get_dirsize_find_largest_dir() uses:
+ * w = sz_kbytes * age_mins */
+static double dir_size_entry_weight(const struct dir_size_entry *entry, time_t cur_time)
+{
+    double weight = entry->size / 1024;
+    const long age = (cur_time - entry->mtime_sec) / 60;
+    if (age > 1)
+        weight *= age;
+    return weight;
+}
+
+static void dir_size_heap_set(dir_size_index_t *index, int pos, struct dir_size_entry *entry)
+{
+    index->heap->pdata[pos] = entry;
+    entry->heap_pos = pos;
+}
+
+static void dir_size_heap_sift_up(dir_size_index_t *index, int pos)
+{
+    struct dir_size_entry *entry = index->heap->pdata[pos];
+    while (pos > 0)
+    {
+        const int parent = (pos - 1) / 2;
+        struct dir_size_entry *parent_entry = index->heap->pdata[parent];
+        if (parent_entry->weight >= entry->weight)
+            break;
+        dir_size_heap_set(index, pos, parent_entry);
+        pos = parent;
+    }
+    dir_size_heap_set(index, pos, entry);
+}
+
+static void dir_size_heap_sift_down(dir_size_index_t *index, int pos)
+{
+    const int len = index->heap->len;
+    struct dir_size_entry *entry = index->heap->pdata[pos];
+    for (;;)
+    {
+        int child = 2 * pos + 1;
+        if (child >= len)
+            break;
+        struct dir_size_entry *child_entry = index->heap->pdata[child];
+        if (child + 1 < len)
+        {
+            struct dir_size_entry *right_entry = index->heap->pdata[child + 1];
+            if (right_entry->weight > child_entry->weight)
+            {
+                child_entry = right_entry;
+                ++child;
+            }
+        }
+        if (entry->weight >= child_entry->weight)
+            break;
+        dir_size_heap_set(index, pos, child_entry);
+        pos = child;
+    }
+    dir_size_heap_set(index, pos, entry);
+}
+
+static void dir_size_heap_remove(dir_size_index_t *index, struct dir_size_entry *entry)
+{
+    const int pos = entry->heap_pos;
+    if (pos < 0)
+        return;
+
+    entry->heap_pos = -1;
+    struct dir_size_entry *last = g_ptr_array_remove_index(index->heap, index->heap->len - 1);
+    if (last == entry)
+        return;
+
+    dir_size_heap_set(index, pos, last);
+    dir_size_heap_sift_up(index, pos);
+    dir_size_heap_sift_down(index, last->heap_pos);
+}
+
+/* Adds the entry to the heap or moves it after its size has changed */
+static void dir_size_heap_update(dir_size_index_t *index, struct dir_size_entry *entry)
+{
+    /* Only directories are candidates */
+    if (!entry->is_dir)
+    {
+        dir_size_heap_remove(index, entry);
+        return;
+    }
+
+    entry->weight = dir_size_entry_weight(entry, index->heap_time);
+    if (entry->heap_pos < 0)
+    {
+        g_ptr_array_add(index->heap, entry);
+        entry->heap_pos = index->heap->len - 1;
+    }
+    dir_size_heap_sift_up(index, entry->heap_pos);
+    dir_size_heap_sift_down(index, entry->heap_pos);
+}
+
+static void dir_size_heap_rebuild(dir_size_index_t *index, time_t cur_time)
+{
+    index->heap_time = cur_time;
+    for (int pos = 0; pos < (int)index->heap->len; ++pos)
+    {
+        struct dir_size_entry *entry = index->heap->pdata[pos];
+        entry->weight = dir_size_entry_weight(entry, cur_time);
+    }
+    for (int pos = (int)index->heap->len / 2 - 1; pos >= 0; --pos)
+        dir_size_heap_sift_down(index, pos);
+}
+
+static struct dir_size_entry *dir_size_index_put(dir_size_index_t *index, const char *name)
+{
+    struct dir_size_entry *entry = g_hash_table_lookup(index->entries, name);
+    if (entry == NULL)
+    {
+        entry = xzalloc(sizeof(*entry));
+        entry->heap_pos = -1;
+        entry->name = xstrdup(name);
+        g_hash_table_insert(index->entries, (char *)entry->name, entry);
+    }
+    else
+        index->total -= entry->size;
+
+    return entry;
+}
+
+static void dir_size_index_drop(dir_size_index_t *index, struct dir_size_entry *entry)
+{
+    index->total -= entry->size;
+    dir_size_heap_remove(index, entry);
+}
+
+static void dir_size_index_load(dir_size_index_t *index)
+{
+    char *path = concat_path_file(index->dirname, DIR_SIZE_INDEX_FILE_NAME);
+    FILE *fp = fopen(path, "re");
+    if (fp == NULL)
+    {
+        if (errno != ENOENT)
+            perror_msg("Can't open size index '%s'", path);
+        free(path);
+        return;
+    }
+
+    char *line;
+    while ((line = xmalloc_fgetline(fp)) != NULL)
+    {
+        char *name_end = strchr(line, '\t');
+        double size;
+        long long mtime_sec;
+        long mtime_nsec;
+        int is_dir;
+        if (name_end != NULL && name_end != line && line[0] != '.'
+            && sscanf(name_end + 1, "%lf\t%lld\t%ld\t%d", &size, &mtime_sec, &mtime_nsec, &is_dir) == 4)
+        {
+            *name_end = '\0';
+            struct dir_size_entry *entry = dir_size_index_put(index, line);
+            entry->size = size;
+            entry->mtime_sec = mtime_sec;
+            entry->mtime_nsec = mtime_nsec;
+            entry->is_dir = is_dir;
+            index->total += size;
+            dir_size_heap_update(index, entry);
+        }
+        else
+            log_notice("Ignoring malformed line in size index '%s'", path);
+
+        free(line);
+    }
+
+    fclose(fp);
+    free(path);
+}
+
+dir_size_index_t *dir_size_index_new(const char *dirname)
+{
+    INITIALIZE_LIBABRT();
+
+    dir_size_index_t *index = xzalloc(sizeof(*index));
+    index->dirname = xstrdup(dirname);
+    index->entries = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+    index->heap = g_ptr_array_new();
+    index->heap_time = time(NULL);
+    dir_size_index_load(index);
+    return index;
+}
+
+void dir_size_index_free(dir_size_index_t *index)
+{
+    if (index == NULL)
+        return;
+
+    g_ptr_array_free(index->heap, TRUE);
+    g_hash_table_destroy(index->entries);
+    free(index->dirname);
+    free(index);
+}
+
+/* Returns true if the entry had to be walked */
+static bool dir_size_index_stat(dir_size_index_t *index, const char *name, const struct stat *st)
+{
+    struct dir_size_entry *entry = g_hash_table_lookup(index->entries, name);
+    if (entry != NULL && S_ISDIR(st->st_mode)
+        && entry->mtime_sec == (long long)st->st_mtim.tv_sec
+        && entry->mtime_nsec == st->st_mtim.tv_nsec)
+    {
+        entry->generation = index->generation;
+        return false;
+    }
+
+    entry = dir_size_index_put(index, name);
+    entry->generation = index->generation;
+    entry->mtime_sec = st->st_mtim.tv_sec;
+    entry->mtime_nsec = st->st_mtim.tv_nsec;
+    entry->is_dir = S_ISDIR(st->st_mode);
+    if (entry->is_dir)
+    {
+        char *path = concat_path_file(index->dirname, name);
+        entry->size = get_dirsize(path);
+        free(path);
+    }
+    else
+        entry->size = S_ISREG(st->st_mode) ? st->st_size : 0;
+
+    index->total += entry->size;
+    dir_size_heap_update(index, entry);
+    return S_ISDIR(st->st_mode);
+}
+
+static gboolean dir_size_index_is_stale(gpointer name, gpointer value, gpointer index)
+{
+    struct dir_size_entry *entry = value;
+    if (entry->generation == ((dir_size_index_t *)index)->generation)
+        return FALSE;
+
+    dir_size_index_drop(index, entry);
+    return TRUE;
+}
+
+unsigned dir_size_index_sync(dir_size_index_t *index)
+{
+    DIR *dir = opendir(index->dirname);
+    if (dir == NULL)
+    {
+        if (errno != ENOENT)
+            perror_msg("Can't open '%s'", index->dirname);
+        g_ptr_array_set_size(index->heap, 0);
+        g_hash_table_remove_all(index->entries);
+        index->total = 0;
+        return 0;
+    }
+
+    ++index->generation;
+    unsigned walked = 0;
+    struct dirent *dent;
+    while ((dent = readdir(dir)) != NULL)
+    {
+        /* Hidden entries including the index itself are used by ABRT */
+        if (dent->d_name[0] == '.')
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), dent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+
+        if (dir_size_index_stat(index, dent->d_name, &st))
+            ++walked;
+    }
+    closedir(dir);
+
+    g_hash_table_foreach_remove(index->entries, dir_size_index_is_stale, index);
+
+    log_debug("Synchronized size index of '%s': %u entries, %u walked, %.0f bytes",
+            index->dirname, g_hash_table_size(index->entries), walked, index->total);
+    return walked;
+}
+
+void dir_size_index_update(dir_size_index_t *index, const char *name)
+{
+    if (name[0] == '.')
+        return;
+
+    char *path = concat_path_file(index->dirname, name);
+    struct stat st;
+    const int r = lstat(path, &st);
+    free(path);
+
+    if (r != 0)
+    {
+        dir_size_index_remove(index, name);
+        return;
+    }
+
+    /* Force walking of the directory, its modification time does not
+     * change if an item has been rewritten in place */
+    struct dir_size_entry *entry = g_hash_table_lookup(index->entries, name);
+    if (entry != NULL)
+        entry->mtime_nsec = -1;
+
+    dir_size_index_stat(index, name, &st);
+}
+
+void dir_size_index_remove(dir_size_index_t *index, const char *name)
+{
+    struct dir_size_entry *entry = g_hash_table_lookup(index->entries, name);
+    if (entry == NULL)
+        return;
+
+    dir_size_index_drop(index, entry);
+    g_hash_table_remove(index->entries, name);
+}
+
+double dir_size_index_total(dir_size_index_t *index)
+{
+    /* Avoid accumulated rounding errors going below zero */
+    return index->total > 0 ? index->total : 0;
+}
+
+char *dir_size_index_find_worst(dir_size_index_t *index, GList *excluded)
+{
+    const time_t cur_time = time(NULL);
+    if (cur_time - index->heap_time >= DIR_SIZE_HEAP_MAX_AGE || cur_time < index->heap_time)
+        dir_size_heap_rebuild(index, cur_time);
+
+    /* Set the excluded ones aside until a candidate is on the top */
+    GList *skipped = NULL;
+    struct dir_size_entry *worst = NULL;
+    while (index->heap->len != 0)
+    {
+        worst = index->heap->pdata[0];
+        if (g_list_find_custom(excluded, worst->name, (GCompareFunc)strcmp) == NULL)
+            break;
+
+        dir_size_heap_remove(index, worst);
+        skipped = g_list_prepend(skipped, worst);
+        worst = NULL;
+    }
+
+    for (GList *item = skipped; item != NULL; item = g_list_next(item))
+        dir_size_heap_update(index, item->data);
+    g_list_free(skipped);
+
+    return worst && worst->weight > 0 ? xstrdup(worst->name) : NULL;
+}
+
+int dir_size_index_save(dir_size_index_t *index)
+{
+    struct strbuf *content = strbuf_new();
+
+    GHashTableIter iter;
+    gpointer name, value;
+    g_hash_table_iter_init(&iter, index->entries);
+    while (g_hash_table_iter_next(&iter, &name, &value))
+    {
+        const struct dir_size_entry *entry = value;
+        /* Names breaking the format are walked every time */
+        if (strpbrk(name, "\t\n") != NULL)
+            continue;
+
+        strbuf_append_strf(content, "%s\t%.0f\t%lld\t%ld\t%d\n", (const char *)name,
+                entry->size, entry->mtime_sec, entry->mtime_nsec, entry->is_dir);
+    }
+
+    int r = -1;
+    char *path = concat_path_file(index->dirname, DIR_SIZE_INDEX_FILE_NAME);
+    char *tmp_path = xasprintf("%s.%lu", path, (long)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        perror_msg("Can't create size index '%s'", tmp_path);
+        goto ret;
+    }
+
+    const ssize_t written = full_write(fd, content->buf, content->len);
+    if (close(fd) != 0 || written != (ssize_t)content->len)
+    {
+        perror_msg("Can't write size index '%s'", tmp_path);
+        unlink(tmp_path);
+        goto ret;
+    }
+
+    if (rename(tmp_path, path) != 0)
+    {
+        perror_msg("Can't rename '%s' to '%s'", tmp_path, path);
+        unlink(tmp_path);
+        goto ret;
+    }
+
+    r = 0;
+
+ ret:
+    free(tmp_path);
+    free(path);
+    strbuf_free(content);
+    return r;
+}
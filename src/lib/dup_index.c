@@ -0,0 +1,501 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* The duplicate index is a pair of plain text files in the root of the dump
+ * location. Every row maps a value of a problem element to a problem
+ * directory:
+ *
+ *   NAME<TAB>VALUE<TAB>DIRECTORY BASENAME
+ *
+ * The writers append their rows to the log file under the lock of the index
+ * file. A later row of the same NAME and DIRECTORY supersedes the earlier
+ * ones. Once the log grows as large as the index, the writer compacts both to
+ * the index file with the latest rows of the existing directories only.
+ *
+ * The readers load both files into a hash table keyed by NAME and DIRECTORY.
+ * The file names start with a dot, so all the tools walking the dump location
+ * skip them. The index is only a cache; rows pointing to deleted directories
+ * are ignored by the readers.
+ */
+
+#include <sys/file.h>
+#include "internal_libabrt.h"
+
+#define DUP_INDEX_FILE_NAME ".dup-index"
+#define DUP_INDEX_LOG_FILE_NAME ".dup-index-log"
+#define DUP_INDEX_COLUMN_DELIMITER '\t'
+/* Do not compact small logs, the rewrite costs more than the replay */
+#define DUP_INDEX_MIN_COMPACT_SIZE (64 * 1024)
+
+struct dup_index_row
+{
+    const char *name;
+    const char *value;
+    const char *dir_name;
+    /* The order of the row in the files */
+    unsigned long seq;
+};
+
+/* The rows of the index, the strings point to the loaded content */
+struct dup_index
+{
+    char *content;
+    char *log_content;
+    /* struct dup_index_row -> itself, keyed by name and dir_name */
+    GHashTable *rows;
+    unsigned long seq;
+};
+
+static int dup_index_open(const char *dump_location, int flags, int operation)
+{
+    char *path = concat_path_file(dump_location, DUP_INDEX_FILE_NAME);
+    int fd = open(path, flags | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        if (errno != ENOENT)
+            perror_msg("Can't open duplicate index '%s'", path);
+        goto ret_open;
+    }
+
+    if (flock(fd, operation) < 0)
+    {
+        perror_msg("Can't lock duplicate index '%s'", path);
+        close(fd);
+        fd = -1;
+    }
+
+ ret_open:
+    free(path);
+    return fd;
+}
+
+/* The log is guarded by the lock of the index file */
+static int dup_index_open_log(const char *dump_location, int flags)
+{
+    char *path = concat_path_file(dump_location, DUP_INDEX_LOG_FILE_NAME);
+    int fd = open(path, flags | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0 && errno != ENOENT)
+        perror_msg("Can't open duplicate index '%s'", path);
+    free(path);
+    return fd;
+}
+
+static bool dup_index_valid_column(const char *column)
+{
+    return column[0] != '\0' && strpbrk(column, "\t\n") == NULL;
+}
+
+/* Splits the row in place. Returns false for malformed rows. */
+static bool dup_index_parse_row(char *row, char **name, char **value, char **dir_name)
+{
+    *name = row;
+    *value = strchr(row, DUP_INDEX_COLUMN_DELIMITER);
+    if (*value == NULL)
+        return false;
+    *(*value)++ = '\0';
+
+    *dir_name = strchr(*value, DUP_INDEX_COLUMN_DELIMITER);
+    if (*dir_name == NULL)
+        return false;
+    *(*dir_name)++ = '\0';
+
+    /* Never let the index point out of the dump location */
+    return (*dir_name)[0] != '\0' && (*dir_name)[0] != '.' && strchr(*dir_name, '/') == NULL;
+}
+
+static guint dup_index_row_hash(gconstpointer key)
+{
+    const struct dup_index_row *row = key;
+    return g_str_hash(row->name) * 31 + g_str_hash(row->dir_name);
+}
+
+static gboolean dup_index_row_equal(gconstpointer a, gconstpointer b)
+{
+    const struct dup_index_row *ra = a;
+    const struct dup_index_row *rb = b;
+    return strcmp(ra->name, rb->name) == 0 && strcmp(ra->dir_name, rb->dir_name) == 0;
+}
+
+static int dup_index_row_cmp(const void *a, const void *b)
+{
+    const struct dup_index_row *ra = *(const struct dup_index_row **)a;
+    const struct dup_index_row *rb = *(const struct dup_index_row **)b;
+    return (ra->seq > rb->seq) - (ra->seq < rb->seq);
+}
+
+/* Replays the rows of the content, of the name only unless it is NULL */
+static void dup_index_replay(struct dup_index *index, char *content, const char *name)
+{
+    char *line = content;
+    char *newline;
+    /* A torn last row is ignored */
+    while ((newline = strchr(line, '\n')) != NULL)
+    {
+        *newline = '\0';
+
+        char *row_name, *row_value, *row_dir_name;
+        if (dup_index_parse_row(line, &row_name, &row_value, &row_dir_name)
+            && (name == NULL || strcmp(row_name, name) == 0))
+        {
+            struct dup_index_row *row = xmalloc(sizeof(*row));
+            row->name = row_name;
+            row->value = row_value;
+            row->dir_name = row_dir_name;
+            row->seq = ++index->seq;
+            /* Supersedes the earlier row of the directory */
+            g_hash_table_replace(index->rows, row, row);
+        }
+
+        line = newline + 1;
+    }
+}
+
+/* Loads the rows of the name, all rows if it is NULL. The index file must be
+ * locked. */
+static bool dup_index_load(struct dup_index *index, int fd, int log_fd, const char *name)
+{
+    memset(index, 0, sizeof(*index));
+    index->rows = g_hash_table_new_full(dup_index_row_hash, dup_index_row_equal, free, NULL);
+
+    if (lseek(fd, 0, SEEK_SET) < 0
+        || (index->content = xmalloc_read(fd, NULL)) == NULL
+        || (log_fd >= 0 && (lseek(log_fd, 0, SEEK_SET) < 0
+                            || (index->log_content = xmalloc_read(log_fd, NULL)) == NULL)))
+    {
+        perror_msg("Can't read duplicate index");
+        return false;
+    }
+
+    dup_index_replay(index, index->content, name);
+    if (index->log_content)
+        dup_index_replay(index, index->log_content, name);
+    return true;
+}
+
+static void dup_index_destroy(struct dup_index *index)
+{
+    g_hash_table_destroy(index->rows);
+    free(index->log_content);
+    free(index->content);
+}
+
+/* Loads the rows of the name of the index in dump_location */
+static bool dup_index_read(const char *dump_location, const char *name, struct dup_index *index)
+{
+    int fd = dup_index_open(dump_location, O_RDONLY, LOCK_SH);
+    if (fd < 0)
+        return false;
+
+    int log_fd = dup_index_open_log(dump_location, O_RDONLY);
+    const bool loaded = dup_index_load(index, fd, log_fd, name);
+    if (!loaded)
+        dup_index_destroy(index);
+
+    if (log_fd >= 0)
+        close(log_fd);
+    /* Releases the lock too */
+    close(fd);
+    return loaded;
+}
+
+/* Returns the rows with the value, the most recently indexed last */
+static GPtrArray *dup_index_rows_with_value(struct dup_index *index, const char *value)
+{
+    GPtrArray *rows = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer row;
+    g_hash_table_iter_init(&iter, index->rows);
+    while (g_hash_table_iter_next(&iter, &row, NULL))
+    {
+        if (strcmp(((struct dup_index_row *)row)->value, value) == 0)
+            g_ptr_array_add(rows, row);
+    }
+
+    g_ptr_array_sort(rows, dup_index_row_cmp);
+    return rows;
+}
+
+static bool dup_index_dir_exists(const char *dump_location, const char *dir_name)
+{
+    struct stat st;
+    char *path = concat_path_file(dump_location, dir_name);
+    const bool exists = lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    free(path);
+    return exists;
+}
+
+char *dup_index_find(const char *dump_location, const char *name, const char *value)
+{
+    INITIALIZE_LIBABRT();
+
+    struct dup_index index;
+    if (!dup_index_read(dump_location, name, &index))
+        return NULL;
+
+    /* The most recently indexed existing directory wins */
+    char *found = NULL;
+    GPtrArray *rows = dup_index_rows_with_value(&index, value);
+    unsigned i;
+    for (i = rows->len; i > 0 && found == NULL; --i)
+    {
+        const struct dup_index_row *row = g_ptr_array_index(rows, i - 1);
+        if (dup_index_dir_exists(dump_location, row->dir_name))
+            found = xstrdup(row->dir_name);
+    }
+
+    g_ptr_array_free(rows, TRUE);
+    dup_index_destroy(&index);
+
+    if (found)
+        log_notice("Duplicate index: '%s' of '%s' is in '%s'", name, value, found);
+
+    return found;
+}
+
+GList *dup_index_find_all(const char *dump_location, const char *name, const char *value, bool *indexed)
+{
+    INITIALIZE_LIBABRT();
+
+    *indexed = false;
+
+    struct dup_index index;
+    if (!dup_index_read(dump_location, name, &index))
+        return NULL;
+
+    *indexed = g_hash_table_size(index.rows) > 0;
+
+    /* The most recently indexed directories go first */
+    GList *found = NULL;
+    GPtrArray *rows = dup_index_rows_with_value(&index, value);
+    unsigned i;
+    for (i = 0; i < rows->len; ++i)
+    {
+        const struct dup_index_row *row = g_ptr_array_index(rows, i);
+        if (dup_index_dir_exists(dump_location, row->dir_name))
+            found = g_list_prepend(found, xstrdup(row->dir_name));
+    }
+
+    g_ptr_array_free(rows, TRUE);
+    dup_index_destroy(&index);
+
+    log_notice("Duplicate index: %u directories with '%s' of '%s'", g_list_length(found), name, value);
+    return found;
+}
+
+GHashTable *dup_index_find_values(const char *dump_location, const char *name, GList *dir_names)
+{
+    INITIALIZE_LIBABRT();
+
+    GHashTable *values = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+
+    struct dup_index index;
+    if (!dup_index_read(dump_location, name, &index))
+        return values;
+
+    for (; dir_names != NULL; dir_names = g_list_next(dir_names))
+    {
+        const struct dup_index_row key = { .name = name, .dir_name = dir_names->data };
+        const struct dup_index_row *row = g_hash_table_lookup(index.rows, &key);
+        if (row)
+            g_hash_table_replace(values, xstrdup(row->dir_name), xstrdup(row->value));
+    }
+
+    dup_index_destroy(&index);
+    return values;
+}
+
+static bool dup_index_valid_dir_name(const char *dir_name)
+{
+    return dup_index_valid_column(dir_name) && dir_name[0] != '.' && strchr(dir_name, '/') == NULL;
+}
+
+/* The names of the problem directories in the dump location, NULL if the
+ * dump location can't be listed */
+static GHashTable *dup_index_list_dirs(const char *dump_location)
+{
+    DIR *dp = opendir(dump_location);
+    if (!dp)
+    {
+        perror_msg("Can't open directory '%s'", dump_location);
+        return NULL;
+    }
+
+    GHashTable *dirs = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    struct dirent *dent;
+    while ((dent = readdir(dp)) != NULL)
+    {
+        if (dent->d_name[0] == '.')
+            continue;
+
+        if (dent->d_type == DT_DIR || dent->d_type == DT_UNKNOWN)
+            g_hash_table_add(dirs, xstrdup(dent->d_name));
+    }
+    closedir(dp);
+
+    return dirs;
+}
+
+/* Rewrites the index with the latest rows of the existing directories and
+ * empties the log. The index file must be locked exclusively. */
+static void dup_index_compact(const char *dump_location, int fd, int log_fd)
+{
+    struct dup_index index;
+    if (!dup_index_load(&index, fd, log_fd, /*all names*/NULL))
+    {
+        dup_index_destroy(&index);
+        return;
+    }
+
+    GHashTable *dirs = dup_index_list_dirs(dump_location);
+
+    /* Keep the order, the most recently indexed rows win */
+    GPtrArray *rows = g_ptr_array_new();
+    GHashTableIter iter;
+    gpointer row;
+    g_hash_table_iter_init(&iter, index.rows);
+    while (g_hash_table_iter_next(&iter, &row, NULL))
+    {
+        if (dirs == NULL || g_hash_table_contains(dirs, ((struct dup_index_row *)row)->dir_name))
+            g_ptr_array_add(rows, row);
+    }
+    g_ptr_array_sort(rows, dup_index_row_cmp);
+
+    struct strbuf *content = strbuf_new();
+    unsigned i;
+    for (i = 0; i < rows->len; ++i)
+    {
+        const struct dup_index_row *r = g_ptr_array_index(rows, i);
+        strbuf_append_strf(content, "%s\t%s\t%s\n", r->name, r->value, r->dir_name);
+    }
+
+    /* Losing the log after a failed rewrite only loses a part of the cache */
+    if (lseek(fd, 0, SEEK_SET) < 0
+        || ftruncate(fd, 0) < 0
+        || full_write(fd, content->buf, content->len) != (ssize_t)content->len
+        || ftruncate(log_fd, 0) < 0)
+        perror_msg("Can't compact duplicate index in '%s'", dump_location);
+    else
+        log_debug("Compacted duplicate index in '%s' to %u rows", dump_location, rows->len);
+
+    strbuf_free(content);
+    g_ptr_array_free(rows, TRUE);
+    if (dirs)
+        g_hash_table_destroy(dirs);
+    dup_index_destroy(&index);
+}
+
+/* Appends the rows of the name in values (dir name -> value) to the log of the
+ * index of dump_location, they supersede the earlier rows of the directories.
+ */
+static int dup_index_write(const char *dump_location, const char *name, GHashTable *values)
+{
+    int fd = dup_index_open(dump_location, O_RDWR | O_CREAT, LOCK_EX);
+    if (fd < 0)
+        return -1;
+
+    int r = -1;
+    int log_fd = dup_index_open_log(dump_location, O_RDWR | O_CREAT | O_APPEND);
+    if (log_fd < 0)
+        goto ret;
+
+    struct stat st, log_st;
+    if (fstat(fd, &st) != 0 || fstat(log_fd, &log_st) != 0)
+    {
+        perror_msg("Can't stat duplicate index in '%s'", dump_location);
+        goto ret;
+    }
+
+    struct strbuf *rows = strbuf_new();
+
+    /* Do not let the first row continue a torn one */
+    char last = '\n';
+    if (log_st.st_size > 0 && pread(log_fd, &last, 1, log_st.st_size - 1) == 1 && last != '\n')
+        strbuf_append_char(rows, '\n');
+
+    GHashTableIter iter;
+    gpointer dir_name, value;
+    g_hash_table_iter_init(&iter, values);
+    while (g_hash_table_iter_next(&iter, &dir_name, &value))
+        strbuf_append_strf(rows, "%s\t%s\t%s\n", name, (char *)value, (char *)dir_name);
+
+    if (full_write(log_fd, rows->buf, rows->len) != (ssize_t)rows->len)
+        perror_msg("Can't write duplicate index in '%s'", dump_location);
+    else
+    {
+        r = 0;
+        const off_t log_size = log_st.st_size + rows->len;
+        if (log_size >= DUP_INDEX_MIN_COMPACT_SIZE && log_size >= st.st_size)
+            dup_index_compact(dump_location, fd, log_fd);
+    }
+
+    strbuf_free(rows);
+
+ ret:
+    if (log_fd >= 0)
+        close(log_fd);
+    /* Releases the lock too */
+    close(fd);
+    return r;
+}
+
+int dup_index_add(const char *dump_location, const char *name, const char *value, const char *dir_name)
+{
+    INITIALIZE_LIBABRT();
+
+    if (!dup_index_valid_column(name) || !dup_index_valid_column(value)
+        || !dup_index_valid_dir_name(dir_name))
+    {
+        error_msg("Can't add '%s' of '%s' to the duplicate index: invalid value", name, dir_name);
+        return -EINVAL;
+    }
+
+    GHashTable *values = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(values, (gpointer)dir_name, (gpointer)value);
+    const int r = dup_index_write(dump_location, name, values);
+    g_hash_table_destroy(values);
+    return r;
+}
+
+int dup_index_add_all(const char *dump_location, const char *name, GHashTable *values)
+{
+    INITIALIZE_LIBABRT();
+
+    if (!dup_index_valid_column(name))
+    {
+        error_msg("Can't add '%s' to the duplicate index: invalid name", name);
+        return -EINVAL;
+    }
+
+    /* Skip the invalid rows, the index is only a cache */
+    GHashTable *valid = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTableIter iter;
+    gpointer dir_name, value;
+    g_hash_table_iter_init(&iter, values);
+    while (g_hash_table_iter_next(&iter, &dir_name, &value))
+    {
+        if (dup_index_valid_column(value) && dup_index_valid_dir_name(dir_name))
+            g_hash_table_insert(valid, dir_name, value);
+        else
+            log_notice("Not adding '%s' of '%s' to the duplicate index: invalid value", name, (char *)dir_name);
+    }
+
+    const int r = dup_index_write(dump_location, name, valid);
+    g_hash_table_destroy(valid);
+    return r;
+}
@@ -63,12 +63,20 @@ void trim_problem_dirs(const char *dirname, double cap_size, const char *exclude
     }
     log_debug("excluded_basename:'%s'", excluded_basename);
 
+    /* We exclude our own dir from candidates for deletion */
+    GList *excluded = excluded_basename ? g_list_prepend(NULL, (gpointer)excluded_basename) : NULL;
+
+    /* Only the directories changed since the index was saved are walked */
+    dir_size_index_t *index = dir_size_index_new(dirname);
+    dir_size_index_sync(index);
+
     int count = 20;
     while (--count >= 0)
     {
-        /* We exclude our own dir from candidates for deletion (3rd param): */
         char *worst_basename = NULL;
-        double cur_size = get_dirsize_find_largest_dir(dirname, &worst_basename, excluded_basename);
+        double cur_size = dir_size_index_total(index);
+        if (cur_size > cap_size)
+            worst_basename = dir_size_index_find_worst(index, excluded);
         if (cur_size <= cap_size || !worst_basename)
         {
             log_info("cur_size:%.0f cap_size:%.0f, no (more) trimming", cur_size, cap_size);
@@ -78,10 +86,15 @@ void trim_problem_dirs(const char *dirname, double cap_size, const char *exclude
         log_warning("%s is %.0f bytes (more than %.0fMiB), deleting '%s'",
                 dirname, cur_size, cap_size / (1024*1024), worst_basename);
         char *d = concat_path_file(dirname, worst_basename);
-        free(worst_basename);
         delete_dump_dir(d);
         free(d);
+        /* Drops the entry if the directory is gone, walks it otherwise */
+        dir_size_index_update(index, worst_basename);
+        free(worst_basename);
     }
+
+    dir_size_index_free(index);
+    g_list_free(excluded);
 }
 
 /**
@@ -172,14 +185,106 @@ static char* exec_vp(char **args, int redirect_stderr, int exec_timeout_sec, int
     return strbuf_free_nobuf(buf_out);
 }
 
+/* The core dumps decompressed for a consumer are kept in a directory of their
+ * own, so they have the name FILENAME_COREDUMP */
+#define COREDUMP_TMP_DIR LARGE_DATA_TMP_DIR"/abrt-coredump-"
+
+char *decompress_coredump(const char *dump_dir_name)
+{
+    char *core_path = concat_path_file(dump_dir_name, FILENAME_COREDUMP);
+    if (access(core_path, R_OK) == 0)
+        return core_path;
+    free(core_path);
+    core_path = NULL;
+
+    char *src_path = concat_path_file(dump_dir_name, FILENAME_COREDUMP_XZ);
+    char *tmp_dir = xstrdup(COREDUMP_TMP_DIR"XXXXXX");
+    int dst_fd = -1;
+    const int src_fd = open(src_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (src_fd < 0)
+    {
+        if (errno != ENOENT)
+            perror_msg("Can't open '%s'", src_path);
+        goto ret;
+    }
+
+    if (mkdtemp(tmp_dir) == NULL)
+    {
+        perror_msg("Can't create directory '%s'", tmp_dir);
+        goto ret;
+    }
+
+    core_path = concat_path_file(tmp_dir, FILENAME_COREDUMP);
+    dst_fd = open(core_path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (dst_fd < 0)
+    {
+        perror_msg("Can't create '%s'", core_path);
+        goto fail;
+    }
+
+    log_notice("Decompressing '%s' to '%s'", src_path, core_path);
+
+    pid_t child = vfork();
+    if (child < 0)
+    {
+        perror_msg("vfork");
+        goto fail;
+    }
+    if (child == 0)
+    {
+        xmove_fd(src_fd, STDIN_FILENO);
+        xmove_fd(dst_fd, STDOUT_FILENO);
+        execl(XZ, XZ, "-d", "-c", (char *)NULL);
+        perror_msg_and_die("Can't execute '%s'", XZ);
+    }
+
+    int status;
+    safe_waitpid(child, &status, 0);
+    if (status != 0)
+    {
+        error_msg("'%s' failed to decompress '%s'", XZ, src_path);
+        goto fail;
+    }
+
+    goto ret;
+
+ fail:
+    release_coredump(core_path);
+    core_path = NULL;
+
+ ret:
+    if (src_fd >= 0)
+        close(src_fd);
+    if (dst_fd >= 0)
+        close(dst_fd);
+    free(tmp_dir);
+    free(src_path);
+    return core_path;
+}
+
+void release_coredump(char *core_path)
+{
+    if (core_path && strncmp(core_path, COREDUMP_TMP_DIR, strlen(COREDUMP_TMP_DIR)) == 0)
+    {
+        unlink(core_path);
+        *strrchr(core_path, '/') = '\0';
+        rmdir(core_path);
+    }
+    free(core_path);
+}
+
 char *run_unstrip_n(const char *dump_dir_name, unsigned timeout_sec)
 {
+    char *core_path = decompress_coredump(dump_dir_name);
+    if (!core_path)
+        return NULL;
+
     int flags = EXECFLG_INPUT_NUL | EXECFLG_OUTPUT | EXECFLG_SETSID | EXECFLG_QUIET;
     VERB1 flags &= ~EXECFLG_QUIET;
     int pipeout[2];
     char* args[4];
     args[0] = (char*)"eu-unstrip";
-    args[1] = xasprintf("--core=%s/"FILENAME_COREDUMP, dump_dir_name);
+    args[1] = xasprintf("--core=%s", core_path);
     args[2] = (char*)"-n";
     args[3] = NULL;
     pid_t child = fork_execv_on_steroids(flags, args, pipeout, /*env_vec:*/ NULL, /*dir:*/ NULL, /*uid(unused):*/ 0);
@@ -228,6 +333,7 @@ char *run_unstrip_n(const char *dump_dir_name, unsigned timeout_sec)
     /* Prevent having zombie child process */
     int status;
     safe_waitpid(child, &status, 0);
+    release_coredump(core_path);
 
     if (status != 0 || buf_out == NULL)
     {
@@ -243,9 +349,17 @@ char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char
 {
     INITIALIZE_LIBABRT();
 
+    /* gdb reports the missing core dump itself */
+    char *core_path = decompress_coredump(dump_dir_name);
+    if (!core_path)
+        core_path = concat_path_file(dump_dir_name, FILENAME_COREDUMP);
+
     struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags:*/ 0);
     if (!dd)
+    {
+        release_coredump(core_path);
         return NULL;
+    }
 
     char *executable = NULL;
     if (dd_exist(dd, FILENAME_BINARY))
@@ -330,7 +444,7 @@ char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char
 
     args[i++] = (char*)"-ex";
     const unsigned core_cmd_index = i++;
-    args[core_cmd_index] = xasprintf("core-file %s/"FILENAME_COREDUMP, dump_dir_name);
+    args[core_cmd_index] = xasprintf("core-file %s", core_path);
 
     args[i++] = (char*)"-ex";
     const unsigned bt_cmd_index = i++;
@@ -409,6 +523,7 @@ char *get_backtrace(const char *dump_dir_name, unsigned timeout_sec, const char
     free(args[debug_dir_cmd_index]);
     free(args[file_cmd_index]);
     free(args[core_cmd_index]);
+    release_coredump(core_path);
     return bt;
 }
 
@@ -0,0 +1,146 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* abrtd publishes its load in a small world readable file, so the crash hooks
+ * can find out whether they should save less data without talking to abrtd:
+ *
+ *   pid NUMBER
+ *   queued NUMBER
+ *   running NUMBER
+ *   rate NUMBER          (problems detected in the last minute)
+ *   free_space NUMBER    (MiB available in the dump location)
+ *   degraded 0|1
+ *
+ * The file is replaced by rename(), readers never see a partial status.
+ */
+
+#include <sys/statvfs.h>
+#include "internal_libabrt.h"
+
+#define LOAD_STATUS_FILE VAR_RUN"/abrt/load-status"
+
+static const char *get_load_status_file_name(void)
+{
+    const char *const load_status = getenv("ABRT_LOAD_STATUS_FILE");
+    return load_status == NULL ? LOAD_STATUS_FILE : load_status;
+}
+
+unsigned long get_free_space_mb(const char *path)
+{
+    struct statvfs vfs;
+    if (statvfs(path, &vfs) != 0)
+    {
+        perror_msg("statvfs('%s')", path);
+        return ULONG_MAX;
+    }
+
+    return ((unsigned long long)vfs.f_bavail * vfs.f_bsize) / (1024 * 1024);
+}
+
+int load_status_save(const struct load_status *status)
+{
+    char *content = xasprintf("pid %lu\nqueued %u\nrunning %u\nrate %u\nfree_space %lu\ndegraded %d\n",
+            (long)getpid(), status->queued, status->running, status->rate,
+            status->free_space, status->degraded);
+
+    int r = -1;
+    const char *const path = get_load_status_file_name();
+    char *tmp_path = xasprintf("%s.%lu", path, (long)getpid());
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror_msg("Can't create load status '%s'", tmp_path);
+        goto ret;
+    }
+
+    const ssize_t len = strlen(content);
+    const ssize_t written = full_write(fd, content, len);
+    if (close(fd) != 0 || written != len)
+    {
+        perror_msg("Can't write load status '%s'", tmp_path);
+        unlink(tmp_path);
+        goto ret;
+    }
+
+    if (rename(tmp_path, path) != 0)
+    {
+        perror_msg("Can't rename '%s' to '%s'", tmp_path, path);
+        unlink(tmp_path);
+        goto ret;
+    }
+
+    r = 0;
+
+ ret:
+    free(tmp_path);
+    free(content);
+    return r;
+}
+
+void load_status_remove(void)
+{
+    const char *const path = get_load_status_file_name();
+    if (unlink(path) != 0 && errno != ENOENT)
+        perror_msg("Can't remove load status '%s'", path);
+}
+
+int load_status_read(struct load_status *status)
+{
+    INITIALIZE_LIBABRT();
+
+    memset(status, 0, sizeof(*status));
+
+    const char *const path = get_load_status_file_name();
+    FILE *fp = fopen(path, "re");
+    if (fp == NULL)
+        return -errno;
+
+    long pid = 0;
+    int degraded = 0;
+    char *line;
+    while ((line = xmalloc_fgetline(fp)) != NULL)
+    {
+        if (sscanf(line, "pid %ld", &pid) != 1
+            && sscanf(line, "queued %u", &status->queued) != 1
+            && sscanf(line, "running %u", &status->running) != 1
+            && sscanf(line, "rate %u", &status->rate) != 1
+            && sscanf(line, "free_space %lu", &status->free_space) != 1
+            && sscanf(line, "degraded %d", &degraded) != 1)
+            log_notice("Ignoring malformed line in load status '%s'", path);
+
+        free(line);
+    }
+    fclose(fp);
+
+    /* The status left behind by a killed abrtd is meaningless */
+    if (pid <= 0 || (kill(pid, 0) != 0 && errno == ESRCH))
+    {
+        memset(status, 0, sizeof(*status));
+        return -ESRCH;
+    }
+
+    status->degraded = degraded;
+    return 0;
+}
+
+char *load_status_describe(const struct load_status *status)
+{
+    return xasprintf("abrtd is overloaded: %u problems queued, %u detected in the last minute, %lu MiB free",
+            status->queued, status->rate, status->free_space);
+}
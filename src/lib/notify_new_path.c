@@ -40,13 +40,33 @@ int notify_new_path_with_response(const char *path, char **message)
     sunx.sun_family = AF_UNIX;
     strcpy(sunx.sun_path, VAR_RUN"/abrt/abrt.socket");
 
+    /* Don't wait if abrtd is busy and doesn't accept connections */
+    ndelay_on(fd);
     if (connect(fd, (struct sockaddr *)&sunx, sizeof(sunx)))
     {
         retval = -errno;
-        perror_msg("connect('%s')", sunx.sun_path);
         close(fd);
-        return retval;
+
+        if (retval != -EAGAIN && retval != -ECONNREFUSED)
+        {
+            perror_msg("connect('%s')", sunx.sun_path);
+            return retval;
+        }
+
+        /* abrtd picks the request up from the spool once it can */
+        char *request = xasprintf("POST /creation_notification HTTP/1.1\r\n\r\n%s", path);
+        retval = spool_request(request, strlen(request));
+        free(request);
+        if (retval != 0)
+            return retval;
+
+        log_notice("abrtd is busy, the notification about '%s' was spooled", path);
+        if (message != NULL)
+            *message = xzalloc(1);
+        /* Accepted, the result isn't known yet */
+        return 202;
     }
+    ndelay_off(fd);
 
     full_write_str(fd, "POST /creation_notification HTTP/1.1\r\n\r\n");
     full_write_str(fd, path);
@@ -0,0 +1,296 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* The post-create journal is an append-only file in the root of the dump
+ * location recording the problem directories entering and leaving the
+ * post-create queue:
+ *
+ *   E<TAB>DIRECTORY BASENAME   (enqueued)
+ *   C<TAB>DIRECTORY BASENAME   (completed or cancelled)
+ *
+ * Replaying the records gives the directories still waiting for post-create
+ * in the order of their detection. Every record is written by a single
+ * write(); a torn last record is dropped when the journal is opened. The
+ * journal is rewritten with the pending directories only once the completed
+ * records prevail.
+ */
+
+#include "internal_libabrt.h"
+
+#define POST_CREATE_JOURNAL_FILE_NAME ".post-create-journal"
+/* Do not compact small journals, the rewrite costs more than the replay */
+#define POST_CREATE_JOURNAL_MIN_COMPACT_RECORDS 1024
+
+struct post_create_journal
+{
+    char *path;
+    int fd;
+    /* basename -> order of enqueueing */
+    GHashTable *pending;
+    unsigned long seq;
+    unsigned records;
+};
+
+struct post_create_journal_entry
+{
+    const char *dirname;
+    unsigned long seq;
+};
+
+static bool post_create_journal_valid_name(const char *dirname)
+{
+    return dirname[0] != '\0' && dirname[0] != '.'
+           && strpbrk(dirname, "/\t\n") == NULL;
+}
+
+static void post_create_journal_replay(post_create_journal_t *journal, char op, const char *dirname)
+{
+    ++journal->records;
+    if (op == 'E')
+    {
+        /* The first enqueueing determines the order */
+        if (g_hash_table_lookup(journal->pending, dirname) == NULL)
+            g_hash_table_insert(journal->pending, xstrdup(dirname),
+                                GUINT_TO_POINTER(++journal->seq));
+    }
+    else
+        g_hash_table_remove(journal->pending, dirname);
+}
+
+static void post_create_journal_load(post_create_journal_t *journal)
+{
+    off_t size = 0;
+    char *content = xmalloc_read(journal->fd, NULL);
+    if (content == NULL)
+    {
+        perror_msg("Can't read post-create journal '%s'", journal->path);
+        return;
+    }
+
+    char *line = content;
+    char *newline;
+    while ((newline = strchr(line, '\n')) != NULL)
+    {
+        *newline = '\0';
+        if ((line[0] == 'E' || line[0] == 'C') && line[1] == '\t'
+            && post_create_journal_valid_name(line + 2))
+            post_create_journal_replay(journal, line[0], line + 2);
+        else
+            log_notice("Ignoring malformed record in post-create journal '%s'", journal->path);
+
+        line = newline + 1;
+    }
+    size = line - content;
+
+    /* Do not let the next record continue the torn one */
+    if (line[0] != '\0')
+    {
+        log_warning("Dropping torn record at the end of post-create journal '%s'", journal->path);
+        if (ftruncate(journal->fd, size) != 0)
+            perror_msg("Can't truncate post-create journal '%s'", journal->path);
+    }
+
+    free(content);
+}
+
+post_create_journal_t *post_create_journal_open(const char *dump_location)
+{
+    INITIALIZE_LIBABRT();
+
+    char *path = concat_path_file(dump_location, POST_CREATE_JOURNAL_FILE_NAME);
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        perror_msg("Can't open post-create journal '%s'", path);
+        free(path);
+        return NULL;
+    }
+
+    post_create_journal_t *journal = xzalloc(sizeof(*journal));
+    journal->path = path;
+    journal->fd = fd;
+    journal->pending = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    post_create_journal_load(journal);
+
+    log_debug("Post-create journal '%s': %u records, %u pending", path,
+              journal->records, g_hash_table_size(journal->pending));
+    return journal;
+}
+
+void post_create_journal_close(post_create_journal_t *journal)
+{
+    if (journal == NULL)
+        return;
+
+    close(journal->fd);
+    g_hash_table_destroy(journal->pending);
+    free(journal->path);
+    free(journal);
+}
+
+static int post_create_journal_entry_cmp(const void *a, const void *b)
+{
+    const struct post_create_journal_entry *ea = a;
+    const struct post_create_journal_entry *eb = b;
+    return (ea->seq > eb->seq) - (ea->seq < eb->seq);
+}
+
+/* Returns the pending directories sorted by the order of enqueueing */
+static struct post_create_journal_entry *post_create_journal_sorted(post_create_journal_t *journal,
+        unsigned *count)
+{
+    *count = g_hash_table_size(journal->pending);
+    struct post_create_journal_entry *entries = xmalloc((*count + 1) * sizeof(*entries));
+
+    unsigned i = 0;
+    GHashTableIter iter;
+    gpointer name, seq;
+    g_hash_table_iter_init(&iter, journal->pending);
+    while (g_hash_table_iter_next(&iter, &name, &seq))
+    {
+        entries[i].dirname = name;
+        entries[i].seq = GPOINTER_TO_UINT(seq);
+        ++i;
+    }
+
+    qsort(entries, *count, sizeof(*entries), post_create_journal_entry_cmp);
+    return entries;
+}
+
+GList *post_create_journal_pending(post_create_journal_t *journal)
+{
+    unsigned count;
+    struct post_create_journal_entry *entries = post_create_journal_sorted(journal, &count);
+
+    GList *pending = NULL;
+    while (count-- > 0)
+        pending = g_list_prepend(pending, xstrdup(entries[count].dirname));
+
+    free(entries);
+    return pending;
+}
+
+bool post_create_journal_is_pending(post_create_journal_t *journal, const char *dirname)
+{
+    return g_hash_table_lookup(journal->pending, dirname) != NULL;
+}
+
+static int post_create_journal_write(post_create_journal_t *journal, char op, const char *dirname)
+{
+    char *record = xasprintf("%c\t%s\n", op, dirname);
+    const ssize_t len = strlen(record);
+    const ssize_t written = write(journal->fd, record, len);
+    free(record);
+
+    if (written != len)
+    {
+        perror_msg("Can't write post-create journal '%s'", journal->path);
+        return -1;
+    }
+
+    ++journal->records;
+    return 0;
+}
+
+/* Rewrites the journal with the pending directories only */
+static void post_create_journal_compact(post_create_journal_t *journal)
+{
+    unsigned count;
+    struct post_create_journal_entry *entries = post_create_journal_sorted(journal, &count);
+
+    struct strbuf *content = strbuf_new();
+    unsigned i;
+    for (i = 0; i < count; ++i)
+        strbuf_append_strf(content, "E\t%s\n", entries[i].dirname);
+    free(entries);
+
+    char *tmp_path = xasprintf("%s.%lu", journal->path, (long)getpid());
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        perror_msg("Can't create post-create journal '%s'", tmp_path);
+        goto ret;
+    }
+
+    if (full_write(fd, content->buf, content->len) != (ssize_t)content->len
+        || fdatasync(fd) != 0)
+    {
+        perror_msg("Can't write post-create journal '%s'", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        goto ret;
+    }
+
+    if (rename(tmp_path, journal->path) != 0)
+    {
+        perror_msg("Can't rename '%s' to '%s'", tmp_path, journal->path);
+        close(fd);
+        unlink(tmp_path);
+        goto ret;
+    }
+
+    close(journal->fd);
+    journal->fd = fd;
+    journal->records = count;
+    log_debug("Compacted post-create journal '%s' to %u records", journal->path, count);
+
+ ret:
+    free(tmp_path);
+    strbuf_free(content);
+}
+
+int post_create_journal_enqueue(post_create_journal_t *journal, const char *dirname)
+{
+    if (!post_create_journal_valid_name(dirname))
+    {
+        error_msg("Can't add '%s' to the post-create journal: invalid name", dirname);
+        return -EINVAL;
+    }
+
+    if (post_create_journal_is_pending(journal, dirname))
+        return 0;
+
+    if (post_create_journal_write(journal, 'E', dirname) != 0)
+        return -1;
+
+    /* The directory must not get lost if the machine goes down */
+    if (fdatasync(journal->fd) != 0)
+        perror_msg("Can't sync post-create journal '%s'", journal->path);
+
+    g_hash_table_insert(journal->pending, xstrdup(dirname), GUINT_TO_POINTER(++journal->seq));
+    return 0;
+}
+
+int post_create_journal_complete(post_create_journal_t *journal, const char *dirname)
+{
+    if (!post_create_journal_is_pending(journal, dirname))
+        return 0;
+
+    /* Losing this record only makes the replay check the directory again */
+    if (post_create_journal_write(journal, 'C', dirname) != 0)
+        return -1;
+
+    g_hash_table_remove(journal->pending, dirname);
+
+    if (journal->records >= POST_CREATE_JOURNAL_MIN_COMPACT_RECORDS
+        && journal->records >= 2 * g_hash_table_size(journal->pending))
+        post_create_journal_compact(journal);
+
+    return 0;
+}
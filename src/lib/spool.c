@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2016  ABRT Team
+    Copyright (C) 2016  RedHat inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* When abrtd is busy and refuses connections to abrt.socket, the clients
+ * leave their requests in the spool directory. The directory is writable by
+ * everybody but readable by root only (mode 1733), the owner of a spooled
+ * file is the client.
+ *
+ * A request is written to a hidden temporary file which is renamed to
+ * SECONDS.MICROSECONDS-RANDOM once it is complete, so the names sort in the
+ * order of submission. abrtd ignores the hidden files.
+ */
+
+#include "internal_libabrt.h"
+
+#define SPOOL_DIR VAR_RUN"/abrt/spool"
+
+const char *spool_dir_name(void)
+{
+    const char *const spool_dir = getenv("ABRT_SPOOL_DIR");
+    return spool_dir == NULL ? SPOOL_DIR : spool_dir;
+}
+
+int spool_request(const char *request, size_t size)
+{
+    INITIALIZE_LIBABRT();
+
+    const char *const spool_dir = spool_dir_name();
+    char *tmp_path = xasprintf("%s/.XXXXXX", spool_dir);
+    char *path = NULL;
+    int r = 0;
+
+    int fd = mkostemp(tmp_path, O_CLOEXEC);
+    if (fd < 0)
+    {
+        r = -errno;
+        perror_msg("Can't create a file in spool directory '%s'", spool_dir);
+        goto ret;
+    }
+
+    const ssize_t written = full_write(fd, request, size);
+    if (written < 0 || (size_t)written != size)
+    {
+        r = -errno;
+        perror_msg("Can't write spooled request '%s'", tmp_path);
+        close(fd);
+        goto unlink_tmp;
+    }
+
+    if (close(fd) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't write spooled request '%s'", tmp_path);
+        goto unlink_tmp;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    path = xasprintf("%s/%010lu.%06lu-%s", spool_dir,
+                     (unsigned long)tv.tv_sec, (unsigned long)tv.tv_usec,
+                     strrchr(tmp_path, '/') + 2);
+
+    if (rename(tmp_path, path) != 0)
+    {
+        r = -errno;
+        perror_msg("Can't rename '%s' to '%s'", tmp_path, path);
+        goto unlink_tmp;
+    }
+
+    log_info("Spooled request '%s'", path);
+    goto ret;
+
+ unlink_tmp:
+    unlink(tmp_path);
+
+ ret:
+    free(path);
+    free(tmp_path);
+    return r;
+}
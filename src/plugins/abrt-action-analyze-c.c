@@ -170,12 +170,8 @@ int main(int argc, char **argv)
 
     export_abrt_envvars(0);
 
-    char *unstrip_n_output = NULL;
-    char *coredump_path = xasprintf("%s/"FILENAME_COREDUMP, dump_dir_name);
-    if (access(coredump_path, R_OK) == 0)
-        unstrip_n_output = run_unstrip_n(dump_dir_name, /*timeout_sec:*/ 30);
-
-    free(coredump_path);
+    /* Decompresses a core dump written by the CompressCore option, if any */
+    char *unstrip_n_output = run_unstrip_n(dump_dir_name, /*timeout_sec:*/ 30);
 
     if (unstrip_n_output)
     {
@@ -18,9 +18,48 @@
 */
 #include <satyr/abrt.h>
 #include <satyr/utils.h>
+#ifdef ENABLE_NATIVE_UNWINDER
+#include <satyr/core/fingerprint.h>
+#include <satyr/core/stacktrace.h>
+#include <satyr/core/unwind.h>
+#endif
 
 #include "libabrt.h"
 
+#ifdef ENABLE_NATIVE_UNWINDER
+/* sr_abrt_create_core_stacktrace() for a core dump decompressed out of the
+ * problem directory */
+static bool create_core_stacktrace(const char *dump_dir_name, const char *core_path,
+                                   bool hash_fingerprints, char **error_message)
+{
+    struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags:*/ 0);
+    if (!dd)
+    {
+        *error_message = xasprintf("Can't open problem directory '%s'", dump_dir_name);
+        return false;
+    }
+
+    char *executable = dd_load_text(dd, FILENAME_EXECUTABLE);
+    struct sr_core_stacktrace *stacktrace = sr_parse_coredump(core_path, executable, error_message);
+    free(executable);
+
+    const bool success = stacktrace != NULL && sr_core_fingerprint_generate(stacktrace, error_message);
+    if (success)
+    {
+        if (hash_fingerprints)
+            sr_core_fingerprint_hash(stacktrace);
+
+        char *json = sr_core_stacktrace_to_json(stacktrace);
+        dd_save_text(dd, FILENAME_CORE_BACKTRACE, json);
+        free(json);
+    }
+
+    sr_core_stacktrace_free(stacktrace);
+    dd_close(dd);
+    return success;
+}
+#endif /* ENABLE_NATIVE_UNWINDER */
+
 int main(int argc, char **argv)
 {
     /* I18n */
@@ -68,8 +107,16 @@ int main(int argc, char **argv)
 
 #ifdef ENABLE_NATIVE_UNWINDER
 
-    success = sr_abrt_create_core_stacktrace(dump_dir_name, !raw_fingerprints,
-                                             &error_message);
+    char *core_path = decompress_coredump(dump_dir_name);
+    char *dd_core_path = concat_path_file(dump_dir_name, FILENAME_COREDUMP);
+    if (core_path && strcmp(core_path, dd_core_path) != 0)
+        success = create_core_stacktrace(dump_dir_name, core_path, !raw_fingerprints,
+                                         &error_message);
+    else
+        success = sr_abrt_create_core_stacktrace(dump_dir_name, !raw_fingerprints,
+                                                 &error_message);
+    free(dd_core_path);
+    release_coredump(core_path);
 #else /* ENABLE_NATIVE_UNWINDER */
 
     /* The value 240 was taken from abrt-action-generate-backtrace.c. */
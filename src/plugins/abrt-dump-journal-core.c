@@ -112,6 +112,9 @@ struct occurrence_queue
     .oq_size = 8,
 };
 
+/* CCpp.conf: DegradeUnderLoad */
+static bool s_degrade_under_load = true;
+
 static unsigned
 abrt_journal_get_last_occurrence(const char *executable)
 {
@@ -249,11 +252,10 @@ abrt_journal_core_retrieve_information(abrt_journal_t *journal, struct crash_inf
 }
 
 /*
- * Initializes ABRT problem directory and save the relevant journal message
- * fileds in that directory.
+ * Copies the core dump saved by systemd-coredump to the problem directory.
  */
 static int
-save_systemd_coredump_in_dump_directory(struct dump_dir *dd, struct crash_info *info)
+save_systemd_coredump_file(struct dump_dir *dd, struct crash_info *info)
 {
     char coredump_path[PATH_MAX + 1] = { '\0' };
     if (coredump_path != abrt_journal_get_string_field(info->ci_journal, "COREDUMP_FILENAME", coredump_path))
@@ -292,6 +294,49 @@ save_systemd_coredump_in_dump_directory(struct dump_dir *dd, struct crash_info *
         dd_save_binary(dd, FILENAME_COREDUMP, data, data_len);
     }
 
+    return 0;
+}
+
+/*
+ * Saves the stack trace systemd-coredump put in the message of the journal
+ * entry. It costs nothing compared to unwinding the core dump.
+ */
+static void
+save_systemd_coredump_stacktrace(struct dump_dir *dd, struct crash_info *info)
+{
+    const char *data = NULL;
+    size_t data_len = 0;
+    if (abrt_journal_get_field(info->ci_journal, "MESSAGE", (const void **)&data, &data_len))
+    {
+        log_info("systemd-coredump journald message misses field: 'MESSAGE'");
+        return;
+    }
+
+    dd_save_binary(dd, FILENAME_JOURNAL_STACKTRACE, data, data_len);
+}
+
+/*
+ * Initializes ABRT problem directory and save the relevant journal message
+ * fileds in that directory.
+ */
+static int
+save_systemd_coredump_in_dump_directory(struct dump_dir *dd, struct crash_info *info)
+{
+    /* abrtd can't keep up - save only the metadata, the core dump would
+     * have to wait for post-create to be unwound anyway */
+    struct load_status load;
+    if (s_degrade_under_load && load_status_read(&load) == 0 && load.degraded)
+    {
+        char *degraded = load_status_describe(&load);
+        log_info("Not saving core dump: %s", degraded);
+        dd_save_text(dd, FILENAME_DEGRADED, degraded);
+        free(degraded);
+
+        save_systemd_coredump_stacktrace(dd, info);
+    }
+    else if (save_systemd_coredump_file(dd, info))
+        return -1;
+
     dd_save_text(dd, FILENAME_ABRT_VERSION, VERSION);
     dd_save_text(dd, FILENAME_TYPE, "CCpp");
     dd_save_text(dd, FILENAME_ANALYZER, "abrt-journal-core");
@@ -439,6 +484,13 @@ abrt_journal_watch_cores(abrt_journal_watch_t *watch, void *user_data)
         goto watch_cleanup;
     }
 
+    if (!crash_admission_check(conf->awc_dump_location, info.ci_executable_path, info.ci_uid,
+                g_settings_crash_rate_burst, g_settings_crash_rate_interval))
+    {
+        error_msg(_("Not saving repeating crash of '%s'"), info.ci_executable_path);
+        goto watch_cleanup;
+    }
+
     if (abrt_journal_core_to_abrt_problem(&info, conf->awc_dump_location))
     {
         error_msg(_("Failed to save detect problem data in abrt database"));
@@ -555,6 +607,9 @@ main(int argc, char *argv[])
         //value = get_map_string_item_or_NULL(settings, "SaveFullCore");
         //setting_SaveFullCore = value ? string_to_bool(value) : true;
 
+        value = get_map_string_item_or_NULL(settings, "DegradeUnderLoad");
+        s_degrade_under_load = value ? string_to_bool(value) : true;
+
         value = get_map_string_item_or_NULL(settings, "VerboseLog");
         if (value)
             g_verbose = xatoi_positive(value);
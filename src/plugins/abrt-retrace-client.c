@@ -43,6 +43,8 @@ struct retrace_settings
 
 static const char *dump_dir_name = NULL;
 static const char *coredump = NULL;
+/* The core dump of dump_dir_name, a temporary file if it is compressed */
+static char *dump_dir_coredump = NULL;
 static const char *required_retrace[] = { FILENAME_COREDUMP,
                                           FILENAME_EXECUTABLE,
                                           FILENAME_PACKAGE,
@@ -136,7 +138,7 @@ static int create_archive(bool unlink_temp)
     /* Run tar, and set output to a pipe with xz waiting on the other
      * end.
      */
-    const char *tar_args[10];
+    const char *tar_args[13];
     tar_args[0] = "tar";
     tar_args[1] = "cO";
     tar_args[2] = xasprintf("--directory=%s", dump_dir_name);
@@ -153,6 +155,16 @@ static int create_archive(bool unlink_temp)
             args_add_if_exists(tar_args, dd, optional_retrace[i], &index);
     }
 
+    /* The decompressed core dump is named FILENAME_COREDUMP too */
+    char *coredump_dir = NULL;
+    if (task_type != TASK_VMCORE && !dd_exist(dd, FILENAME_COREDUMP) && dump_dir_coredump)
+    {
+        coredump_dir = xstrndup(dump_dir_coredump, strrchr(dump_dir_coredump, '/') - dump_dir_coredump);
+        tar_args[index++] = "-C";
+        tar_args[index++] = coredump_dir;
+        tar_args[index++] = FILENAME_COREDUMP;
+    }
+
     tar_args[index] = NULL;
     dd_close(dd);
 
@@ -169,6 +181,7 @@ static int create_archive(bool unlink_temp)
     }
 
     free((void*)tar_args[2]);
+    free(coredump_dir);
     close(tar_xz_pipe[1]);
 
     /* Wait for tar and xz to finish successfully */
@@ -464,6 +477,9 @@ static int create(bool delete_temp_archive,
     }
     else if (dump_dir_name != NULL)
     {
+        /* The server does not understand compressed core files */
+        dump_dir_coredump = decompress_coredump(dump_dir_name);
+
         struct dump_dir *dd = dd_opendir(dump_dir_name, /*flags*/ 0);
         if (!dd)
             xfunc_die(); /* dd_opendir already emitted error message */
@@ -476,7 +492,10 @@ static int create(bool delete_temp_archive,
         const char **required_files = task_type == TASK_VMCORE ? required_vmcore : required_retrace;
         while (required_files[i])
         {
-            path = concat_path_file(dump_dir_name, required_files[i]);
+            if (dump_dir_coredump && strcmp(required_files[i], FILENAME_COREDUMP) == 0)
+                path = xstrdup(dump_dir_coredump);
+            else
+                path = concat_path_file(dump_dir_name, required_files[i]);
             xstat(path, &file_stat);
             free(path);
 
@@ -611,6 +630,8 @@ static int create(bool delete_temp_archive,
     }
 
     int tempfd = create_archive(delete_temp_archive);
+    release_coredump(dump_dir_coredump);
+    dump_dir_coredump = NULL;
     if (-1 == tempfd)
         return 1;
 
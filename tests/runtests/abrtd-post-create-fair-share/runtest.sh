@@ -0,0 +1,143 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of abrtd-post-create-fair-share
+#   Description: Checks that a user below the fair share of post-create jobs goes first
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="abrtd-post-create-fair-share"
+PACKAGE="abrt"
+
+ABRT_CONF="/etc/abrt/abrt.conf"
+TEST_EVENT_CONF="/etc/libreport/events.d/${TEST}.conf"
+ORDER_FILE="/var/spool/abrt/${TEST}_order"
+RELEASE_PREFIX="/var/spool/abrt/${TEST}_release_"
+
+# $1 - directory name, $2 - uid
+# Different executables, so the problems are not serialized as duplicates.
+function notify_problem
+{
+    local dd=$ABRT_CONF_DUMP_LOCATION/$1
+
+    rlRun "mkdir -p ${dd}.new" 0
+    echo -n "$TEST" > ${dd}.new/type
+    echo -n "$TEST" > ${dd}.new/analyzer
+    echo -n "$2"    > ${dd}.new/uid
+    echo -n "/usr/bin/$1" > ${dd}.new/executable
+    date +%s        > ${dd}.new/time
+    date +%s        > ${dd}.new/last_occurrence
+    chown -R root:abrt ${dd}.new
+    chmod -R 0750 ${dd}.new
+
+    rlRun "mv ${dd}.new ${dd}" 0
+    echo "import problem; problem.notify_new_path(\"${dd}\")" | python
+}
+
+# $1 - expected number of started post-create events
+function wait_for_started
+{
+    local c=0
+    while [ "$(wc -l < $ORDER_FILE 2>/dev/null || echo 0)" -lt $1 ]; do
+        sleep 0.1
+        c=$((c+1))
+        if [ $c -gt 300 ]; then
+            rlFail "$1 post-create events didn't start in 30s"
+            break
+        fi
+    done
+    # Nothing else may start
+    sleep 1
+    rlAssertEquals "Started post-create events" "$(wc -l < $ORDER_FILE)" "$1"
+}
+
+rlJournalStart
+
+    rlPhaseStartSetup
+        check_prior_crashes
+
+        load_abrt_conf
+
+        TmpDir=$(mktemp -d)
+        pushd $TmpDir
+
+        rlFileBackup $ABRT_CONF
+
+        systemctl stop abrtd
+
+        sed -i '/^[#[:space:]]*MaxPostCreateJobs[[:space:]]*=/d;/^[#[:space:]]*PostCreateAging[[:space:]]*=/d' $ABRT_CONF
+        echo "MaxPostCreateJobs = 2" >> $ABRT_CONF
+        echo "PostCreateAging = 0" >> $ABRT_CONF
+
+        cat > $TEST_EVENT_CONF <<EOF
+EVENT=post-create type=${TEST}
+    echo \$(basename \$DUMP_DIR) >> $ORDER_FILE
+    while [ ! -f ${RELEASE_PREFIX}\$(basename \$DUMP_DIR) ]; do sleep 0.2; done
+EOF
+        rm -f $ORDER_FILE ${RELEASE_PREFIX}*
+
+        systemctl start abrtd
+    rlPhaseEnd
+
+    rlPhaseStartTest "A user below the fair share goes first"
+        # The first user takes both slots and queues one more problem
+        notify_problem ${TEST}_first_1 0
+        notify_problem ${TEST}_first_2 0
+        wait_for_started 2
+        notify_problem ${TEST}_first_3 0
+        sleep 1
+
+        # The second user's problem is detected last
+        notify_problem ${TEST}_second_1 1000
+        sleep 1
+        rlAssertEquals "No slot is free" "$(wc -l < $ORDER_FILE)" "2"
+
+        # With one slot each, the first user is at the fair share
+        touch ${RELEASE_PREFIX}${TEST}_first_1
+        wait_for_started 3
+        rlAssertEquals "The second user goes first" "$(sed -n 3p $ORDER_FILE)" "${TEST}_second_1"
+
+        touch ${RELEASE_PREFIX}${TEST}_first_2
+        wait_for_started 4
+        rlAssertEquals "The first user goes next" "$(sed -n 4p $ORDER_FILE)" "${TEST}_first_3"
+
+        rlLog "$(cat $ORDER_FILE)"
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        touch ${RELEASE_PREFIX}${TEST}_first_3 ${RELEASE_PREFIX}${TEST}_second_1
+        sleep 1
+
+        rlFileRestore
+        rm -f $TEST_EVENT_CONF
+        rm -f $ORDER_FILE ${RELEASE_PREFIX}*
+        rm -rf $ABRT_CONF_DUMP_LOCATION/${TEST}_*
+
+        systemctl restart abrtd
+        popd
+        rm -rf $TmpDir
+    rlPhaseEnd
+    rlJournalPrintText
+rlJournalEnd
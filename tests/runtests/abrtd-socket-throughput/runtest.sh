@@ -0,0 +1,83 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of abrtd-socket-throughput
+#   Description: Measures how many problems abrtd accepts per second on abrt.socket
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="abrtd-socket-throughput"
+PACKAGE="abrt"
+
+ABRT_CONF="/etc/abrt/abrt.conf"
+TOTAL=200
+PARALLEL=10
+
+rlJournalStart
+    rlPhaseStartSetup
+        check_prior_crashes
+
+        load_abrt_conf
+
+        rlFileBackup $ABRT_CONF
+        # Don't let the size limit delete the submitted problems
+        sed 's/MaxCrashReportsSize\s*=.*/MaxCrashReportsSize = 0/' -i $ABRT_CONF
+
+        cp submit.py /tmp/$TEST-submit.py
+        rlServiceStart abrtd
+    rlPhaseEnd
+
+    rlPhaseStartTest "Throughput"
+        rlRun "RESULT=\$(python /tmp/$TEST-submit.py $TOTAL $PARALLEL)" 0 "Submit $TOTAL problems"
+        ACCEPTED=$(echo $RESULT | cut -d' ' -f1)
+        RATE=$(echo $RESULT | cut -d' ' -f2)
+        rlLog "abrtd accepted $ACCEPTED problems, $RATE submissions per second"
+        rlAssertEquals "All problems accepted" "_$ACCEPTED" "_$TOTAL"
+    rlPhaseEnd
+
+    rlPhaseStartTest "Slow client"
+        # A client which doesn't send anything must not block the others
+        python -c "import socket, time; s = socket.socket(socket.AF_UNIX); s.connect('/var/run/abrt/abrt.socket'); time.sleep(8)" &
+        SLOW_PID=$!
+        sleep 1
+
+        START=$(date +%s)
+        rlRun "RESULT=\$(python /tmp/$TEST-submit.py 1 1)" 0 "Submit while a client is idle"
+        END=$(date +%s)
+        rlAssertEquals "The problem was accepted" "_$(echo $RESULT | cut -d' ' -f1)" "_1"
+        rlAssertGreater "Accepted in less than 3s" 3 $((END - START))
+
+        kill $SLOW_PID
+        wait $SLOW_PID
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rlFileRestore
+        rm -f /tmp/$TEST-submit.py
+        rm -rf $ABRT_CONF_DUMP_LOCATION/$TEST-*
+        rlServiceRestore abrtd
+    rlPhaseEnd
+    rlJournalPrintText
+rlJournalEnd
@@ -0,0 +1,63 @@
+#!/usr/bin/python
+# Submits problems to abrt.socket from several connections at once and prints
+# the number of accepted submissions and the submissions per second.
+
+import os
+import socket
+import sys
+import threading
+import time
+
+SOCKET = "/var/run/abrt/abrt.socket"
+TYPE = "abrtd-socket-throughput"
+
+
+def submit(num, codes):
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    s.settimeout(30)
+    try:
+        s.connect(SOCKET)
+        # crash_admission_check() throttles repeating crashes of an executable
+        s.sendall(b"POST / HTTP/1.1\r\n\r\n"
+                  + ("type=%s\0" % TYPE).encode()
+                  + ("analyzer=%s\0" % TYPE).encode()
+                  + ("pid=%d\0" % os.getpid()).encode()
+                  + ("executable=/usr/bin/%s-%d\0" % (TYPE, num)).encode()
+                  + ("reason=%s %d\0" % (TYPE, num)).encode()
+                  + ("backtrace=%s\0" % ("frame\n" * 100)).encode())
+        s.shutdown(socket.SHUT_WR)
+
+        response = b""
+        while True:
+            buf = s.recv(256)
+            if not buf:
+                break
+            response += buf
+        codes.append(response.split(b" ")[1])
+    except Exception as ex:
+        codes.append(str(ex).encode())
+    finally:
+        s.close()
+
+
+def main():
+    total = int(sys.argv[1])
+    parallel = int(sys.argv[2])
+
+    codes = []
+    begin = time.time()
+    for first in range(0, total, parallel):
+        threads = [threading.Thread(target=submit, args=(num, codes))
+                   for num in range(first, min(first + parallel, total))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+    elapsed = time.time() - begin
+
+    accepted = len([c for c in codes if c == b"201"])
+    print("%d %.1f" % (accepted, accepted / elapsed))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of abrtd-spool-quota
+#   Description: Checks that abrtd limits the spooled requests of a user and never reads /proc of their clients
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="abrtd-spool-quota"
+PACKAGE="abrt"
+
+TEST_EVENT_CONF="/etc/libreport/events.d/${TEST}.conf"
+SPOOL_DIR="/var/run/abrt/spool"
+TEST_USER="abrt_spool_test_user"
+# SPOOL_MAX_REQUESTS_PER_UID in abrtd.c
+SPOOL_MAX_REQUESTS=32
+SPOOLED=40
+
+# $1 - index of the request, it makes the directory name unique
+# pid 1 belongs to init, its /proc must not end up in the problem
+function spool_problem
+{
+    su $TEST_USER -s /bin/bash -c "
+        cd $SPOOL_DIR &&
+        tmp=\$(mktemp .XXXXXX) &&
+        printf 'POST / HTTP/1.1\r\n\r\ntype=${TEST}\0basename=${TEST}_$1\0analyzer=${TEST}\0pid=1\0executable=/usr/bin/${TEST}_$1\0reason=spooled $1\0cmdline=${TEST} $1\0' > \$tmp &&
+        mv \$tmp \$(printf '%010u.%06u-%s' \$(date +%s) $1 \${tmp#.})"
+}
+
+rlJournalStart
+
+    rlPhaseStartSetup
+        check_prior_crashes
+
+        load_abrt_conf
+
+        TmpDir=$(mktemp -d)
+        pushd $TmpDir
+
+        rlRun "useradd $TEST_USER" 0
+
+        cat > $TEST_EVENT_CONF <<EOF
+EVENT=post-create type=${TEST}
+    true
+EOF
+
+        # The requests are spooled while abrtd is not running
+        systemctl stop abrtd
+    rlPhaseEnd
+
+    rlPhaseStartTest "Requests over the quota are removed"
+        for i in $(seq 1 $SPOOLED); do
+            spool_problem $i
+        done
+        rlAssertEquals "All requests are spooled" "$(ls $SPOOL_DIR | wc -l)" "$SPOOLED"
+
+        systemctl start abrtd
+
+        # abrtd processes 10 spooled requests per second
+        c=0
+        while [ -n "$(ls $SPOOL_DIR)" ]; do
+            sleep 1
+            c=$((c+1))
+            if [ $c -gt 30 ]; then
+                rlFail "The spool wasn't drained in 30s"
+                break
+            fi
+        done
+        sleep 2
+
+        rlAssertEquals "Only the requests within the quota are processed" \
+            "$(ls -d $ABRT_CONF_DUMP_LOCATION/${TEST}_* | wc -l)" "$SPOOL_MAX_REQUESTS"
+    rlPhaseEnd
+
+    rlPhaseStartTest "/proc of the client of a spooled request is not read"
+        for dd in $ABRT_CONF_DUMP_LOCATION/${TEST}_*; do
+            rlAssertExists "$dd/spooled"
+            rlAssertGrep "^${TEST} [0-9]*$" "$dd/cmdline"
+            rlAssertNotExists "$dd/environ"
+            rlAssertNotExists "$dd/open_fds"
+        done
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rm -f $TEST_EVENT_CONF
+        rm -f $SPOOL_DIR/* $SPOOL_DIR/.??*
+        rm -rf $ABRT_CONF_DUMP_LOCATION/${TEST}_*
+        rlRun "userdel -r -f $TEST_USER" 0
+
+        systemctl restart abrtd
+        popd
+        rm -rf $TmpDir
+    rlPhaseEnd
+    rlJournalPrintText
+rlJournalEnd
@@ -160,6 +160,7 @@ function prepare() {
 
     rm -f -- $ABRT_CONF_DUMP_LOCATION/last-ccpp
     rm -f -- $ABRT_CONF_DUMP_LOCATION/last-via-server
+    rm -f -- $ABRT_CONF_DUMP_LOCATION/.crash-admission
     rm -f "/tmp/abrt-done"
 
     if [ ! -f /etc/libreport/events.d/test_event.conf ]; then
@@ -44,6 +44,10 @@ rlJournalStart
         rlFileBackup $CFG_FILE $CCPP_CFG_FILE
         sed -i 's/ProcessUnpackaged = no/ProcessUnpackaged = yes/g' $CFG_FILE
         sed -i 's/\(MakeCompatCore\) = no/\1 = yes/g' $CCPP_CFG_FILE
+        # Enable the option whatever the shipped configuration says
+        sed -i 's/^[#[:space:]]*\(SparseCore\)[[:space:]]*=.*/\1 = yes/' $CCPP_CFG_FILE
+        grep -q "^SparseCore" $CCPP_CFG_FILE || echo "SparseCore = yes" >> $CCPP_CFG_FILE
+        rlAssertGrep "^SparseCore = yes$" $CCPP_CFG_FILE
     rlPhaseEnd
 
     rlPhaseStartTest
@@ -60,11 +64,18 @@ rlJournalStart
 
         # In my experience here apparent size is almost 500 times bigger
         rlAssertGreater "Corefile is very sparse" $((apparent_coresize/50)) $actual_coresize
-    rlPhaseEnd
 
-    rlPhaseStartCleanup
         wait_for_hooks
         get_crash_path
+        rlAssertExists "$crash_PATH/coredump"
+        apparent_abrtsize=$(du -B1 --apparent-size $crash_PATH/coredump | sed 's/[ \t].*//')
+        actual_abrtsize=$(du -B1 $crash_PATH/coredump | sed 's/[ \t].*//')
+        rlLog "ABRT core sizes: apparent:$apparent_abrtsize actual:$actual_abrtsize"
+        # Zero blocks are not written, they take no space
+        rlAssertGreater "ABRT core is very sparse" $((apparent_abrtsize/50)) $actual_abrtsize
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
         rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash directory"
 
         popd # $TmpDir
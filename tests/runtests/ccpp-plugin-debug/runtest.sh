@@ -60,6 +60,7 @@ function prepare_test_case
 
     rlLog "Remove all files from $ABRT_CONF_DUMP_LOCATION"
     rm -rf $ABRT_CONF_DUMP_LOCATION/*
+    rm -f $ABRT_CONF_DUMP_LOCATION/.crash-admission
 }
 
 function assert_file_is_coredump
@@ -97,8 +98,8 @@ rlJournalStart
         PID=$(./$ABRT_BINARY_NAME & echo $!)
         wait_for_process "abrt-hook-ccpp"
 
-        # "total 1" + last-ccpp
-        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 2 "Crash of ABRT binary caused a new file in the dump location"
+        # "total 0"
+        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 1 "Crash of ABRT binary caused a new file in the dump location"
 
         UID=$(id -u)
         journalctl SYSLOG_IDENTIFIER=abrt-hook-ccpp --since="$SINCE" | tee no_debug.log
@@ -114,8 +115,8 @@ rlJournalStart
         rlAssertExists $ABRT_BINARY_COREDUMP
         assert_file_is_coredump $ABRT_BINARY_COREDUMP
 
-        # "total 2" + last-ccpp + the core file
-        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 3 "Crash of ABRT binary caused too many new files"
+        # "total 2" + the core file
+        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 2 "Crash of ABRT binary caused too many new files"
 
         rm -rf $ABRT_BINARY_COREDUMP
     rlPhaseEnd
@@ -176,8 +177,8 @@ rlJournalStart
         journalctl SYSLOG_IDENTIFIER=abrt-hook-ccpp --since="$SINCE" | tee is_directory.log
         rlAssertGrep "Can't open '$ABRT_BINARY_COREDUMP': File exists" is_directory.log
 
-        # "total 2" + last-ccpp + the core file
-        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 3 "Crash of ABRT binary caused too many new files"
+        # "total 2" + the core file
+        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 2 "Crash of ABRT binary caused too many new files"
 
         rm -rf $ABRT_BINARY_COREDUMP
     rlPhaseEnd
@@ -205,8 +206,8 @@ rlJournalStart
         assert_file_is_coredump $ABRT_BINARY_COREDUMP
         rlAssertEquals "The hard link was not overwritten" "_$SECRET_INFORMATION" "_$(cat $ABRT_CONF_DUMP_LOCATION/abrt_test_hardlink)"
 
-        # "total 2" + last-ccpp + the core file + the hard link
-        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 4 "Crash of ABRT binary caused too many new files"
+        # "total 2" + the core file + the hard link
+        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 3 "Crash of ABRT binary caused too many new files"
 
         rm -rf $ABRT_BINARY_COREDUMP
         rm -rf $ABRT_CONF_DUMP_LOCATION/abrt_test_hardlink
@@ -227,8 +228,8 @@ rlJournalStart
         assert_file_is_coredump $ABRT_BINARY_COREDUMP
         rlAssertEquals "the symlink isn't touched" "_$SECRET_INFORMATION" "_$(cat /tmp/abrt_secret_file)"
 
-        # "total 2" + last-ccpp + the core file
-        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 3 "Crash of ABRT binary caused too many new files"
+        # "total 2" + the core file
+        assert_number_of_files $ABRT_CONF_DUMP_LOCATION 2 "Crash of ABRT binary caused too many new files"
 
         rm -rf $ABRT_BINARY_COREDUMP
     rlPhaseEnd
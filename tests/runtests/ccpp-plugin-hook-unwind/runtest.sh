@@ -85,6 +85,7 @@ rlJournalStart
         rlAssertExists "$crash_PATH/coredump"
 
         rlRun "./verify_core_backtrace.py $crash_PATH/core_backtrace $(uname -i) $(cat ${crash_PATH}/executable)" 0 "All frames must have required members"
+        rlAssertGrep "^core [1-9][0-9]* " /var/run/abrt/hook-timings
 
         rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash directory"
     rlPhaseEnd
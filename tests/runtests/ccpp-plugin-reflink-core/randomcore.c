@@ -0,0 +1,16 @@
+#include <stdlib.h>
+
+/* Crashes with 64MiB of data which are neither zeros nor file-backed, hence
+ * they are written to the core files */
+int main(void)
+{
+    const size_t size = 64 * 1024 * 1024;
+    unsigned *data = malloc(size);
+    size_t i;
+
+    srand(1);
+    for (i = 0; i < size / sizeof(*data); ++i)
+        data[i] = rand();
+
+    abort();
+}
@@ -0,0 +1,111 @@
+#!/bin/bash
+# vim: dict=/usr/share/beakerlib/dictionary.vim cpt=.,w,b,u,t,i,k
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   runtest.sh of ccpp-plugin-reflink-core
+#   Description: compat core is a reflink clone of the ABRT core on file systems supporting reflinks
+#   Author: ABRT Team
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+#
+#   Copyright (c) 2016 Red Hat, Inc. All rights reserved.
+#
+#   This program is free software: you can redistribute it and/or
+#   modify it under the terms of the GNU General Public License as
+#   published by the Free Software Foundation, either version 3 of
+#   the License, or (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be
+#   useful, but WITHOUT ANY WARRANTY; without even the implied
+#   warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+#   PURPOSE.  See the GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program. If not, see http://www.gnu.org/licenses/.
+#
+# ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+. /usr/share/beakerlib/beakerlib.sh
+. ../aux/lib.sh
+
+TEST="ccpp-plugin-reflink-core"
+PACKAGE="abrt"
+
+CFG_FILE="/etc/abrt/abrt-action-save-package-data.conf"
+CCPP_CFG_FILE="/etc/abrt/plugins/CCpp.conf"
+
+# $1 - reflink=0|1
+# Mounts a new XFS file system over the dump location, crashes randomcore with
+# its working directory in the file system and sets KIB_WRITTEN to the amount
+# of data written to the device.
+function crash_on_xfs
+{
+    rlRun "truncate -s 1G $TmpDir/xfs.img"
+    rlRun "mkfs.xfs -q -m reflink=$1 $TmpDir/xfs.img"
+    LOOPDEV=$(losetup --show -f $TmpDir/xfs.img)
+    rlRun "mount -o context=system_u:object_r:abrt_var_cache_t:s0 $LOOPDEV $ABRT_CONF_DUMP_LOCATION"
+
+    # The compat core must be on the same file system, a hidden directory
+    # is not considered a problem directory
+    rlRun "mkdir $ABRT_CONF_DUMP_LOCATION/.cwd"
+    pushd $ABRT_CONF_DUMP_LOCATION/.cwd
+
+    prepare
+    rlRun "sync"
+    written_before=$(awk '{ print $7 }' /sys/block/$(basename $LOOPDEV)/stat)
+
+    rlRun "sh -c '$TmpDir/randomcore; exit 0' &>/dev/null"
+    wait_for_hooks
+    get_crash_path
+
+    rlAssertExists "$crash_PATH/coredump"
+    rlAssertExists core*
+    rlRun "cmp core* $crash_PATH/coredump" 0 "Compat core is identical to ABRT core"
+
+    rlRun "sync"
+    written_after=$(awk '{ print $7 }' /sys/block/$(basename $LOOPDEV)/stat)
+    # Sectors are 512 bytes
+    KIB_WRITTEN=$(( (written_after - written_before) / 2 ))
+    rlLog "Written with reflink=$1: $KIB_WRITTEN KiB"
+
+    rlRun "abrt-cli rm $crash_PATH"
+    popd # $ABRT_CONF_DUMP_LOCATION/.cwd
+
+    rlRun "umount $ABRT_CONF_DUMP_LOCATION"
+    rlRun "losetup -d $LOOPDEV"
+    rlRun "rm -f $TmpDir/xfs.img"
+}
+
+rlJournalStart
+    rlPhaseStartSetup
+        check_prior_crashes
+        load_abrt_conf
+
+        TmpDir=$(mktemp -d)
+        rlRun "cc randomcore.c -o $TmpDir/randomcore" 0 "Compiling randomcore.c"
+        rlRun "ulimit -c unlimited"
+
+        rlFileBackup $CFG_FILE $CCPP_CFG_FILE
+        sed -i 's/ProcessUnpackaged = no/ProcessUnpackaged = yes/g' $CFG_FILE
+        sed -i 's/\(MakeCompatCore\) = no/\1 = yes/g' $CCPP_CFG_FILE
+    rlPhaseEnd
+
+    rlPhaseStartTest "tee without reflinks"
+        crash_on_xfs 0
+        TEE_KIB_WRITTEN=$KIB_WRITTEN
+        # Two copies of 64MiB
+        rlAssertGreater "Both core files are written" $TEE_KIB_WRITTEN $((2 * 64 * 1024))
+    rlPhaseEnd
+
+    rlPhaseStartTest "reflink clone"
+        crash_on_xfs 1
+        REFLINK_KIB_WRITTEN=$KIB_WRITTEN
+        rlAssertGreater "The core is written once" $((TEE_KIB_WRITTEN * 2 / 3)) $REFLINK_KIB_WRITTEN
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rlRun "rm -r $TmpDir" 0 "Removing tmp directory"
+        rlFileRestore # CFG_FILE CCPP_CFG_FILE
+    rlPhaseEnd
+rlJournalPrintText
+rlJournalEnd
@@ -60,6 +60,10 @@ rlJournalStart
 
         rlAssertExists "$crash_PATH/core_backtrace"
         rlAssertGrep "/bin/will_segfault" "$crash_PATH/core_backtrace"
+
+        rlAssertExists "$crash_PATH/hook_timings"
+        rlAssertGrep "^core [0-9]* [1-9][0-9]*$" "$crash_PATH/hook_timings"
+        rlAssertGrep "^total [0-9]* [0-9]*$" "$crash_PATH/hook_timings"
     rlPhaseEnd
 
     rlPhaseStartTest "core_backtrace contents"
@@ -100,6 +100,131 @@ EOF
         rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/CCpp*" 0 "Removing problem dirs"
     rlPhaseEnd
 
+    rlPhaseStartTest "Same CORE_BACKTRACEs without the duplicate index"
+        prepare
+
+        rlLog "Creating problem data."
+        python <<EOF
+import dbus
+bus = dbus.SystemBus()
+
+proxy = bus.get_object("org.freedesktop.problems", '/org/freedesktop/problems')
+
+problems = dbus.Interface(proxy, dbus_interface='org.freedesktop.problems')
+
+description = {"analyzer"    : "CCpp",
+               "reason"      : "Application has been killed",
+               "backtrace"   : "die()",
+               "executable"  : "/usr/bin/true",
+               "core_backtrace" :
+"{\"signal\":11,\"stacktrace\":[{\"crash_thread\":true,\"frames\":[{\"address\":270434862256,\"build_id\":\"94dc0d88101e6afa78c2d7f799bce5dcdf74446f\",\"build_id_offset\":820400,\"function_name\":\"__nanosleep\",\"file_name\":\"/lib64/libc.so.6\",\"fingerprint\":\"6c1eb9626919a2a5f6a4fc4c2edc9b21b33b7354\"},{\"address\":4210271,\"build_id\":\"f84fbe616129d71ffe0ca3c05283a1928f0fdf67\",\"build_id_offset\":15967},{\"address\":1000,\"build_id_offset\":1000},{\"address\":0,\"build_id_offset\":0}]}]}" }
+
+problems.NewProblem(description)
+EOF
+        wait_for_hooks
+
+        rlRun "cd $ABRT_CONF_DUMP_LOCATION/CCpp*"
+
+        # The duplicate is looked up by the parallel scan of all problem
+        # directories, which rebuilds the index
+        rlRun "rm -f $ABRT_CONF_DUMP_LOCATION/.dup-index $ABRT_CONF_DUMP_LOCATION/.dup-index-log"
+
+        # Because of occurrence
+        sleep 2
+
+        prepare
+
+        rlLog "Creating different problem data with same core_backtrace."
+        python <<EOF
+import dbus
+bus = dbus.SystemBus()
+
+proxy = bus.get_object("org.freedesktop.problems", '/org/freedesktop/problems')
+
+problems = dbus.Interface(proxy, dbus_interface='org.freedesktop.problems')
+
+description = {"analyzer"    : "CCpp",
+               "reason"      : "Application has been killed again",
+               "backtrace"   : "die_hard()",
+               "executable"  : "/usr/bin/true",
+               "core_backtrace" :
+"{\"signal\":11,\"stacktrace\":[{\"crash_thread\":true,\"frames\":[{\"address\":270434862256,\"build_id\":\"94dc0d88101e6afa78c2d7f799bce5dcdf74446f\",\"build_id_offset\":820400,\"function_name\":\"__nanosleep\",\"file_name\":\"/lib64/libc.so.6\",\"fingerprint\":\"6c1eb9626919a2a5f6a4fc4c2edc9b21b33b7354\"},{\"address\":4210271,\"build_id\":\"f84fbe616129d71ffe0ca3c05283a1928f0fdf67\",\"build_id_offset\":15967},{\"address\":1000,\"build_id_offset\":1000},{\"address\":0,\"build_id_offset\":0}]}]}" }
+
+problems.NewProblem(description)
+EOF
+        wait_for_hooks
+
+        rlAssertEquals "Checking if abrt counted only a single crash" `cat count` 2
+        rlRun "cat $ABRT_CONF_DUMP_LOCATION/.dup-index* | grep '^dup_key'" 0 "Indexed dup_key"
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/CCpp*" 0 "Removing problem dirs"
+    rlPhaseEnd
+
+    rlPhaseStartTest "Similar CORE_BACKTRACEs"
+        prepare
+
+        rlLog "Creating problem data."
+        python <<EOF
+import dbus
+bus = dbus.SystemBus()
+
+proxy = bus.get_object("org.freedesktop.problems", '/org/freedesktop/problems')
+
+problems = dbus.Interface(proxy, dbus_interface='org.freedesktop.problems')
+
+description = {"analyzer"    : "CCpp",
+               "reason"      : "Application has been killed",
+               "backtrace"   : "die()",
+               "executable"  : "/usr/bin/true",
+               "core_backtrace" :
+"{\"signal\":11,\"stacktrace\":[{\"crash_thread\":true,\"frames\":[{\"address\":270434862256,\"build_id\":\"94dc0d88101e6afa78c2d7f799bce5dcdf74446f\",\"build_id_offset\":820400,\"function_name\":\"__nanosleep\",\"file_name\":\"/lib64/libc.so.6\",\"fingerprint\":\"6c1eb9626919a2a5f6a4fc4c2edc9b21b33b7354\"},{\"address\":4210271,\"build_id\":\"f84fbe616129d71ffe0ca3c05283a1928f0fdf67\",\"build_id_offset\":15967},{\"address\":1000,\"build_id_offset\":1000},{\"address\":0,\"build_id_offset\":0}]}]}" }
+
+problems.NewProblem(description)
+EOF
+        wait_for_hooks
+
+        rlRun "cd $ABRT_CONF_DUMP_LOCATION/CCpp*"
+
+        # The MinHash signature lets the next problem find this one
+        rlAssertExists "crash_frames"
+        rlRun "cat $ABRT_CONF_DUMP_LOCATION/.dup-index* | grep '^crash_frames_lsh'" 0 "Indexed crash_frames_lsh"
+
+        # Because of occurrence
+        sleep 2
+
+        prepare
+
+        rlLog "Creating problem data with one different frame in core_backtrace."
+        python <<EOF
+import dbus
+bus = dbus.SystemBus()
+
+proxy = bus.get_object("org.freedesktop.problems", '/org/freedesktop/problems')
+
+problems = dbus.Interface(proxy, dbus_interface='org.freedesktop.problems')
+
+description = {"analyzer"    : "CCpp",
+               "reason"      : "Application has been killed again",
+               "backtrace"   : "die_hard()",
+               "executable"  : "/usr/bin/true",
+               "core_backtrace" :
+"{\"signal\":11,\"stacktrace\":[{\"crash_thread\":true,\"frames\":[{\"address\":270434862256,\"build_id\":\"94dc0d88101e6afa78c2d7f799bce5dcdf74446f\",\"build_id_offset\":820400,\"function_name\":\"__nanosleep\",\"file_name\":\"/lib64/libc.so.6\",\"fingerprint\":\"6c1eb9626919a2a5f6a4fc4c2edc9b21b33b7354\"},{\"address\":4210271,\"build_id\":\"f84fbe616129d71ffe0ca3c05283a1928f0fdf67\",\"build_id_offset\":15999},{\"address\":1000,\"build_id_offset\":1000},{\"address\":0,\"build_id_offset\":0}]}]}" }
+
+problems.NewProblem(description)
+EOF
+        wait_for_hooks
+
+        # One of four frames differs, the distance 0.25 is within the threshold
+        rlAssertEquals "Checking if abrt counted only a single crash" `cat count` 2
+        rlAssertEquals "Checking if there is only one problem directory" `ls -d $ABRT_CONF_DUMP_LOCATION/CCpp* | wc -l` 1
+    rlPhaseEnd
+
+    rlPhaseStartCleanup
+        rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/CCpp*" 0 "Removing problem dirs"
+    rlPhaseEnd
+
     rlPhaseStartTest "Same CORE_BACKTRACEs & different EXECUTABLEs"
         prepare
 
@@ -259,7 +259,7 @@ rlJournalStart
         rlAssertGrep "curl sent header: 'POST /rs/cases/[0-9]*/attachments/.*/(attachments|comments) HTTP/1" client_create3 -E
 
         rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash dir"
-        rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/last-ccpp"
+        rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/.crash-admission"
     rlPhaseEnd
 
    rlPhaseStartTest "rhtsupport create with option -u with attach email"
@@ -307,7 +307,7 @@ rlJournalStart
         rlAssertGrep "curl sent header: 'POST /rs/cases/[0-9]*/attachments/.*/(attachments|comments) HTTP/1" client_create4 -E
 
         rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash dir"
-        rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/last-ccpp"
+        rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/.crash-admission"
     rlPhaseEnd
 
     rlPhaseStartTest "rhtsupport create with option -u (uReport has been already submitted, email is configured)"
@@ -356,7 +356,7 @@ rlJournalStart
         rlAssertGrep "curl sent header: 'POST /rs/cases/[0-9]*/attachments/.*/(attachments|comments) HTTP/1" client_create5 -E
 
         rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash dir"
-        rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/last-ccpp"
+        rlRun "rm -rf $ABRT_CONF_DUMP_LOCATION/.crash-admission"
     rlPhaseEnd
 
     rlPhaseStartTest "rhtsupport create with option -u (uReport has been already submitted, email is not configured)"
@@ -0,0 +1,205 @@
+/* Sends a problem with a big item to abrt.socket using the v1 protocol, the
+ * v2 protocol or the v2 protocol with the item passed as a file descriptor.
+ * The batch mode sends BATCH_SIZE problems in one request.
+ *
+ * Usage: create_problem_socket_v2 v1|v2|fd|batch SIZE_IN_KiB
+ */
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SOCKET_FILE "/var/run/abrt/abrt.socket"
+#define FD_VALUE 0xFFFFFFFFu
+#define BATCH_SIZE 10
+
+static int full_send(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while (len > 0) {
+		ssize_t r = send(fd, p, len, MSG_NOSIGNAL);
+		if (r < 0) {
+			perror("send");
+			return -1;
+		}
+		p += r;
+		len -= r;
+	}
+	return 0;
+}
+
+static int send_v1_item(int fd, const char *key, const char *value)
+{
+	if (full_send(fd, key, strlen(key)) || full_send(fd, "=", 1))
+		return -1;
+	return full_send(fd, value, strlen(value) + 1);
+}
+
+static int send_v2_item(int fd, const char *key, const char *value, size_t value_len)
+{
+	uint32_t lengths[2] = { htonl(strlen(key)), htonl(value_len) };
+	if (full_send(fd, lengths, sizeof(lengths)) || full_send(fd, key, strlen(key)))
+		return -1;
+	return full_send(fd, value, value_len);
+}
+
+/* The lengths and the key carry the file descriptor */
+static int send_v2_fd_item(int fd, const char *key, int item_fd)
+{
+	uint32_t lengths[2] = { htonl(strlen(key)), htonl(FD_VALUE) };
+	char data[sizeof(lengths) + 256];
+	memcpy(data, lengths, sizeof(lengths));
+	memcpy(data + sizeof(lengths), key, strlen(key));
+
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct iovec iov = { .iov_base = data, .iov_len = sizeof(lengths) + strlen(key) };
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &item_fd, sizeof(int));
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)iov.iov_len) {
+		perror("sendmsg");
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s v1|v2|fd|batch SIZE_IN_KiB\n", argv[0]);
+		return 2;
+	}
+
+	const char *mode = argv[1];
+	const size_t size = strtoul(argv[2], NULL, 10) * 1024;
+
+	/* A text item, v1 can't send NUL bytes */
+	char *backtrace = malloc(size + 1);
+	size_t i;
+	for (i = 0; i < size; ++i)
+		backtrace[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+	backtrace[size] = '\0';
+
+	int item_fd = -1;
+	if (strcmp(mode, "fd") == 0) {
+		char tmp_name[] = "/tmp/backtrace-XXXXXX";
+		item_fd = mkstemp(tmp_name);
+		if (item_fd < 0 || write(item_fd, backtrace, size) != (ssize_t)size) {
+			perror("Can't create the backtrace file");
+			return 1;
+		}
+		unlink(tmp_name);
+	}
+
+	char reason[64];
+	snprintf(reason, sizeof(reason), "socket API %s test", mode);
+
+	/* Crashes of the same executable would be throttled as repeating */
+	const char *executable = strcmp(mode, "v1") == 0 ? "/usr/bin/true"
+		: strcmp(mode, "v2") == 0 ? "/usr/bin/false" : "/usr/bin/echo";
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un sun = { .sun_family = AF_UNIX, .sun_path = SOCKET_FILE };
+	if (fd < 0 || connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+		perror("Can't connect to " SOCKET_FILE);
+		return 1;
+	}
+
+	const char *items[][2] = {
+		{ "type", "java" },
+		{ "analyzer", "java" },
+		{ "pid", "1000" },
+		{ "executable", executable },
+		{ "reason", reason },
+	};
+	const size_t items_count = sizeof(items) / sizeof(items[0]);
+
+	int r = 0;
+	if (strcmp(mode, "v1") == 0) {
+		r = full_send(fd, "POST / HTTP/1.1\r\n\r\n", strlen("POST / HTTP/1.1\r\n\r\n"));
+		for (i = 0; r == 0 && i < items_count; ++i)
+			r = send_v1_item(fd, items[i][0], items[i][1]);
+		if (r == 0)
+			r = send_v1_item(fd, "backtrace", backtrace);
+	} else if (strcmp(mode, "batch") == 0) {
+		r = full_send(fd, "POST /batch HTTP/1.1\r\n\r\n", strlen("POST /batch HTTP/1.1\r\n\r\n"));
+		unsigned problem;
+		for (problem = 0; r == 0 && problem < BATCH_SIZE; ++problem) {
+			/* No executable, the crashes of one executable would be
+			 * throttled as repeating after the first one */
+			for (i = 0; r == 0 && i < items_count; ++i)
+				if (strcmp(items[i][0], "executable") != 0)
+					r = send_v2_item(fd, items[i][0], items[i][1], strlen(items[i][1]));
+			/* Every problem needs its own backtrace, otherwise they are duplicates */
+			backtrace[0] = 'A' + problem;
+			if (r == 0)
+				r = send_v2_item(fd, "backtrace", backtrace, size);
+			/* The end of the problem */
+			if (r == 0)
+				r = send_v2_item(fd, "", "", 0);
+		}
+	} else {
+		r = full_send(fd, "POST /v2 HTTP/1.1\r\n\r\n", strlen("POST /v2 HTTP/1.1\r\n\r\n"));
+		for (i = 0; r == 0 && i < items_count; ++i)
+			r = send_v2_item(fd, items[i][0], items[i][1], strlen(items[i][1]));
+		if (r == 0 && item_fd >= 0)
+			r = send_v2_fd_item(fd, "backtrace", item_fd);
+		else if (r == 0)
+			r = send_v2_item(fd, "backtrace", backtrace, size);
+	}
+
+	if (r != 0)
+		return 1;
+
+	shutdown(fd, SHUT_WR);
+
+	char response[256 * BATCH_SIZE];
+	ssize_t len = 0, rd;
+	while (len < (ssize_t)sizeof(response) - 1
+	       && (rd = read(fd, response + len, sizeof(response) - 1 - len)) > 0)
+		len += rd;
+	close(fd);
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	response[len] = '\0';
+	printf("%s: %ld ms, response: %s\n", mode,
+		(end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000,
+		response);
+
+	free(backtrace);
+
+	if (strcmp(mode, "batch") != 0)
+		return strncmp(response, "HTTP/1.1 201", strlen("HTTP/1.1 201")) != 0;
+
+	/* A line with the code of every problem follows the header */
+	if (strncmp(response, "HTTP/1.1 200", strlen("HTTP/1.1 200")) != 0)
+		return 1;
+	unsigned created = 0;
+	char *line = strstr(response, "\r\n\r\n");
+	for (line = line ? strtok(line + 4, "\n") : NULL; line; line = strtok(NULL, "\n"))
+		created += strncmp(line, "201 ", 4) == 0;
+	return created != BATCH_SIZE;
+}
@@ -34,6 +34,10 @@ PACKAGE="abrt"
 
 TEST_APP="create_problem_socket"
 TEST_APP_SRC=$TEST_APP".c"
+TEST_APP_V2="create_problem_socket_v2"
+TEST_APP_V2_SRC=$TEST_APP_V2".c"
+# KiB, v1 requests must fit in 4MiB
+ITEM_SIZE=3072
 
 CFG_FILE="/etc/abrt/abrt-action-save-package-data.conf"
 
@@ -47,9 +51,10 @@ rlPhaseStartSetup
         rlRun "dnf install -y abrt-devel libreport-devel" 0 "installed required devel packages"
 
         TmpDir=$(mktemp -d)
-        cp $TEST_APP_SRC $TmpDir
+        cp $TEST_APP_SRC $TEST_APP_V2_SRC $TmpDir
         pushd $TmpDir
         rlRun "gcc `pkg-config abrt --libs --cflags` $TEST_APP_SRC -o $TEST_APP" 0 "Testing app compiled successfully"
+        rlRun "gcc $TEST_APP_V2_SRC -o $TEST_APP_V2" 0 "v2 testing app compiled successfully"
     rlPhaseEnd
 
     rlPhaseStartTest
@@ -58,6 +63,31 @@ rlPhaseStartSetup
         get_crash_path
     rlPhaseEnd
 
+    rlPhaseStartTest "v2 protocol throughput"
+        for mode in v1 v2 fd; do
+            rlRun "./$TEST_APP_V2 $mode $ITEM_SIZE > $mode.log" 0 "Problem sent with $mode"
+            rlLog "$(cat $mode.log)"
+
+            v2_PATH="$(abrt-cli list 2> /dev/null | grep Directory | awk '{ print $2 }' | tail -n1)"
+            rlAssertGreater "Whole backtrace saved" $(stat -c %s $v2_PATH/backtrace) $((ITEM_SIZE * 1024 - 1))
+            rlAssertGrep "socket API $mode test" $v2_PATH/reason
+            rlRun "abrt-cli rm $v2_PATH" 0 "Remove $mode crash directory"
+        done
+        rlRun "ls -d $ABRT_CONF_DUMP_LOCATION/.incoming-*" 2 "No incomplete problem directory left"
+    rlPhaseEnd
+
+    rlPhaseStartTest "batch"
+        rlRun "./$TEST_APP_V2 batch 64 > batch.log" 0 "Batch of problems sent"
+        rlLog "$(cat batch.log)"
+        rlAssertEquals "Every problem created" $(grep -c "^201 " batch.log) 10
+
+        for batch_PATH in $(sed -n 's/^201 //p' batch.log); do
+            rlAssertGrep "socket API batch test" $batch_PATH/reason
+            rlAssertNotExists $batch_PATH/executable
+            abrt-cli rm $batch_PATH
+        done
+    rlPhaseEnd
+
     rlPhaseStartCleanup
         rlRun "abrt-cli rm $crash_PATH" 0 "Remove crash directory"
         popd #TmpDir